@@ -31,6 +31,11 @@ std::pair<CliResult, std::optional<ProgramConfig>> ParseCli(int argc, const char
             "output,o",
             po::value<std::string>()->default_value("./bin/a.elf"),
             "path to output file"
+        )
+        (
+            "codegen,c",
+            po::value<std::string>()->default_value("regalloc"),
+            "code generation strategy: stack | accumulator | regalloc | ssa"
         );
 
     std::ostringstream help_text;
@@ -59,7 +64,8 @@ std::pair<CliResult, std::optional<ProgramConfig>> ParseCli(int argc, const char
         ProgramConfig{
             .input = vm["input"].as<std::string>(),
             .output = vm["output"].as<std::string>(),
-            .ast = vm["ast"].as<std::string>()
+            .ast = vm["ast"].as<std::string>(),
+            .codegen = vm["codegen"].as<std::string>()
         }
     };
 }
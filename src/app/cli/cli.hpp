@@ -26,6 +26,7 @@ struct ProgramConfig {
     std::string input;
     std::string output;
     std::string ast;
+    std::string codegen;
 };
 
 std::pair<CliResult, std::optional<ProgramConfig>> ParseCli(int argc, const char** argv);
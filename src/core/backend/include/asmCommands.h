@@ -4,6 +4,14 @@
 #include <cstdint>
 #include <vector>
 #include <span>
+#include <optional>
+#include <utility>
+#include <limits>
+
+// whether the value survives sign extension from a 32-bit immediate
+inline bool FitsImm32(int64_t value) {
+    return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+}
 
 enum class r64 {
     rax = 0,
@@ -43,6 +51,56 @@ enum class r8 {
     r15b = 15,
 };
 
+enum class r16 {
+    ax = 0,
+    cx = 1,
+    dx = 2,
+    bx = 3,
+    sp = 4,
+    bp = 5,
+    si = 6,
+    di = 7,
+    r8w = 8,
+    r9w = 9,
+    r10w = 10,
+    r11w = 11,
+    r12w = 12,
+    r13w = 13,
+    r14w = 14,
+    r15w = 15,
+};
+
+// Instruction kinds the peephole pass looks into; everything else is Other.
+enum class Op {
+    Push,
+    PushImm,
+    Pop,
+    MovImm,
+    MovReg,
+    Load,
+    AddImm,
+    SubImm,
+    CmpImm,
+    Jcc,
+    Jmp,
+    Call,
+    // nops up to the next multiple of imm, resized whenever the code moves
+    Align,
+    Other,
+};
+
+// One emitted instruction. dst/src/imm hold the operands of the ops above
+// (Load: dst <- [src + imm]); branches and calls keep their destination offset.
+struct Instruction {
+    Op op = Op::Other;
+    r64 dst = r64::rax;
+    r64 src = r64::rax;
+    int64_t imm = 0;
+    size_t offset = 0;
+    std::optional<size_t> target;
+    std::vector<uint8_t> bytes;
+};
+
 class CodeBuffer {
 private:
     std::vector<uint8_t> vec;
@@ -74,11 +132,36 @@ public:
     }
 };
 
+// A code position that branches can name before it is bound.
+struct Label {
+    size_t id;
+};
+
 class x86_64 {
 private:
+    // load address of the first code byte, modulo any alignment asked for
+    size_t origin = 0;
     CodeBuffer code;
+    std::vector<Instruction> instructions;
+    // original offset -> offset after Assemble
+    std::vector<std::pair<size_t, size_t>> offsetMap;
+    // label id -> bound offset
+    std::vector<std::optional<size_t>> labels;
+    // position of a rel32 waiting for its label -> label id
+    std::vector<std::pair<size_t, size_t>> fixups;
+
+    void Record(Op op, r64 dst = r64::rax, r64 src = r64::rax, int64_t imm = 0);
+    void AddFixup(Label target);
+    void AppendMemoryOperand(int reg, r64 base, int32_t offset);
+    void AppendSetcc(uint8_t condition, r64 reg);
+    void AppendCmov(uint8_t condition, r64 dst, r64 src);
+    void AppendGroup1(int ext, r64 reg, int32_t imm);
 
 public:
+    x86_64() = default;
+    explicit x86_64(size_t origin)
+        : origin(origin) {}
+
     size_t GetCodeSize() const noexcept {
         return code.GetSize();
     }
@@ -91,6 +174,23 @@ public:
         code.InsertNumber(num, pos);
     }
 
+    // The emitted code as an instruction list, with patched bytes and resolved branch targets.
+    std::vector<Instruction> GetInstructions() const;
+    // Replaces the code with the given list, retargeting branches and calls to the new layout.
+    void Assemble(const std::vector<Instruction>& list);
+    // Where code first emitted at the given offset ended up after Assemble.
+    size_t MapOffset(size_t offset) const;
+    // Shortens every jump whose displacement fits into rel8.
+    void Relax();
+
+    Label NewLabel();
+    void Bind(Label label);
+    // pads with nops so the next instruction starts on a multiple of boundary
+    void Align(size_t boundary);
+    bool HasUnresolvedFixups() const noexcept {
+        return !fixups.empty();
+    }
+
     void push(r64 reg);
     void push(int32_t imm);
     void pop(r64 reg);
@@ -98,12 +198,24 @@ public:
     void mov(r64 dst, r64 src);
     void mov(r64 dst, r64 src, int32_t offset);
     void mov(r64 src, int32_t offset, r64 dst);
+    void mov(r64 base, int32_t offset, r8 src);
+    void mov(r64 base, int32_t offset, r16 src);
+    void movabs(r64 reg, int64_t imm);
     void add(r64 dst, r64 src);
     void add(r64 reg, int32_t imm);
     void sub(r64 dst, r64 src);
     void sub(r64 reg, int32_t imm);
     void imul(r64 dst, r64 src);
+    void imul(r64 dst, r64 src, int32_t imm);
+    void imul(r64 reg);
     void idiv(r64 reg);
+    void mul(r64 reg);
+    void shr(r64 reg, uint8_t imm);
+    void shl(r64 reg, uint8_t imm);
+    void sar(r64 reg, uint8_t imm);
+    void lea(r64 dst, r64 base, r64 index, uint8_t scale);
+    void or_(r64 dst, r64 src);
+    void and_(r64 reg, int32_t imm);
     void cmp(r64 dst, r64 src);
     void cmp(r64 reg, int32_t imm);
     void je(int32_t offset);
@@ -112,21 +224,41 @@ public:
     void jg(int32_t offset);
     void jge(int32_t offset);
     void jne(int32_t offset);
+    void jle(int32_t offset);
+    void je(Label target);
+    void jmp(Label target);
+    void jl(Label target);
+    void jg(Label target);
+    void jge(Label target);
+    void jne(Label target);
+    void jle(Label target);
     void call(int32_t offset);
     void xchg(r64 dst, r64 src);
+    void test(r64 dst, r64 src);
+    void cqo();
     void neg(r64 reg);
     void inc(r64 reg);
     void dec(r64 reg);
     void ret();
     void syscall();
     void nop();
+    void rep_movsb();
+    void rdtsc();
     void setg(r64 reg);
     void setge(r64 reg);
     void setl(r64 reg);
     void setle(r64 reg);
     void sete(r64 reg);
     void setne(r64 reg);
+    void cmovg(r64 dst, r64 src);
+    void cmovge(r64 dst, r64 src);
+    void cmovl(r64 dst, r64 src);
+    void cmovle(r64 dst, r64 src);
+    void cmove(r64 dst, r64 src);
+    void cmovne(r64 dst, r64 src);
     void movzx(r64 dst, r8 src);
+    void movzx(r64 dst, r64 base, int32_t offset);
+    void movzxw(r64 dst, r64 base, int32_t offset);
 };
 
 #endif // ASM_COMMANDS_H
@@ -24,6 +24,12 @@ public:
         : BaseException("Code generator error: " + message) {}
 };
 
+class OptionException : public BaseException {
+public:
+    OptionException(const std::string& message)
+        : BaseException("Option error: " + message) {}
+};
+
 } // namespace BackendExcept
 
 #endif // BACKEND_EXCEPTIONS_H
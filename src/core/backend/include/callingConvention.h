@@ -0,0 +1,31 @@
+#ifndef CALLING_CONVENTION_H
+#define CALLING_CONVENTION_H
+
+#include "asmCommands.h"
+
+// Arguments travel in these registers, the result comes back in rax.
+inline constexpr r64 kArgRegs[] {
+    r64::rdi,
+    r64::rsi,
+    r64::rdx,
+    r64::rcx,
+    r64::r8,
+    r64::r9,
+};
+
+// What a call may destroy. Generated functions keep only rbx, rbp and r12-r15; the runtime
+// routines document their sets at their definitions in standardFunctions.cpp.
+inline constexpr r64 kCallClobbers[] {
+    r64::rax, r64::rcx, r64::rdx, r64::rsi, r64::rdi, r64::r8, r64::r9, r64::r10, r64::r11,
+};
+inline constexpr r64 kRuntimeClobbers[] {
+    r64::rax, r64::rcx, r64::rdx, r64::rsi, r64::rdi, r64::r11,
+};
+inline constexpr r64 kClockNsClobbers[] {
+    r64::rax, r64::rcx, r64::rsi, r64::rdi, r64::r11,
+};
+inline constexpr r64 kCyclesClobbers[] {
+    r64::rax, r64::rdx,
+};
+
+#endif // CALLING_CONVENTION_H
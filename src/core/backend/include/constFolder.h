@@ -0,0 +1,47 @@
+#ifndef CONST_FOLDER_H
+#define CONST_FOLDER_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "node.hpp"
+
+// Folds constant subtrees and propagates constants and copies through each Def body.
+// Facts are tracked per variable name, following the generator's scoping: they die with
+// the scope that declared the variable, are intersected where an If rejoins, and anything
+// a While body assigns is forgotten before the loop, since the back edge brings it back.
+class ConstantFolder {
+private:
+    struct Fact {
+        std::optional<int64_t> constant;
+        std::string copyOf;
+
+        bool operator==(const Fact& other) const = default;
+    };
+
+    std::unordered_map<std::string, Fact> facts;
+    std::vector<std::vector<std::string>> scopes;
+
+    void FoldDef(Node* def);
+    void FoldStmt(Node* node);
+    void FoldExpr(Node* node);
+    void FoldAssignment(Node* node);
+    void FoldIf(Node* node);
+    void FoldWhile(Node* node);
+
+    bool IsDeclared(const std::string& name) const;
+    void EnterScope();
+    void ExitScope();
+    void Kill(const std::string& name);
+
+    static void CollectAssigned(const Node* node, std::unordered_set<std::string>& names);
+
+public:
+    void Run(Node* program);
+};
+
+#endif // CONST_FOLDER_H
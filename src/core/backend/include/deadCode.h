@@ -0,0 +1,29 @@
+#ifndef DEAD_CODE_H
+#define DEAD_CODE_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "node.hpp"
+
+// Removes code that can never run. Functions that main cannot reach through calls are
+// dropped, and inside the rest statements after a Return are cut off, as are If and While
+// bodies whose condition is the constant 0. The runtime routines are pruned separately by
+// the generator, which emits only the ones the remaining code refers to.
+class DeadCodeEliminator {
+private:
+    std::unordered_map<std::string, Node*> defs;
+    std::unordered_set<std::string> reachable;
+
+    void CollectDefs(Node* node);
+    void MarkReachable(const std::string& name);
+    void RemoveUnreachable(Node* node);
+
+    bool PruneStmt(Node* node);
+
+public:
+    void Run(Node* program);
+};
+
+#endif // DEAD_CODE_H
@@ -0,0 +1,35 @@
+#ifndef FRAME_LAYOUT_H
+#define FRAME_LAYOUT_H
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "regAlloc.h"
+#include "node.hpp"
+
+// Sizes a function's frame before its body is emitted. Declarations are resolved with the
+// same scoping rules as ScopeManager, which hands the slots of a closed block back to the
+// next one, so the frame is the deepest the slot stack gets.
+class FrameLayout {
+private:
+    struct Scope {
+        std::unordered_set<std::string> names;
+        int slots = 0;
+    };
+
+    const RegisterAssignment* assignment = nullptr;
+    std::vector<Scope> scopes;
+    int slots = 0;
+    int maxSlots = 0;
+
+    void Declare(const Node* decl);
+    bool IsDeclared(const std::string& name) const;
+    void VisitStmt(const Node* node);
+
+public:
+    // bytes below rbp the function's variables occupy
+    int Size(const Node* def, const RegisterAssignment& registers);
+};
+
+#endif // FRAME_LAYOUT_H
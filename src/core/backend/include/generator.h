@@ -2,6 +2,7 @@
 #define GENERATOR_H
 
 #include <unordered_map>
+#include <unordered_set>
 #include <span>
 #include <vector>
 #include <string>
@@ -9,11 +10,52 @@
 
 #include "asmCommands.h"
 #include "headers.h"
+#include "regAlloc.h"
+#include "ssaRegAlloc.h"
+#include "strengthReduce.h"
 #include "node.hpp"
 
+// Internal runtime routines; the leading underscores keep them out of the user namespace.
+inline const std::string kRuntimeFlushStdout = "__flush_stdout";
+
+enum class CodeGenMode {
+    Stack,
+    Accumulator,
+    RegAlloc,
+    Ssa,
+};
+
+struct CodeGenOptions {
+    CodeGenMode mode = CodeGenMode::RegAlloc;
+    bool peephole = true;
+    bool peepholeStats = false;
+    // largest function body, in AST nodes, substituted into its call sites; 0 turns inlining off
+    size_t inlineLimit = 40;
+    bool fold = true;
+    bool licm = true;
+    bool cse = true;
+    // small if bodies that only assign a variable become cmov
+    bool cmov = true;
+    // bodies per test in unrolled counted loops; 1 turns unrolling off
+    size_t unrollFactor = 4;
+    bool tailCalls = true;
+    bool relax = true;
+    bool dce = true;
+    // loop headers start on a multiple of this many bytes; 1 leaves them where they fall
+    size_t loopAlign = 16;
+    // prints every function's optimized SSA form to stderr
+    bool dumpSsa = false;
+};
+
+// A variable lives either in a register or in the frame at [rbp - offset].
+struct VarLocation {
+    int offset = 0;
+    std::optional<r64> reg;
+};
+
 class ScopeManager {
 private:
-    std::vector<std::unordered_map<std::string, int>> symbolStack;
+    std::vector<std::unordered_map<std::string, VarLocation>> symbolStack;
     int stackOffset = 0;
     const int kWordSize = 8;
 
@@ -22,18 +64,27 @@ public:
         symbolStack.emplace_back();
     }
 
+    // the scope's frame slots go back to whatever the next scope declares
     void ExitScope() {
-        stackOffset -= symbolStack.back().size() * kWordSize;
+        for (const auto& [name, location] : symbolStack.back()) {
+            if (!location.reg.has_value()) {
+                stackOffset -= kWordSize;
+            }
+        }
         symbolStack.pop_back();
     }
 
-    int AddSymbol(const std::string& name) {
-        stackOffset += kWordSize;
-        symbolStack.back()[name] = stackOffset;
-        return stackOffset;
+    VarLocation AddSymbol(const std::string& name, std::optional<r64> reg = std::nullopt) {
+        VarLocation location {.reg = reg};
+        if (!reg.has_value()) {
+            stackOffset += kWordSize;
+            location.offset = stackOffset;
+        }
+        symbolStack.back()[name] = location;
+        return location;
     }
 
-    std::optional<int> FindSymbol(const std::string& name) const {
+    std::optional<VarLocation> FindSymbol(const std::string& name) const {
         for (auto stackIter = symbolStack.rbegin(); stackIter != symbolStack.rend(); ++stackIter) {
             if (auto mapIter = stackIter->find(name); mapIter != stackIter->end()) {
                 return mapIter->second;
@@ -56,29 +107,130 @@ public:
         auto iter = mp.find(name);
         return iter == mp.end() ? std::nullopt : std::make_optional(iter->second);
     }
+
+    std::vector<size_t> GetOffsets() const {
+        std::vector<size_t> offsets;
+        for (const auto& [name, offset] : mp) {
+            offsets.push_back(offset);
+        }
+        return offsets;
+    }
+};
+
+class DataManager {
+private:
+    std::unordered_map<std::string, uint64_t> symbols;
+    std::vector<uint8_t> rodata;
+    uint64_t bssSize = 0;
+    const uint64_t kWordSize = 8;
+
+public:
+    uint64_t AddRodata(const std::string& name, std::span<const uint8_t> bytes) {
+        uint64_t addr = kRodataLoadAddress + rodata.size();
+        rodata.insert(rodata.end(), bytes.begin(), bytes.end());
+        symbols[name] = addr;
+        return addr;
+    }
+
+    uint64_t AddBss(const std::string& name, uint64_t size) {
+        uint64_t addr = kBssLoadAddress + bssSize;
+        bssSize += (size + kWordSize - 1) / kWordSize * kWordSize;
+        symbols[name] = addr;
+        return addr;
+    }
+
+    std::optional<uint64_t> FindData(const std::string& name) const noexcept {
+        auto iter = symbols.find(name);
+        return iter == symbols.end() ? std::nullopt : std::make_optional(iter->second);
+    }
+
+    uint64_t GetBssSize() const noexcept {
+        return bssSize;
+    }
+
+    size_t GetRodataSize() const noexcept {
+        return rodata.size();
+    }
+
+    const uint8_t* GetRodataData() const noexcept {
+        return rodata.data();
+    }
 };
 
 class CodeGen {
 private:
+    // a register lent to an expression temporary; spilled ones were pushed and get popped back
+    struct ScratchReg {
+        r64 reg;
+        bool spilled;
+    };
+
+    CodeGenOptions options;
     x86_64 asmGen;
     ScopeManager vars;
     FunctionManager funcs;
+    DataManager data;
+    std::string currentFunction;
+    RegisterAssignment assignment;
+    std::vector<r64> savedRegs;
+    // false when the function never touches its frame and skips setting up rbp
+    bool framePointer = true;
+    std::vector<r64> freeScratch;
+    std::vector<r64> liveResults;
+    Label bodyEntry {};
+    const ssa::Function* ssaFunc = nullptr;
+    SsaAssignment ssaAssignment;
+    // spill slots sit below this: rbp, or rsp in a leaf that uses the red zone
+    r64 ssaFrameBase = r64::rbp;
+    std::vector<Label> blockLabels;
 
     void CreateElfHeader(Elf64_Ehdr* ehdr);
     void CreateProgramHeader(Elf64_Phdr* phdr, uint64_t filesz);
+    void CreateRodataProgramHeader(Elf64_Phdr* phdr, uint64_t offset, uint64_t filesz);
+    void CreateBssProgramHeader(Elf64_Phdr* phdr, uint64_t memsz);
 
-    void CreateStandartFunctions();
+    int32_t GetDataAddress(const std::string& name) const;
+
+    void CreateStandartFunctions(const std::unordered_set<NodeType>& builtins);
+    void CreateWriteStdout();
+    void CreateFlushStdout();
     void CreatePrintAscii();
+    void CreatePrintStr();
     void CreatePrintInt();
+    void CreateFillStdin();
+    void CreateInitStdin();
+    void CreateParseInt();
     void CreateReadInt();
+    void CreateMapFile();
+    void CreateMapReadInt();
+    void CreateMapEof();
+    void CreateClockNs();
+    void CreateCycles();
 
     void CodeGenExpr(Node* node);
+    void CodeGenExprTo(Node* node, r64 dst);
     void CodeGenStmt(Node* node);
 
+    VarLocation FindVariable(Node* node) const;
+    std::optional<r64> AssignedRegister(const Node* decl) const;
+    std::optional<r64> VariableRegister(Node* node) const;
+    void LoadVariable(const VarLocation& location, r64 dst);
+    void StoreVariable(const VarLocation& location, r64 src);
+    ScratchReg AcquireScratch(r64 dst);
+    void ReleaseScratch(const ScratchReg& scratch);
+
     void EmitNumber(Node* node);
     void EmitIdentifier(Node* node);
+    std::vector<r64> SaveLiveRegisters(std::span<const r64> clobbers, bool returnsValue);
+    void RestoreLiveRegisters(const std::vector<r64>& saved);
+    void LoadCallArgs(Node* node);
     void EmitCallInt(Node* node);
     void EmitReadInt();
+    void EmitMapFile(Node* node);
+    void EmitMapReadInt(Node* node);
+    void EmitMapEof(Node* node);
+    void EmitClockNs();
+    void EmitCycles();
     void EmitAdd(Node* node);
     void EmitSub(Node* node);
     void EmitMul(Node* node);
@@ -89,17 +241,77 @@ private:
     void EmitLessOrEqual(Node* node);
     void EmitIdentical(Node* node);
     void EmitNotIdentical(Node* node);
+    static int RegisterNeed(const Node* node);
+    static bool EvaluatesRightFirst(const Node* node);
+    static bool OverwritesBeforeRead(const Node* node, const std::string& name);
+    ScratchReg EmitRegOperands(Node* node, r64 dst);
+    void EmitRegBinary(Node* node, r64 dst);
+    void EmitRegCompare(Node* node);
+    void EmitRegDiv(r64 dst, r64 divisor);
+    void EmitMulByConstant(r64 dst, const MulPlan& plan, r64 tmp);
+    void EmitDivByConstant(r64 dst, int64_t divisor, r64 tmp);
+    bool EmitStackByConstant(Node* node);
+    bool EmitRegByConstant(Node* node, r64 dst);
+    void EmitAddImmediate(r64 dst, int32_t imm);
+    void EmitSubImmediate(r64 dst, int32_t imm);
+    void EmitImmediateOp(NodeType type, r64 dst, int32_t imm);
+    bool EmitStackImmediate(Node* node);
+    bool EmitRegImmediate(Node* node, r64 dst);
+    bool EmitStackCompareImmediate(Node* node);
+    static void PromoteTailCalls(Node* node);
     void EmitDef(Node* node);
     void EmitSemicolon(Node* node);
     void EmitEqual(Node* node);
     void EmitPrintAscii(Node* node);
     void EmitPrintInt(Node* node);
+    void EmitPrintStr(Node* node);
+    void EmitConditionFlags(Node* cond);
+    void EmitBranchIfFalse(Node* cond, Label target);
+    void EmitBranchIfTrue(Node* cond, Label target);
+    void EmitCmov(Node* cond, r64 dst, r64 src);
+    bool EmitConditionalMove(Node* node);
     void EmitIf(Node* node);
     void EmitWhile(Node* node);
     void EmitReturn(Node* node);
+    void EmitTailCall(Node* node);
     void EmitCallVoid(Node* node);
+    void EmitPrologue(int32_t frameSize);
+    void EmitEpilogue();
+    void EmitExit();
+    uint64_t StringLiteralAddress(const std::string& literal);
+    uint64_t PathLiteralAddress(const std::string& path);
+    void EmitCallTo(const std::string& name);
+
+    void EmitSsaDef(Node* node);
+    const SsaLocation& SsaLocationOf(ssa::ValueId value) const;
+    std::optional<r64> SsaRegister(ssa::ValueId value) const;
+    std::optional<int32_t> SsaImmediate(ssa::ValueId value) const;
+    void LoadSsaValue(ssa::ValueId value, r64 dst);
+    void StoreSsaValue(ssa::ValueId value, r64 src);
+    r64 SsaOperand(ssa::ValueId value, r64 scratch);
+    void EmitSsaMove(const SsaLocation& dst, const SsaLocation& src);
+    void EmitParallelMove(std::vector<std::pair<SsaLocation, SsaLocation>> moves);
+    void EmitSsaInst(ssa::ValueId value);
+    void EmitSsaBinary(ssa::ValueId value);
+    void EmitSsaDiv(ssa::ValueId value);
+    ssa::Opcode EmitSsaCompare(const ssa::Inst& inst);
+    void EmitSetcc(ssa::Opcode op, r64 reg);
+    void EmitJcc(ssa::Opcode op, Label target);
+    void EmitCmovcc(ssa::Opcode op, r64 dst, r64 src);
+    void EmitSsaSelect(ssa::ValueId value);
+    void EmitSsaCallArgs(const ssa::Inst& call);
+    void EmitSsaBuiltin(ssa::ValueId value);
+    bool IsSsaTailCall(ssa::ValueId value) const;
+    bool IsSsaForwarder(ssa::BlockId block) const;
+    ssa::BlockId SsaJumpTarget(ssa::BlockId block) const;
+    ssa::BlockId NextSsaBlock(ssa::BlockId block) const;
+    void EmitSsaTerminator(ssa::BlockId block);
+    void EmitSsaTailCall(const ssa::Inst& call);
 
 public:
+    explicit CodeGen(const CodeGenOptions& opts = {})
+        : options(opts), asmGen(kCodeOffset) {}
+
     void GenerateProgram(Node* program, const std::string& fileName);
 };
 
@@ -6,4 +6,14 @@
 constexpr uint64_t kElfHeaderSize = sizeof(Elf64_Ehdr);
 constexpr uint64_t kProgramHeaderSize = sizeof(Elf64_Phdr);
 
+// text (R+X), read-only data (R) and a zero-filled writable segment for runtime state
+constexpr uint64_t kProgramHeaderCount = 3;
+constexpr uint64_t kCodeOffset = kElfHeaderSize + kProgramHeaderCount * kProgramHeaderSize;
+
+constexpr uint64_t kPageSize = 0x1000;
+
+// data segments must stay below 2 GiB so that addresses fit into a sign-extended imm32
+constexpr uint64_t kRodataLoadAddress = 0x10000000;
+constexpr uint64_t kBssLoadAddress = 0x20000000;
+
 #endif // HEADERS_H
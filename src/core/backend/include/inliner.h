@@ -0,0 +1,48 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "node.hpp"
+#include "tree.hpp"
+
+// Substitutes small leaf functions into their call sites. A candidate has at most six
+// parameters, makes no calls itself (so it cannot recurse) and has at most `limit` nodes in
+// its body. The copied body gets its locals renamed with a per-site prefix, parameters become
+// assignments from the arguments, and Return becomes an assignment to the call's target.
+// The AST has no jumps, so a Return nested in an If also sets a done flag, and everything
+// after that If is guarded by the flag.
+class Inliner {
+private:
+    // one expansion: where results go and how its locals are named
+    struct Site {
+        std::string prefix;
+        std::string target;
+        std::string flag;
+    };
+
+    Tree& tree;
+    size_t limit;
+    size_t siteCount = 0;
+    std::unordered_map<std::string, const Node*> candidates;
+
+    void VisitStmt(Node* node);
+    void Expand(Node* stmt, const Node* call, const std::string& target, bool returnTarget);
+
+    std::vector<Node*> Lower(const std::vector<const Node*>& stmts, const Site& site, bool nested);
+    std::vector<Node*> LowerReturn(const Node* ret, const Site& site, bool nested);
+    Node* Clone(const Node* node, const std::string& prefix);
+    Node* Chain(const std::vector<Node*>& stmts);
+    Node* Assign(const std::string& name, Node* value);
+
+    bool IsCandidate(const Node* def) const;
+
+public:
+    Inliner(Tree& ast, size_t sizeLimit) : tree(ast), limit(sizeLimit) {}
+
+    void Run(Node* program);
+};
+
+#endif // INLINER_H
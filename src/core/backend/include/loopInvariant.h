@@ -0,0 +1,40 @@
+#ifndef LOOP_INVARIANT_H
+#define LOOP_INVARIANT_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "node.hpp"
+#include "tree.hpp"
+
+// Hoists loop-invariant expressions out of While loops. An expression is invariant when it
+// is pure, cannot trap and reads only variables the loop never assigns; every maximal one is
+// computed once into a fresh temporary right before the loop. Outer loops are handled first,
+// so an inner loop's bounds derived from the outer index end up in the outer body.
+class LoopInvariantMotion {
+private:
+    Tree& tree;
+    size_t tempCount = 0;
+
+    // per loop: the names it assigns, and the temporaries created for it so far
+    std::unordered_set<std::string> assigned;
+    std::unordered_map<std::string, std::string> temps;
+    std::vector<Node*> hoisted;
+
+    void VisitStmt(Node* node);
+    void HoistLoop(Node* loop);
+    void HoistInStmt(Node* node);
+    void HoistInExpr(Node* node);
+
+    bool IsInvariant(const Node* node) const;
+    std::string TempFor(Node* expr);
+
+public:
+    explicit LoopInvariantMotion(Tree& ast) : tree(ast) {}
+
+    void Run(Node* program);
+};
+
+#endif // LOOP_INVARIANT_H
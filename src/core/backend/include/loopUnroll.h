@@ -0,0 +1,51 @@
+#ifndef LOOP_UNROLL_H
+#define LOOP_UNROLL_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "node.hpp"
+#include "tree.hpp"
+
+// Unrolls counted While loops: `while (i < bound) { ...; i = i + step; }`, with <= or a
+// decreasing index and > / >= as well, where the body assigns the index only in its last
+// statement and the bound is pure and never assigned in the loop. A loop whose index starts
+// at a known constant and whose bound is a literal is replaced by copies of its body when
+// the trip count is small. Any other counted loop gets an unrolled copy running `factor`
+// bodies per test, while the index is at least `factor - 1` steps short of the bound, and
+// the original loop after it runs the remaining iterations. Inner loops are unrolled first.
+class LoopUnroller {
+private:
+    struct CountedLoop {
+        std::string index;
+        NodeType compare;
+        const Node* bound;
+        // signed: negative for a decreasing index
+        int64_t step;
+    };
+
+    Tree& tree;
+    size_t factor;
+    // variables holding a known constant at the current statement
+    std::unordered_map<std::string, int64_t> constants;
+
+    void VisitStmt(Node* node);
+    void Unroll(Node* loop, const std::unordered_map<std::string, int64_t>& entry);
+    bool UnrollFully(Node* loop, const CountedLoop& counted, int64_t start);
+    void UnrollPartially(Node* loop, const CountedLoop& counted);
+
+    std::optional<CountedLoop> Match(const Node* loop) const;
+    Node* Clone(const Node* node);
+    Node* Repeat(const Node* body, size_t times);
+    void Forget(const Node* stmt);
+
+public:
+    LoopUnroller(Tree& ast, size_t unrollFactor) : tree(ast), factor(unrollFactor) {}
+
+    void Run(Node* program);
+};
+
+#endif // LOOP_UNROLL_H
@@ -0,0 +1,34 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "asmCommands.h"
+
+// Rewrites short instruction windows of the finished code until nothing matches any more.
+// A window never spans a branch target or a function entry, except at its first instruction.
+class PeepholeOptimizer {
+private:
+    struct Rule {
+        std::string name;
+        size_t window;
+        // replacement for the window, if the rule applies; `next` follows the window and is left alone
+        std::function<std::optional<std::vector<Instruction>>(std::span<const Instruction> window, const Instruction* next)> rewrite;
+        size_t hits = 0;
+    };
+
+    std::vector<Rule> rules;
+
+public:
+    PeepholeOptimizer();
+
+    void Run(x86_64& code, const std::vector<size_t>& entries);
+    void PrintStats(std::ostream& out) const;
+};
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,59 @@
+#ifndef REG_ALLOC_H
+#define REG_ALLOC_H
+
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <utility>
+
+#include "asmCommands.h"
+#include "node.hpp"
+
+struct RegisterAssignment {
+    // declaring identifier node -> register; variables missing here live in the frame
+    std::unordered_map<const Node*, r64> registers;
+    // callee-saved registers the function has to preserve
+    std::vector<r64> calleeSaved;
+    // registers left over for expression temporaries
+    std::vector<r64> scratch;
+};
+
+// Linear-scan allocation of a function's variables.
+// Positions are handed out in the order the generator emits code, declarations are
+// resolved with the same scoping rules as ScopeManager, and a variable used inside a
+// loop it was declared outside of stays live until the end of that loop.
+class RegisterAllocator {
+private:
+    struct Interval {
+        const Node* decl;
+        int start;
+        int end;
+        std::vector<int> uses;
+        bool crossesCall = false;
+    };
+
+    std::vector<Interval> intervals;
+    std::vector<std::unordered_map<std::string, size_t>> scopes;
+    std::vector<std::pair<int, int>> loops;
+    std::vector<int> calls;
+    int position = 0;
+
+    void Declare(const Node* decl, int pos);
+    void Touch(const std::string& name);
+    void MarkCall();
+
+    void VisitStmt(const Node* node);
+    void VisitExpr(const Node* node);
+
+    void ExtendOverLoops();
+    void MarkCallCrossings();
+    RegisterAssignment LinearScan();
+
+public:
+    RegisterAssignment Allocate(const Node* def);
+
+    // every variable stays in the frame and all scratch registers are free
+    static RegisterAssignment FrameOnly();
+};
+
+#endif // REG_ALLOC_H
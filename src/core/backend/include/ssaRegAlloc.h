@@ -0,0 +1,75 @@
+#ifndef SSA_REG_ALLOC_H
+#define SSA_REG_ALLOC_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "asmCommands.h"
+#include "ir.hpp"
+
+// Where an SSA value lives for its whole lifetime. Constants get no storage and are
+// materialized wherever they are read.
+struct SsaLocation {
+    enum class Kind {
+        None,
+        Register,
+        Stack,
+        Constant,
+    };
+
+    Kind kind = Kind::None;
+    r64 reg = r64::rax;
+    // Stack: the value is at [frame base - offset]
+    int32_t offset = 0;
+    int64_t value = 0;
+
+    bool operator==(const SsaLocation& other) const = default;
+};
+
+struct SsaAssignment {
+    std::vector<SsaLocation> locations;
+    // comparisons emitted as cmp + jcc by the branch right after them, without a value of their own
+    std::vector<bool> fused;
+    // callee-saved registers the function has to preserve
+    std::vector<r64> calleeSaved;
+    int32_t frameSize = 0;
+};
+
+// Linear-scan allocation over SSA values, for a function whose critical edges are split and
+// whose blocks are numbered in layout order. Liveness is solved on the CFG and every value
+// gets one interval from its first to its last live position; a phi is read at the end of
+// each predecessor, where the copies into it go. An interval that crosses a call avoids the
+// registers that call destroys, so nothing is saved around calls. rax, rdx and r11 are never
+// handed out: the emitter needs them for results, division and shuffling spilled operands.
+class SsaRegisterAllocator {
+private:
+    struct Interval {
+        ssa::ValueId value;
+        int start;
+        int end;
+        // registers destroyed by calls inside the interval
+        std::vector<r64> forbidden;
+        std::optional<r64> hint;
+    };
+
+    const ssa::Function* func = nullptr;
+    SsaAssignment assignment;
+    std::vector<int> positions;
+    std::vector<int> blockStart;
+    std::vector<int> blockEnd;
+    std::vector<Interval> intervals;
+
+    void Number();
+    void FindFusedComparisons();
+    void BuildIntervals();
+    void AddHints();
+    void LinearScan();
+
+    bool NeedsLocation(ssa::ValueId value) const;
+
+public:
+    SsaAssignment Allocate(const ssa::Function& function);
+};
+
+#endif // SSA_REG_ALLOC_H
@@ -0,0 +1,33 @@
+#ifndef STRENGTH_REDUCE_H
+#define STRENGTH_REDUCE_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// x * factor without imul, applied in this order:
+// an optional ((x << addShift) +/- x), lea steps x + x * scale, a final shift and a negation
+struct MulPlan {
+    uint8_t addShift = 0;
+    int addSign = 0;
+    std::vector<uint8_t> leaScales;
+    uint8_t shift = 0;
+    bool negate = false;
+};
+
+// nullopt when imul is at least as cheap as the replacement sequence
+std::optional<MulPlan> PlanMultiply(int64_t factor);
+
+// x / divisor == (mulhi(x, multiplier) [+ x]) >> shift, rounded toward zero,
+// for a divisor >= 3 that is not a power of two (Granlund-Montgomery)
+struct DivMagic {
+    int64_t multiplier;
+    uint8_t shift;
+};
+
+DivMagic SignedDivMagic(int64_t divisor);
+
+// division by 0 and -1 keeps idiv, which traps where the hardware does
+bool IsReducibleDivisor(int64_t divisor);
+
+#endif // STRENGTH_REDUCE_H
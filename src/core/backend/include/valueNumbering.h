@@ -0,0 +1,60 @@
+#ifndef VALUE_NUMBERING_H
+#define VALUE_NUMBERING_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "node.hpp"
+#include "tree.hpp"
+
+// Eliminates common subexpressions in each Def body. Every assignment gives its variable a
+// fresh version, and a pure expression is numbered by its shape and the versions of the
+// variables it reads, so two expressions with the same number compute the same value. A
+// repeated expression reads the variable that was assigned it, or a temporary computed right
+// before its first occurrence. Values flow into If and While bodies, which the code before
+// them dominates, but never out of them; a call forgets everything, so no temporary lives
+// across one.
+class ValueNumbering {
+private:
+    struct Value {
+        // the first occurrence, recomputed into a temporary if the value is needed again
+        Node* node;
+        std::string holder;
+        size_t holderVersion = 0;
+    };
+
+    Tree& tree;
+    size_t tempCount = 0;
+    size_t versionCount = 0;
+
+    std::unordered_map<std::string, size_t> versions;
+    std::vector<Value> values;
+    // numbers available at the current statement
+    std::unordered_map<std::string, size_t> available;
+    // the statement each first occurrence is evaluated in
+    std::unordered_map<const Node*, Node*> owners;
+    // statements that became "temporary; statement", mapped to the node now holding the statement
+    std::unordered_map<const Node*, Node*> moved;
+
+    void VisitStmt(Node* node);
+    void VisitAssignment(Node* node);
+    void VisitIf(Node* node);
+    void VisitWhile(Node* node);
+    void VisitExpr(Node* node, Node* stmt, bool record);
+
+    std::string NumberOf(const Node* node) const;
+    std::string Reuse(Value& value);
+    void Assign(const std::string& name);
+    void Invalidate(const std::unordered_set<std::string>& names);
+    Node* Resolve(Node* stmt) const;
+    void SetOwner(const Node* node, Node* stmt);
+
+public:
+    explicit ValueNumbering(Tree& ast) : tree(ast) {}
+
+    void Run(Node* program);
+};
+
+#endif // VALUE_NUMBERING_H
@@ -1,15 +1,297 @@
 #include "asmCommands.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace {
 
 constexpr uint8_t kRexW = 0x48;
 constexpr uint8_t kRexR = 0x44;
 constexpr uint8_t kRexX = 0x42;
 constexpr uint8_t kRexB = 0x41;
+constexpr uint8_t kRex = 0x40;
+constexpr uint8_t kSibBaseOnly = 0x24;
+constexpr uint8_t kOperandSize16 = 0x66;
+
+// REX.W prefix extended for a register in the ModR/M reg field and one in the r/m field
+uint8_t RexW(r64 reg, r64 rm) {
+    uint8_t rex = kRexW;
+    if (static_cast<int>(reg) >= 8) rex |= kRexR;
+    if (static_cast<int>(rm) >= 8) rex |= kRexB;
+    return rex;
+}
+
+uint8_t RexW(r64 rm) {
+    return static_cast<int>(rm) >= 8 ? kRexW | kRexB : kRexW;
+}
+
+// ModR/M for a register-direct operand: (Mod=11, Reg=reg, R/M=rm)
+uint8_t DirectModRM(int reg, r64 rm) {
+    return static_cast<uint8_t>(0xc0 + ((reg & 0x7) << 3) + (static_cast<int>(rm) & 0x7));
+}
+
+constexpr size_t kShortBranchSize = 2;
+
+// whether the value survives sign extension from an 8-bit immediate
+bool FitsImm8(int32_t value) {
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+bool IsJump(const Instruction& instr) {
+    return instr.op == Op::Jcc || instr.op == Op::Jmp;
+}
+
+// branches end with their displacement: rel8 for the two-byte jumps, rel32 otherwise
+size_t DisplacementSize(const Instruction& instr) {
+    return IsJump(instr) && instr.bytes.size() == kShortBranchSize ? sizeof(int8_t) : sizeof(int32_t);
+}
+
+// an offset whose instruction was removed lands on the next surviving one
+size_t Lookup(const std::vector<std::pair<size_t, size_t>>& map, size_t offset) {
+    auto iter = std::lower_bound(map.begin(), map.end(), offset, [](const auto& entry, size_t value) {
+        return entry.first < value;
+    });
+    return iter == map.end() ? map.back().second : iter->second;
+}
+
+// nops from the address up to the next multiple of the boundary, in as few instructions as possible
+std::vector<uint8_t> AlignmentPadding(size_t address, size_t boundary) {
+    // the recommended multi-byte nop of each length
+    static const std::vector<uint8_t> kNops[] = {
+        {},
+        {0x90},
+        {0x66, 0x90},
+        {0x0f, 0x1f, 0x00},
+        {0x0f, 0x1f, 0x40, 0x00},
+        {0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    };
+
+    size_t size = (boundary - address % boundary) % boundary;
+    std::vector<uint8_t> bytes;
+    while (size > 0) {
+        size_t length = std::min(size, std::size(kNops) - 1);
+        bytes.insert(bytes.end(), kNops[length].begin(), kNops[length].end());
+        size -= length;
+    }
+    return bytes;
+}
 
 } // namespace
 
+void x86_64::AppendMemoryOperand(int reg, r64 base, int32_t offset) {
+    // ModR/M: (Mod=10, Reg=reg, R/M=base) disp32
+    // rsp and r12 as a base can only be encoded through a SIB byte
+    uint8_t modrm[] = {static_cast<uint8_t>(0x80 + ((reg & 0x7) << 3) + (static_cast<int>(base) & 0x7))};
+    code.Append(modrm);
+    if ((static_cast<int>(base) & 0x7) == static_cast<int>(r64::rsp)) {
+        uint8_t sib[] = {kSibBaseOnly};
+        code.Append(sib);
+    }
+    code.Append(offset);
+}
+
+void x86_64::Record(Op op, r64 dst, r64 src, int64_t imm) {
+    instructions.push_back({.op = op, .dst = dst, .src = src, .imm = imm, .offset = code.GetSize(), .target = std::nullopt, .bytes = {}});
+}
+
+std::vector<Instruction> x86_64::GetInstructions() const {
+    std::vector<Instruction> list = instructions;
+    for (size_t i = 0; i < list.size(); ++i) {
+        size_t end = i + 1 < list.size() ? list[i + 1].offset : code.GetSize();
+        list[i].bytes.assign(code.GetData() + list[i].offset, code.GetData() + end);
+
+        if (list[i].op == Op::Jcc || list[i].op == Op::Jmp || list[i].op == Op::Call) {
+            int64_t disp = 0;
+            if (DisplacementSize(list[i]) == sizeof(int8_t)) {
+                disp = static_cast<int8_t>(list[i].bytes.back());
+            } else {
+                int32_t disp32 = 0;
+                std::copy(list[i].bytes.end() - sizeof(disp32), list[i].bytes.end(), reinterpret_cast<uint8_t*>(&disp32));
+                disp = disp32;
+            }
+            list[i].target = end + disp;
+        }
+    }
+    return list;
+}
+
+void x86_64::Assemble(const std::vector<Instruction>& list) {
+    std::vector<std::pair<size_t, size_t>> step;
+    std::vector<Instruction> relocated = list;
+    size_t pos = 0;
+    for (Instruction& instr : relocated) {
+        // padding is sized for where it lands now; whatever targets it goes past it
+        if (instr.op == Op::Align) {
+            instr.bytes = AlignmentPadding(origin + pos, static_cast<size_t>(instr.imm));
+            step.emplace_back(instr.offset, pos + instr.bytes.size());
+        } else {
+            step.emplace_back(instr.offset, pos);
+        }
+        pos += instr.bytes.size();
+    }
+    step.emplace_back(code.GetSize(), pos);
+
+    CodeBuffer rebuilt;
+    for (Instruction& instr : relocated) {
+        instr.offset = rebuilt.GetSize();
+        if (instr.target.has_value()) {
+            instr.target = Lookup(step, instr.target.value());
+            int32_t disp = static_cast<int32_t>(instr.target.value() - (instr.offset + instr.bytes.size()));
+            size_t size = DisplacementSize(instr);
+            std::copy(reinterpret_cast<uint8_t*>(&disp), reinterpret_cast<uint8_t*>(&disp) + size, instr.bytes.end() - size);
+        }
+        rebuilt.Append(instr.bytes);
+        instr.bytes.clear();
+    }
+
+    // later passes move code that earlier ones already moved; keep mapping from the original layout
+    if (offsetMap.empty()) {
+        offsetMap = step;
+    } else {
+        for (auto& entry : offsetMap) {
+            entry.second = Lookup(step, entry.second);
+        }
+    }
+
+    code = rebuilt;
+    instructions = relocated;
+}
+
+size_t x86_64::MapOffset(size_t offset) const {
+    if (offsetMap.empty()) {
+        return offset;
+    }
+    return Lookup(offsetMap, offset);
+}
+
+void x86_64::Relax() {
+    std::vector<Instruction> list = GetInstructions();
+
+    // branch index -> index of the instruction it targets, list.size() for the end of the code
+    std::vector<size_t> targetIndex(list.size());
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (IsJump(list[i])) {
+            auto iter = std::lower_bound(list.begin(), list.end(), list[i].target.value(), [](const Instruction& instr, size_t value) {
+                return instr.offset < value;
+            });
+            // a jump onto alignment padding lands past it
+            while (iter != list.end() && iter->op == Op::Align) {
+                ++iter;
+            }
+            targetIndex[i] = static_cast<size_t>(iter - list.begin());
+        }
+    }
+
+    // Start from rel32 everywhere and shorten what fits. Shortening only ever brings
+    // code closer together, so a jump that fits once keeps fitting and this terminates.
+    // Alignment padding counts at its largest, since shortening can make it grow.
+    std::vector<bool> relaxed(list.size(), false);
+    std::vector<size_t> position(list.size() + 1);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        position[0] = 0;
+        for (size_t i = 0; i < list.size(); ++i) {
+            size_t size = list[i].bytes.size();
+            if (relaxed[i]) {
+                size = kShortBranchSize;
+            } else if (list[i].op == Op::Align) {
+                size = static_cast<size_t>(list[i].imm) - 1;
+            }
+            position[i + 1] = position[i] + size;
+        }
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (!IsJump(list[i]) || relaxed[i]) {
+                continue;
+            }
+            int64_t disp = static_cast<int64_t>(position[targetIndex[i]]) - static_cast<int64_t>(position[i] + kShortBranchSize);
+            if (disp >= INT8_MIN && disp <= INT8_MAX) {
+                relaxed[i] = changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (!relaxed[i]) {
+            continue;
+        }
+        // opcode: 70+cc cb (from 0F 80+cc cd), EB cb (from E9 cd)
+        uint8_t opcode = list[i].op == Op::Jcc ? static_cast<uint8_t>(0x70 | (list[i].bytes[1] & 0x0f)) : 0xeb;
+        list[i].bytes = {opcode, 0x00};
+    }
+
+    Assemble(list);
+}
+
+Label x86_64::NewLabel() {
+    labels.emplace_back();
+    return {labels.size() - 1};
+}
+
+void x86_64::Bind(Label label) {
+    size_t offset = code.GetSize();
+    labels[label.id] = offset;
+    std::erase_if(fixups, [&](const auto& fixup) {
+        if (fixup.second != label.id) {
+            return false;
+        }
+        code.InsertNumber(static_cast<int32_t>(offset - (fixup.first + sizeof(int32_t))), fixup.first);
+        return true;
+    });
+}
+
+// the branch just emitted ends with a rel32 for the target
+void x86_64::AddFixup(Label target) {
+    size_t pos = code.GetSize() - sizeof(int32_t);
+    if (labels[target.id].has_value()) {
+        code.InsertNumber(static_cast<int32_t>(labels[target.id].value() - code.GetSize()), pos);
+    } else {
+        fixups.emplace_back(pos, target.id);
+    }
+}
+
+// group 1 arithmetic (add, and, sub, cmp, ...) on a register with the shortest immediate
+void x86_64::AppendGroup1(int ext, r64 reg, int32_t imm) {
+    if (FitsImm8(imm)) {
+        // opcode: REX.W + 83 /ext ib
+        // ModR/M: (Mod=11, Reg=ext, R/M=reg)
+        uint8_t opcode[] = {RexW(reg), 0x83, DirectModRM(ext, reg), static_cast<uint8_t>(imm)};
+        code.Append(opcode);
+        return;
+    }
+    // opcode: REX.W + 81 /ext id
+    // ModR/M: (Mod=11, Reg=ext, R/M=reg)
+    uint8_t opcode[] = {RexW(reg), 0x81, DirectModRM(ext, reg)};
+    code.Append(opcode);
+    code.Append(imm);
+}
+
+void x86_64::AppendSetcc(uint8_t condition, r64 reg) {
+    // opcode: [REX] 0F cc
+    // ModR/M: (Mod=11, Reg=000, R/M=reg)
+    // spl/bpl/sil/dil are only reachable with a REX prefix
+    if (reg >= r64::rsp) {
+        uint8_t prefix[] = {static_cast<int>(reg) >= 8 ? kRexB : kRex};
+        code.Append(prefix);
+    }
+    uint8_t opcode[] = {0x0f, condition, DirectModRM(0, reg)};
+    code.Append(opcode);
+}
+
+void x86_64::AppendCmov(uint8_t condition, r64 dst, r64 src) {
+    Record(Op::Other);
+    // opcode: REX.W + 0F cc /r
+    // ModR/M: (Mod=11, Reg=dst, R/M=src)
+    uint8_t opcode[] = {RexW(dst, src), 0x0f, condition, DirectModRM(static_cast<int>(dst), src)};
+    code.Append(opcode);
+}
+
 void x86_64::push(r64 reg) {
+    Record(Op::Push, reg);
     if (reg <= r64::rdi) {
         // opcode: 0x50 + rd
         uint8_t opcode[] = {static_cast<uint8_t>(0x50 + (static_cast<int>(reg) & 0x7))};
@@ -22,6 +304,13 @@ void x86_64::push(r64 reg) {
 }
 
 void x86_64::push(int32_t imm) {
+    Record(Op::PushImm, r64::rax, r64::rax, imm);
+    if (FitsImm8(imm)) {
+        // opcode: 6A ib
+        uint8_t opcode[] = {0x6a, static_cast<uint8_t>(imm)};
+        code.Append(opcode);
+        return;
+    }
     // opcode: 68 id
     uint8_t opcode[] = {0x68};
     code.Append(opcode);
@@ -29,6 +318,7 @@ void x86_64::push(int32_t imm) {
 }
 
 void x86_64::pop(r64 reg) {
+    Record(Op::Pop, reg);
     if (reg <= r64::rdi) {
         // opcode: 0x58 + rd
         uint8_t opcode[] = {static_cast<uint8_t>(0x58 + (static_cast<int>(reg) & 0x7))};
@@ -41,109 +331,245 @@ void x86_64::pop(r64 reg) {
 }
 
 void x86_64::mov(r64 reg, int32_t imm) {
+    Record(Op::MovImm, reg, r64::rax, imm);
     // opcode: REX.W + C7 /0 imm32
     // ModR/M: (Mod=11, Reg=000, R/M=reg_code)
+    uint8_t rex = static_cast<int>(reg) >= 8 ? kRexW | kRexB : kRexW;
     uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0xc7, modrm}; 
+    uint8_t opcode[] = {rex, 0xc7, modrm}; 
     code.Append(opcode);
     code.Append(imm);
 }
 
 void x86_64::mov(r64 dst, r64 src) {
+    Record(Op::MovReg, dst, src);
     // opcode: REX.W + 8B /r
     // ModR/M: (Mod=11, Reg=dst, R/M=src)
+    uint8_t rex = kRexW;
+    if (static_cast<int>(dst) >= 8) rex |= kRexR;
+    if (static_cast<int>(src) >= 8) rex |= kRexB;
     uint8_t modrm = static_cast<uint8_t>(0xc0 + ((static_cast<int>(dst) & 0x7) << 3) + (static_cast<int>(src) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x8b, modrm};
+    uint8_t opcode[] = {rex, 0x8b, modrm};
     code.Append(opcode);
 }
 
 void x86_64::mov(r64 dst, r64 src, int32_t offset) { 
+    Record(Op::Load, dst, src, offset);
     // opcode: REX.W + 8B /r disp32
     // ModR/M: (Mod=10, Reg=reg, R/M=src)
-    uint8_t modrm = static_cast<uint8_t>(0x80 + ((static_cast<int>(dst) & 0x7) << 3) + (static_cast<int>(src) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x8b, modrm};
+    uint8_t rex = kRexW;
+    if (static_cast<int>(dst) >= 8) rex |= kRexR;
+    if (static_cast<int>(src) >= 8) rex |= kRexB;
+    uint8_t opcode[] = {rex, 0x8b};
     code.Append(opcode);
-    code.Append(offset);
+    AppendMemoryOperand(static_cast<int>(dst), src, offset);
 }
 
 void x86_64::mov(r64 src, int32_t offset, r64 dst) {
+    Record(Op::Other);
     // opcode: REX.W + 89 /r disp32
     // ModR/M: (Mod=10, Reg=reg, R/M=src)
-    uint8_t rex = static_cast<int>(src) >= 8 || static_cast<int>(dst) >= 8 ? kRexW | kRexR : kRexW;
-    uint8_t modrm = static_cast<uint8_t>(0x80 + ((static_cast<int>(dst) & 0x7) << 3) + (static_cast<int>(src) & 0x7));
-    uint8_t opcode[] = {rex, 0x89, modrm};
+    uint8_t rex = kRexW;
+    if (static_cast<int>(dst) >= 8) rex |= kRexR;
+    if (static_cast<int>(src) >= 8) rex |= kRexB;
+    uint8_t opcode[] = {rex, 0x89};
+    code.Append(opcode);
+    AppendMemoryOperand(static_cast<int>(dst), src, offset);
+}
+
+void x86_64::mov(r64 base, int32_t offset, r8 src) {
+    Record(Op::Other);
+    // opcode: [REX] 88 /r disp32
+    // ModR/M: (Mod=10, Reg=src, R/M=base)
+    // spl/bpl/sil/dil are only reachable with a REX prefix
+    uint8_t rex = kRex;
+    if (static_cast<int>(src) >= 8) rex |= kRexR;
+    if (static_cast<int>(base) >= 8) rex |= kRexB;
+    if (rex != kRex || src >= r8::spl) {
+        uint8_t prefix[] = {rex};
+        code.Append(prefix);
+    }
+    uint8_t opcode[] = {0x88};
+    code.Append(opcode);
+    AppendMemoryOperand(static_cast<int>(src), base, offset);
+}
+
+void x86_64::mov(r64 base, int32_t offset, r16 src) {
+    Record(Op::Other);
+    // opcode: 66 [REX] 89 /r disp32
+    // ModR/M: (Mod=10, Reg=src, R/M=base)
+    uint8_t prefix[] = {kOperandSize16};
+    code.Append(prefix);
+    uint8_t rex = kRex;
+    if (static_cast<int>(src) >= 8) rex |= kRexR;
+    if (static_cast<int>(base) >= 8) rex |= kRexB;
+    if (rex != kRex) {
+        uint8_t rexPrefix[] = {rex};
+        code.Append(rexPrefix);
+    }
+    uint8_t opcode[] = {0x89};
     code.Append(opcode);
-    code.Append(offset);
+    AppendMemoryOperand(static_cast<int>(src), base, offset);
+}
+
+void x86_64::movabs(r64 reg, int64_t imm) {
+    Record(Op::Other);
+    // opcode: REX.W + B8 + rd io
+    uint8_t rex = static_cast<int>(reg) >= 8 ? kRexW | kRexB : kRexW;
+    uint8_t opcode[] = {rex, static_cast<uint8_t>(0xb8 + (static_cast<int>(reg) & 0x7))};
+    code.Append(opcode);
+    code.Append(static_cast<int32_t>(imm));
+    code.Append(static_cast<int32_t>(imm >> 32));
 }
 
 void x86_64::add(r64 dst, r64 src) {
+    Record(Op::Other);
     // opcode: REX.W + 01 /r
     // ModR/M: (Mod=11, Reg=src, R/M=dst)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + ((static_cast<int>(src) & 0x7) << 3) + (static_cast<int>(dst) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x01, modrm};
+    uint8_t opcode[] = {RexW(src, dst), 0x01, DirectModRM(static_cast<int>(src), dst)};
     code.Append(opcode);
 }
 
 void x86_64::add(r64 reg, int32_t imm) {
-    // opcode: REX.W + 81 /0 id
-    // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x81, modrm};
-    code.Append(opcode);
-    code.Append(imm);
+    Record(Op::AddImm, reg, r64::rax, imm);
+    AppendGroup1(0, reg, imm);
 }
 
 void x86_64::sub(r64 dst, r64 src) {
+    Record(Op::Other);
     // opcode: REX.W + 29 /r
     // ModR/M: (Mod=11, Reg=src, R/M=dst)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + ((static_cast<int>(src) & 0x7) << 3) + (static_cast<int>(dst) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x29, modrm};
+    uint8_t opcode[] = {RexW(src, dst), 0x29, DirectModRM(static_cast<int>(src), dst)};
     code.Append(opcode);
 }
 
 void x86_64::sub(r64 reg, int32_t imm) {
-    // opcode: REX.W + 81 /5 id
-    // ModR/M: (Mod=11, Reg=101, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xe8 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x81, modrm};
-    code.Append(opcode);
-    code.Append(imm);
+    Record(Op::SubImm, reg, r64::rax, imm);
+    AppendGroup1(5, reg, imm);
 }
 
 void x86_64::imul(r64 dst, r64 src) {
+    Record(Op::Other);
     // opcode: REX.W + 0F AF /r
     // ModR/M: (Mod=11, Reg=dst, R/M=src)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + ((static_cast<int>(dst) & 0x7) << 3) + (static_cast<int>(src) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x0f, 0xaf, modrm};
+    uint8_t opcode[] = {RexW(dst, src), 0x0f, 0xaf, DirectModRM(static_cast<int>(dst), src)};
     code.Append(opcode);
 }
 
+void x86_64::imul(r64 dst, r64 src, int32_t imm) {
+    Record(Op::Other);
+    // ModR/M: (Mod=11, Reg=dst, R/M=src)
+    if (FitsImm8(imm)) {
+        // opcode: REX.W + 6B /r ib
+        uint8_t opcode[] = {RexW(dst, src), 0x6b, DirectModRM(static_cast<int>(dst), src), static_cast<uint8_t>(imm)};
+        code.Append(opcode);
+        return;
+    }
+    // opcode: REX.W + 69 /r id
+    uint8_t opcode[] = {RexW(dst, src), 0x69, DirectModRM(static_cast<int>(dst), src)};
+    code.Append(opcode);
+    code.Append(imm);
+}
+
 void x86_64::idiv(r64 reg) {
+    Record(Op::Other);
     // opcode: REX.W + F7 /7
     // ModR/M: (Mod=11, Reg=111, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xf8 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0xf7, modrm};
+    uint8_t opcode[] = {RexW(reg), 0xf7, DirectModRM(7, reg)};
+    code.Append(opcode);
+}
+
+// signed rdx:rax = rax * reg
+void x86_64::imul(r64 reg) {
+    Record(Op::Other);
+    // opcode: REX.W + F7 /5
+    // ModR/M: (Mod=11, Reg=101, R/M=reg)
+    uint8_t opcode[] = {RexW(reg), 0xf7, DirectModRM(5, reg)};
+    code.Append(opcode);
+}
+
+void x86_64::and_(r64 reg, int32_t imm) {
+    Record(Op::Other);
+    AppendGroup1(4, reg, imm);
+}
+
+void x86_64::mul(r64 reg) {
+    Record(Op::Other);
+    // opcode: REX.W + F7 /4
+    // ModR/M: (Mod=11, Reg=100, R/M=reg)
+    uint8_t opcode[] = {RexW(reg), 0xf7, DirectModRM(4, reg)};
+    code.Append(opcode);
+}
+
+void x86_64::shr(r64 reg, uint8_t imm) {
+    Record(Op::Other);
+    // opcode: REX.W + C1 /5 ib
+    // ModR/M: (Mod=11, Reg=101, R/M=reg)
+    uint8_t opcode[] = {RexW(reg), 0xc1, DirectModRM(5, reg), imm};
+    code.Append(opcode);
+}
+
+void x86_64::shl(r64 reg, uint8_t imm) {
+    Record(Op::Other);
+    // opcode: REX.W + C1 /4 ib
+    // ModR/M: (Mod=11, Reg=100, R/M=reg)
+    uint8_t opcode[] = {RexW(reg), 0xc1, DirectModRM(4, reg), imm};
+    code.Append(opcode);
+}
+
+void x86_64::sar(r64 reg, uint8_t imm) {
+    Record(Op::Other);
+    // opcode: REX.W + C1 /7 ib
+    // ModR/M: (Mod=11, Reg=111, R/M=reg)
+    uint8_t opcode[] = {RexW(reg), 0xc1, DirectModRM(7, reg), imm};
+    code.Append(opcode);
+}
+
+// dst = base + index * scale, scale being 1, 2, 4 or 8
+void x86_64::lea(r64 dst, r64 base, r64 index, uint8_t scale) {
+    Record(Op::Other);
+    uint8_t rex = RexW(dst, base);
+    if (static_cast<int>(index) >= 8) rex |= kRexX;
+    uint8_t scaleBits = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+    // rbp and r13 as a SIB base need Mod=01 with a zero disp8
+    bool disp8 = (static_cast<int>(base) & 0x7) == static_cast<int>(r64::rbp);
+    // opcode: REX.W + 8D /r
+    // ModR/M: (Mod=00 or 01, Reg=dst, R/M=100) SIB: (Scale, Index=index, Base=base)
+    uint8_t opcode[] = {
+        rex, 0x8d,
+        static_cast<uint8_t>((disp8 ? 0x44 : 0x04) + ((static_cast<int>(dst) & 0x7) << 3)),
+        static_cast<uint8_t>((scaleBits << 6) + ((static_cast<int>(index) & 0x7) << 3) + (static_cast<int>(base) & 0x7)),
+    };
+    code.Append(opcode);
+    if (disp8) {
+        uint8_t zero[] = {0x00};
+        code.Append(zero);
+    }
+}
+
+void x86_64::or_(r64 dst, r64 src) {
+    Record(Op::Other);
+    // opcode: REX.W + 09 /r
+    // ModR/M: (Mod=11, Reg=src, R/M=dst)
+    uint8_t opcode[] = {RexW(src, dst), 0x09, DirectModRM(static_cast<int>(src), dst)};
     code.Append(opcode);
 }
 
 void x86_64::cmp(r64 dst, r64 src) {
+    Record(Op::Other);
     // opcode: REX.W + 39 /r
     // ModR/M: (Mod=11, Reg=src, R/M=dst)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + ((static_cast<int>(src) & 0x7) << 3) + (static_cast<int>(dst) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x39, modrm};
+    uint8_t opcode[] = {RexW(src, dst), 0x39, DirectModRM(static_cast<int>(src), dst)};
     code.Append(opcode);
 }
 
 void x86_64::cmp(r64 reg, int32_t imm) {
-    // opcode: REX.W + 81 /7 id
-    // ModR/M: (Mod=11, Reg=111, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xf8 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x81, modrm};
-    code.Append(opcode);
-    code.Append(imm);
+    Record(Op::CmpImm, reg, r64::rax, imm);
+    AppendGroup1(7, reg, imm);
 }
 
 void x86_64::je(int32_t offset) {
+    Record(Op::Jcc);
     // opcode: 0F 84 imm32
     uint8_t opcode[] = {0x0f, 0x84};
     code.Append(opcode);
@@ -151,6 +577,7 @@ void x86_64::je(int32_t offset) {
 }
 
 void x86_64::jmp(int32_t offset) {
+    Record(Op::Jmp);
     // opcode: E9 cd
     uint8_t opcode[] = {0xe9};
     code.Append(opcode);
@@ -158,6 +585,7 @@ void x86_64::jmp(int32_t offset) {
 }
 
 void x86_64::jl(int32_t offset) {
+    Record(Op::Jcc);
     // opcode: 0F 8C cd
     uint8_t opcode[] = {0x0f, 0x8c};
     code.Append(opcode);
@@ -165,6 +593,7 @@ void x86_64::jl(int32_t offset) {
 }
 
 void x86_64::jg(int32_t offset) {
+    Record(Op::Jcc);
     // opcode: 0F 8F cd
     uint8_t opcode[] = {0x0f, 0x8f};
     code.Append(opcode);
@@ -172,6 +601,7 @@ void x86_64::jg(int32_t offset) {
 }
 
 void x86_64::jge(int32_t offset) {
+    Record(Op::Jcc);
     // opcode: 0F 8D cd
     uint8_t opcode[] = {0x0f, 0x8d};
     code.Append(opcode);
@@ -179,13 +609,58 @@ void x86_64::jge(int32_t offset) {
 }
 
 void x86_64::jne(int32_t offset) {
+    Record(Op::Jcc);
     // opcode: OF 85 cd
     uint8_t opcode[] = {0x0f, 0x85};
     code.Append(opcode);
     code.Append(offset);
 }
 
+void x86_64::jle(int32_t offset) {
+    Record(Op::Jcc);
+    // opcode: 0F 8E cd
+    uint8_t opcode[] = {0x0f, 0x8e};
+    code.Append(opcode);
+    code.Append(offset);
+}
+
+void x86_64::je(Label target) {
+    je(0);
+    AddFixup(target);
+}
+
+void x86_64::jmp(Label target) {
+    jmp(0);
+    AddFixup(target);
+}
+
+void x86_64::jl(Label target) {
+    jl(0);
+    AddFixup(target);
+}
+
+void x86_64::jg(Label target) {
+    jg(0);
+    AddFixup(target);
+}
+
+void x86_64::jge(Label target) {
+    jge(0);
+    AddFixup(target);
+}
+
+void x86_64::jne(Label target) {
+    jne(0);
+    AddFixup(target);
+}
+
+void x86_64::jle(Label target) {
+    jle(0);
+    AddFixup(target);
+}
+
 void x86_64::call(int32_t offset) {
+    Record(Op::Call);
     // opcode: E8 cd
     uint8_t opcode[] = {0xe8};
     code.Append(opcode);
@@ -193,107 +668,187 @@ void x86_64::call(int32_t offset) {
 }
 
 void x86_64::xchg(r64 dst, r64 src) {
+    Record(Op::Other);
     // opcode: REX.W + 87 /r
     // ModR/M: (Mod=11, Reg=src, R/M=dst)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + ((static_cast<int>(src) & 0x7) << 3) + (static_cast<int>(dst) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x87, modrm};
+    uint8_t opcode[] = {RexW(src, dst), 0x87, DirectModRM(static_cast<int>(src), dst)};
+    code.Append(opcode);
+}
+
+void x86_64::test(r64 dst, r64 src) {
+    Record(Op::Other);
+    // opcode: REX.W + 85 /r
+    // ModR/M: (Mod=11, Reg=src, R/M=dst)
+    uint8_t opcode[] = {RexW(src, dst), 0x85, DirectModRM(static_cast<int>(src), dst)};
+    code.Append(opcode);
+}
+
+void x86_64::cqo() {
+    Record(Op::Other);
+    // opcode: REX.W + 99
+    uint8_t opcode[] = {kRexW, 0x99};
     code.Append(opcode);
 }
 
 void x86_64::neg(r64 reg) {
+    Record(Op::Other);
     // opcode: REX.W + F7 /3
     // ModR/M: (Mod=11, Reg=011, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xd8 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0xf7, modrm};
+    uint8_t opcode[] = {RexW(reg), 0xf7, DirectModRM(3, reg)};
     code.Append(opcode);
 }
 
 void x86_64::inc(r64 reg) {
+    Record(Op::Other);
     // opcode: REX.W + FF /0
     // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0xff, modrm};
+    uint8_t opcode[] = {RexW(reg), 0xff, DirectModRM(0, reg)};
     code.Append(opcode);
 }
 
 void x86_64::dec(r64 reg) {
+    Record(Op::Other);
     // opcode: REX.W + FF /1
     // ModR/M: (Mod=11, Reg=001, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc8 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {kRexW, 0xff, modrm};
+    uint8_t opcode[] = {RexW(reg), 0xff, DirectModRM(1, reg)};
     code.Append(opcode);
 }
 
+void x86_64::Align(size_t boundary) {
+    Record(Op::Align, r64::rax, r64::rax, static_cast<int64_t>(boundary));
+    std::vector<uint8_t> padding = AlignmentPadding(origin + code.GetSize(), boundary);
+    code.Append(padding);
+}
+
 void x86_64::ret() {
+    Record(Op::Other);
     // opcode: С3
     uint8_t opcode[] = {0xc3};
     code.Append(opcode);
 }
 
 void x86_64::syscall() {
+    Record(Op::Other);
     // opcode: 0F 05
     uint8_t opcode[] = {0x0f, 0x05};
     code.Append(opcode);
 }
 
 void x86_64::nop() {
+    Record(Op::Other);
     // opcode: NP 90
     uint8_t opcode[] = {0x90};
     code.Append(opcode);
 }
 
+void x86_64::rdtsc() {
+    Record(Op::Other);
+    // opcode: 0F 31
+    uint8_t opcode[] = {0x0f, 0x31};
+    code.Append(opcode);
+}
+
+void x86_64::rep_movsb() {
+    Record(Op::Other);
+    // opcode: F3 A4
+    uint8_t opcode[] = {0xf3, 0xa4};
+    code.Append(opcode);
+}
+
 void x86_64::setg(r64 reg) {
+    Record(Op::Other);
     // opcode: 0F 9F
-    // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {0x0f, 0x9f, modrm};
-    code.Append(opcode);
+    AppendSetcc(0x9f, reg);
 }
 
 void x86_64::setge(r64 reg) {
+    Record(Op::Other);
     // opcode: 0F 9D
-    // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {0x0f, 0x9d, modrm};
-    code.Append(opcode);
+    AppendSetcc(0x9d, reg);
 }
 
 void x86_64::setl(r64 reg) {
+    Record(Op::Other);
     // opcode: 0F 9C
-    // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {0x0f, 0x9c, modrm};
-    code.Append(opcode);
+    AppendSetcc(0x9c, reg);
 }
 
 void x86_64::setle(r64 reg) {
+    Record(Op::Other);
     // opcode: 0F 9E
-    // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {0x0f, 0x9e, modrm};
-    code.Append(opcode);
+    AppendSetcc(0x9e, reg);
 }
 
 void x86_64::sete(r64 reg) {
+    Record(Op::Other);
     // opcode: 0F 94
-    // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {0x0f, 0x94, modrm};
-    code.Append(opcode);    
+    AppendSetcc(0x94, reg);
 }
 
 void x86_64::setne(r64 reg) {
+    Record(Op::Other);
     // opcode: 0F 95
-    // ModR/M: (Mod=11, Reg=000, R/M=reg)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + (static_cast<int>(reg) & 0x7));
-    uint8_t opcode[] = {0x0f, 0x95, modrm};
-    code.Append(opcode);
+    AppendSetcc(0x95, reg);
+}
+
+void x86_64::cmovg(r64 dst, r64 src) {
+    // opcode: REX.W + 0F 4F
+    AppendCmov(0x4f, dst, src);
+}
+
+void x86_64::cmovge(r64 dst, r64 src) {
+    // opcode: REX.W + 0F 4D
+    AppendCmov(0x4d, dst, src);
+}
+
+void x86_64::cmovl(r64 dst, r64 src) {
+    // opcode: REX.W + 0F 4C
+    AppendCmov(0x4c, dst, src);
+}
+
+void x86_64::cmovle(r64 dst, r64 src) {
+    // opcode: REX.W + 0F 4E
+    AppendCmov(0x4e, dst, src);
+}
+
+void x86_64::cmove(r64 dst, r64 src) {
+    // opcode: REX.W + 0F 44
+    AppendCmov(0x44, dst, src);
+}
+
+void x86_64::cmovne(r64 dst, r64 src) {
+    // opcode: REX.W + 0F 45
+    AppendCmov(0x45, dst, src);
 }
 
 void x86_64::movzx(r64 dst, r8 src) {
+    Record(Op::Other);
     // opcode: REX.W + 0F B6 /r
     // ModR/M: (Mod=11, Reg=dst, R/M=src)
-    uint8_t modrm = static_cast<uint8_t>(0xc0 + ((static_cast<int>(dst) & 0x7) << 3) + (static_cast<int>(src) & 0x7));
-    uint8_t opcode[] = {kRexW, 0x0f, 0xb6, modrm};
+    uint8_t opcode[] = {RexW(dst, static_cast<r64>(src)), 0x0f, 0xb6, DirectModRM(static_cast<int>(dst), static_cast<r64>(src))};
+    code.Append(opcode);
+}
+
+void x86_64::movzx(r64 dst, r64 base, int32_t offset) {
+    Record(Op::Other);
+    // opcode: REX.W + 0F B6 /r disp32
+    // ModR/M: (Mod=10, Reg=dst, R/M=base)
+    uint8_t rex = kRexW;
+    if (static_cast<int>(dst) >= 8) rex |= kRexR;
+    if (static_cast<int>(base) >= 8) rex |= kRexB;
+    uint8_t opcode[] = {rex, 0x0f, 0xb6};
+    code.Append(opcode);
+    AppendMemoryOperand(static_cast<int>(dst), base, offset);
+}
+
+void x86_64::movzxw(r64 dst, r64 base, int32_t offset) {
+    Record(Op::Other);
+    // opcode: REX.W + 0F B7 /r disp32
+    // ModR/M: (Mod=10, Reg=dst, R/M=base)
+    uint8_t rex = kRexW;
+    if (static_cast<int>(dst) >= 8) rex |= kRexR;
+    if (static_cast<int>(base) >= 8) rex |= kRexB;
+    uint8_t opcode[] = {rex, 0x0f, 0xb7};
     code.Append(opcode);
+    AppendMemoryOperand(static_cast<int>(dst), base, offset);
 }
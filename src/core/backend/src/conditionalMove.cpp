@@ -0,0 +1,105 @@
+#include "generator.h"
+
+#include "node.hpp"
+
+namespace {
+
+// largest right side, in AST nodes, worth computing on the path that does not need it
+constexpr size_t kMaxSelectNodes = 5;
+
+// Nodes in a right side that is safe to compute whether or not the condition holds, or 0
+// when it is not: calls and builtins have effects and a division can trap.
+size_t SpeculationCost(const Node* node) {
+    switch (node->GetType()) {
+        case Number:
+        case Identifier: {
+            return 1;
+        }
+        case Add:
+        case Sub:
+        case Mul:
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            size_t lhs = SpeculationCost(node->GetLeft());
+            size_t rhs = SpeculationCost(node->GetRight());
+            return lhs == 0 || rhs == 0 ? 0 : lhs + rhs + 1;
+        }
+        default: {
+            return 0;
+        }
+    }
+}
+
+} // namespace
+
+void CodeGen::EmitCmov(Node* cond, r64 dst, r64 src) {
+    switch (cond->GetType()) {
+        case Greater:           asmGen.cmovg(dst, src);     break;
+        case GreaterOrEqual:    asmGen.cmovge(dst, src);    break;
+        case Less:              asmGen.cmovl(dst, src);     break;
+        case LessOrEqual:       asmGen.cmovle(dst, src);    break;
+        case Identical:         asmGen.cmove(dst, src);     break;
+        default:                asmGen.cmovne(dst, src);    break;
+    }
+}
+
+// Lowers `if (cond) x = value;` to cmp + cmovcc when x already exists and value is cheap and
+// safe to compute either way, so an unpredictable condition costs no mispredicted branch.
+// The value is computed before the condition, whose flags nothing after it touches.
+bool CodeGen::EmitConditionalMove(Node* node) {
+    Node* cond = node->GetLeft();
+    Node* body = node->GetRight();
+    if (!options.cmov || body->GetType() != Equal) {
+        return false;
+    }
+    Node* value = body->GetRight();
+    size_t cost = SpeculationCost(value);
+    // a variable the body declares would die with it
+    std::optional<VarLocation> location = vars.FindSymbol(body->GetLeft()->GetValue());
+    if (cost == 0 || cost > kMaxSelectNodes || !location.has_value()) {
+        return false;
+    }
+
+    if (options.mode == CodeGenMode::Stack) {
+        CodeGenExpr(value);
+        EmitConditionFlags(cond);
+        asmGen.pop(r64::rcx);
+        LoadVariable(location.value(), r64::rax);
+        EmitCmov(cond, r64::rax, r64::rcx);
+        StoreVariable(location.value(), r64::rax);
+        return true;
+    }
+
+    std::optional<r64> source = VariableRegister(value);
+    if (!source.has_value() && freeScratch.empty()) {
+        return false;
+    }
+
+    std::optional<ScratchReg> scratch;
+    if (!source.has_value()) {
+        scratch = AcquireScratch(r64::rax);
+        CodeGenExprTo(value, scratch->reg);
+        source = scratch->reg;
+    }
+
+    liveResults.push_back(source.value());
+    EmitConditionFlags(cond);
+    liveResults.pop_back();
+
+    if (location->reg.has_value()) {
+        EmitCmov(cond, location->reg.value(), source.value());
+    } else {
+        LoadVariable(location.value(), r64::rax);
+        EmitCmov(cond, r64::rax, source.value());
+        StoreVariable(location.value(), r64::rax);
+    }
+
+    if (scratch.has_value()) {
+        ReleaseScratch(scratch.value());
+    }
+    return true;
+}
@@ -0,0 +1,330 @@
+#include "constFolder.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+bool IsNumber(const Node* node) {
+    return node && node->GetType() == Number;
+}
+
+int64_t ValueOf(const Node* node) {
+    return std::stoll(node->GetValue());
+}
+
+// Keeps the left link: call arguments are chained through it.
+void MakeNumber(Node* node, int64_t value) {
+    node->SetType(Number);
+    node->SetValue(std::to_string(value));
+}
+
+void ReplaceWith(Node* node, const Node* child) {
+    node->SetType(child->GetType());
+    node->SetValue(child->GetValue());
+    node->SetLeft(child->GetLeft());
+    node->SetRight(child->GetRight());
+}
+
+void MakeEnd(Node* node) {
+    node->SetType(End);
+    node->SetValue("");
+    node->SetLeft(nullptr);
+    node->SetRight(nullptr);
+}
+
+// Same results as the generated code: wrapping arithmetic, truncating division.
+// Division by zero and INT64_MIN / -1 trap at run time, so they are left alone.
+std::optional<int64_t> Evaluate(NodeType type, int64_t lhs, int64_t rhs) {
+    uint64_t ulhs = static_cast<uint64_t>(lhs);
+    uint64_t urhs = static_cast<uint64_t>(rhs);
+    switch (type) {
+        case Add:               return static_cast<int64_t>(ulhs + urhs);
+        case Sub:               return static_cast<int64_t>(ulhs - urhs);
+        case Mul:               return static_cast<int64_t>(ulhs * urhs);
+        case Div: {
+            if (rhs == 0 || (lhs == std::numeric_limits<int64_t>::min() && rhs == -1)) {
+                return std::nullopt;
+            }
+            return lhs / rhs;
+        }
+        case Greater:           return lhs > rhs;
+        case GreaterOrEqual:    return lhs >= rhs;
+        case Less:              return lhs < rhs;
+        case LessOrEqual:       return lhs <= rhs;
+        case Identical:         return lhs == rhs;
+        case NotIdentical:      return lhs != rhs;
+
+        default: {
+            return std::nullopt;
+        }
+    }
+}
+
+// x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1 -> x
+const Node* NeutralOperand(const Node* node) {
+    const Node* left = node->GetLeft();
+    const Node* right = node->GetRight();
+    switch (node->GetType()) {
+        case Add: {
+            if (IsNumber(right) && ValueOf(right) == 0) return left;
+            if (IsNumber(left) && ValueOf(left) == 0) return right;
+            return nullptr;
+        }
+        case Mul: {
+            if (IsNumber(right) && ValueOf(right) == 1) return left;
+            if (IsNumber(left) && ValueOf(left) == 1) return right;
+            return nullptr;
+        }
+        case Sub:
+        case Div: {
+            int64_t neutral = node->GetType() == Sub ? 0 : 1;
+            if (IsNumber(right) && ValueOf(right) == neutral) return left;
+            return nullptr;
+        }
+        default: {
+            return nullptr;
+        }
+    }
+}
+
+} // namespace
+
+void ConstantFolder::Run(Node* program) {
+    if (!program) {
+        return;
+    }
+
+    switch (program->GetType()) {
+        case Semicolon: {
+            Run(program->GetLeft());
+            Run(program->GetRight());
+            break;
+        }
+        case Def: {
+            FoldDef(program);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void ConstantFolder::FoldDef(Node* def) {
+    facts.clear();
+    scopes.clear();
+
+    EnterScope();
+    for (const Node* arg = def->GetLeft(); arg; arg = arg->GetLeft()) {
+        scopes.back().push_back(arg->GetValue());
+    }
+    FoldStmt(def->GetRight());
+    ExitScope();
+}
+
+void ConstantFolder::FoldStmt(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            FoldStmt(node->GetLeft());
+            FoldStmt(node->GetRight());
+            break;
+        }
+        case Equal:         FoldAssignment(node);           break;
+        case If:            FoldIf(node);                   break;
+        case While:         FoldWhile(node);                break;
+        case PrintAscii:
+        case PrintInt:
+        case Return:        FoldExpr(node->GetLeft());      break;
+        case Call:          FoldExpr(node);                 break;
+
+        default: {
+            break;
+        }
+    }
+}
+
+void ConstantFolder::FoldExpr(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Identifier: {
+            auto iter = facts.find(node->GetValue());
+            if (iter == facts.end()) {
+                break;
+            }
+            if (iter->second.constant.has_value()) {
+                MakeNumber(node, iter->second.constant.value());
+            } else {
+                node->SetValue(iter->second.copyOf);
+            }
+            break;
+        }
+        case Call: {
+            for (Node* arg = node->GetLeft(); arg; arg = arg->GetLeft()) {
+                if (arg->GetType() == Identifier) {
+                    FoldExpr(arg);
+                }
+            }
+            break;
+        }
+        case MapReadInt:
+        case MapEof: {
+            FoldExpr(node->GetLeft());
+            break;
+        }
+        case Add:
+        case Sub:
+        case Mul:
+        case Div:
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            FoldExpr(node->GetLeft());
+            FoldExpr(node->GetRight());
+
+            Node* left = node->GetLeft();
+            Node* right = node->GetRight();
+            if (IsNumber(left) && IsNumber(right)) {
+                std::optional<int64_t> value = Evaluate(node->GetType(), ValueOf(left), ValueOf(right));
+                if (value.has_value()) {
+                    MakeNumber(node, value.value());
+                    node->SetLeft(nullptr);
+                    node->SetRight(nullptr);
+                }
+                break;
+            }
+
+            if (const Node* operand = NeutralOperand(node)) {
+                ReplaceWith(node, operand);
+                break;
+            }
+
+            // operands have no side effects, but a subtree could still trap on division
+            bool leftLeaf = left->GetType() == Identifier || IsNumber(left);
+            bool rightLeaf = right->GetType() == Identifier || IsNumber(right);
+            if (node->GetType() == Mul && leftLeaf && rightLeaf &&
+                ((IsNumber(left) && ValueOf(left) == 0) || (IsNumber(right) && ValueOf(right) == 0))) {
+                MakeNumber(node, 0);
+                node->SetLeft(nullptr);
+                node->SetRight(nullptr);
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void ConstantFolder::FoldAssignment(Node* node) {
+    Node* rhs = node->GetRight();
+    FoldExpr(rhs);
+
+    std::string name = node->GetLeft()->GetValue();
+    if (!IsDeclared(name)) {
+        scopes.back().push_back(name);
+    }
+    Kill(name);
+
+    if (IsNumber(rhs)) {
+        facts[name] = {ValueOf(rhs), ""};
+    } else if (rhs->GetType() == Identifier && rhs->GetValue() != name) {
+        facts[name] = {std::nullopt, rhs->GetValue()};
+    }
+}
+
+void ConstantFolder::FoldIf(Node* node) {
+    FoldExpr(node->GetLeft());
+
+    if (IsNumber(node->GetLeft()) && ValueOf(node->GetLeft()) == 0) {
+        MakeEnd(node);
+        return;
+    }
+    bool alwaysTaken = IsNumber(node->GetLeft());
+
+    std::unordered_map<std::string, Fact> before = facts;
+
+    EnterScope();
+    FoldStmt(node->GetRight());
+    ExitScope();
+
+    if (alwaysTaken) {
+        return;
+    }
+
+    // only what holds on both the taken and the skipped path survives
+    std::erase_if(facts, [&](const auto& entry) {
+        auto iter = before.find(entry.first);
+        return iter == before.end() || !(iter->second == entry.second);
+    });
+}
+
+void ConstantFolder::FoldWhile(Node* node) {
+    std::unordered_set<std::string> assigned;
+    CollectAssigned(node->GetRight(), assigned);
+    for (const std::string& name : assigned) {
+        Kill(name);
+    }
+
+    FoldExpr(node->GetLeft());
+    if (IsNumber(node->GetLeft()) && ValueOf(node->GetLeft()) == 0) {
+        MakeEnd(node);
+        return;
+    }
+
+    // the loop may run zero times, so facts from the body do not survive it
+    std::unordered_map<std::string, Fact> head = facts;
+
+    EnterScope();
+    FoldStmt(node->GetRight());
+    ExitScope();
+
+    facts = head;
+}
+
+bool ConstantFolder::IsDeclared(const std::string& name) const {
+    return std::any_of(scopes.begin(), scopes.end(), [&](const auto& scope) {
+        return std::find(scope.begin(), scope.end(), name) != scope.end();
+    });
+}
+
+void ConstantFolder::EnterScope() {
+    scopes.emplace_back();
+}
+
+void ConstantFolder::ExitScope() {
+    for (const std::string& name : scopes.back()) {
+        Kill(name);
+    }
+    scopes.pop_back();
+}
+
+void ConstantFolder::Kill(const std::string& name) {
+    facts.erase(name);
+    std::erase_if(facts, [&](const auto& entry) {
+        return entry.second.copyOf == name;
+    });
+}
+
+void ConstantFolder::CollectAssigned(const Node* node, std::unordered_set<std::string>& names) {
+    if (!node) {
+        return;
+    }
+    if (node->GetType() == Equal) {
+        names.insert(node->GetLeft()->GetValue());
+    }
+    if (node->GetType() == Semicolon || node->GetType() == If || node->GetType() == While) {
+        CollectAssigned(node->GetLeft(), names);
+        CollectAssigned(node->GetRight(), names);
+    }
+}
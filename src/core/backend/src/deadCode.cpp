@@ -0,0 +1,133 @@
+#include "deadCode.h"
+
+#include <vector>
+
+namespace {
+
+const std::string kEntryFunctionName = "main";
+
+bool IsZero(const Node* node) {
+    return node->GetType() == Number && std::stoll(node->GetValue()) == 0;
+}
+
+void ReplaceWith(Node* node, const Node* child) {
+    node->SetType(child->GetType());
+    node->SetValue(child->GetValue());
+    node->SetLeft(child->GetLeft());
+    node->SetRight(child->GetRight());
+}
+
+void MakeEnd(Node* node) {
+    node->SetType(End);
+    node->SetValue("");
+    node->SetLeft(nullptr);
+    node->SetRight(nullptr);
+}
+
+void CollectCalls(const Node* node, std::vector<std::string>& callees) {
+    if (!node) {
+        return;
+    }
+    if (node->GetType() == Call) {
+        callees.push_back(node->GetValue());
+    }
+    CollectCalls(node->GetLeft(), callees);
+    CollectCalls(node->GetRight(), callees);
+}
+
+} // namespace
+
+void DeadCodeEliminator::Run(Node* program) {
+    defs.clear();
+    reachable.clear();
+    CollectDefs(program);
+
+    // without an entry point the generator reports the error, so leave the program alone
+    if (defs.count(kEntryFunctionName) == 0) {
+        return;
+    }
+    MarkReachable(kEntryFunctionName);
+    RemoveUnreachable(program);
+
+    for (const std::string& name : reachable) {
+        PruneStmt(defs.at(name)->GetRight());
+    }
+}
+
+void DeadCodeEliminator::CollectDefs(Node* node) {
+    if (!node) {
+        return;
+    }
+    if (node->GetType() == Semicolon) {
+        CollectDefs(node->GetLeft());
+        CollectDefs(node->GetRight());
+    } else if (node->GetType() == Def) {
+        defs.emplace(node->GetValue(), node);
+    }
+}
+
+void DeadCodeEliminator::MarkReachable(const std::string& name) {
+    std::vector<std::string> pending {name};
+    while (!pending.empty()) {
+        std::string current = pending.back();
+        pending.pop_back();
+        // calls to undefined functions are left for the generator to report
+        auto iter = defs.find(current);
+        if (iter == defs.end() || !reachable.insert(current).second) {
+            continue;
+        }
+        CollectCalls(iter->second->GetRight(), pending);
+    }
+}
+
+void DeadCodeEliminator::RemoveUnreachable(Node* node) {
+    if (!node) {
+        return;
+    }
+    if (node->GetType() == Semicolon) {
+        RemoveUnreachable(node->GetLeft());
+        RemoveUnreachable(node->GetRight());
+    } else if (node->GetType() == Def && reachable.count(node->GetValue()) == 0) {
+        MakeEnd(node);
+    }
+}
+
+// Returns whether the statement always ends in a Return, so that whatever follows it is dead.
+bool DeadCodeEliminator::PruneStmt(Node* node) {
+    if (!node) {
+        return false;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            // chains lean left, so the statements before node->GetRight() are all in the left subtree
+            if (PruneStmt(node->GetLeft())) {
+                ReplaceWith(node, node->GetLeft());
+                return true;
+            }
+            return PruneStmt(node->GetRight());
+        }
+        case If: {
+            if (IsZero(node->GetLeft())) {
+                MakeEnd(node);
+                return false;
+            }
+            bool returns = PruneStmt(node->GetRight());
+            return returns && node->GetLeft()->GetType() == Number;
+        }
+        case While: {
+            if (IsZero(node->GetLeft())) {
+                MakeEnd(node);
+                return false;
+            }
+            PruneStmt(node->GetRight());
+            return false;
+        }
+        case Return: {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#include "frameLayout.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr int kWordSize = 8;
+
+} // namespace
+
+int FrameLayout::Size(const Node* def, const RegisterAssignment& registers) {
+    assignment = &registers;
+    scopes.clear();
+    slots = 0;
+    maxSlots = 0;
+
+    scopes.emplace_back();
+    for (const Node* arg = def->GetLeft(); arg; arg = arg->GetLeft()) {
+        Declare(arg);
+    }
+    VisitStmt(def->GetRight());
+    scopes.pop_back();
+
+    return maxSlots * kWordSize;
+}
+
+void FrameLayout::Declare(const Node* decl) {
+    Scope& scope = scopes.back();
+    scope.names.insert(decl->GetValue());
+    if (!assignment->registers.contains(decl)) {
+        ++scope.slots;
+        maxSlots = std::max(maxSlots, ++slots);
+    }
+}
+
+bool FrameLayout::IsDeclared(const std::string& name) const {
+    return std::any_of(scopes.begin(), scopes.end(), [&](const Scope& scope) {
+        return scope.names.contains(name);
+    });
+}
+
+void FrameLayout::VisitStmt(const Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            VisitStmt(node->GetLeft());
+            VisitStmt(node->GetRight());
+            break;
+        }
+        case Equal: {
+            if (!IsDeclared(node->GetLeft()->GetValue())) {
+                Declare(node->GetLeft());
+            }
+            break;
+        }
+        case If:
+        case While: {
+            scopes.emplace_back();
+            VisitStmt(node->GetRight());
+            slots -= scopes.back().slots;
+            scopes.pop_back();
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
@@ -1,28 +1,46 @@
 #include "generator.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
 #include "asmCommands.h"
+#include "callingConvention.h"
 #include "backendExceptions.h"
+#include "frameLayout.h"
+#include "peephole.h"
 #include "node.hpp"
 
 namespace {
 
 const std::string kEntryFunctionName = "main";
-const r64 kArgRegs[] {
-    r64::rdi,
-    r64::rsi,
-    r64::rdx,
-    r64::rcx,
-    r64::r8,
-    r64::r9,
+const std::string kStringLiteralPrefix = "__str_";
+const std::string kPathLiteralPrefix = "__path_";
+// node types backed by a runtime routine
+const NodeType kBuiltins[] {
+    PrintAscii, PrintInt, PrintStr, ReadInt, MapFile, MapReadInt, MapEof, ClockNs, Cycles,
 };
 
+void CollectBuiltins(const Node* node, std::unordered_set<NodeType>& builtins) {
+    if (!node) {
+        return;
+    }
+    if (std::find(std::begin(kBuiltins), std::end(kBuiltins), node->GetType()) != std::end(kBuiltins)) {
+        builtins.insert(node->GetType());
+    }
+    CollectBuiltins(node->GetLeft(), builtins);
+    CollectBuiltins(node->GetRight(), builtins);
+}
+
 } // namespace
 
 void CodeGen::GenerateProgram(Node* program, const std::string& fileName) {
-    CreateStandartFunctions();
+    std::unordered_set<NodeType> builtins(std::begin(kBuiltins), std::end(kBuiltins));
+    if (options.dce) {
+        builtins.clear();
+        CollectBuiltins(program, builtins);
+    }
+    CreateStandartFunctions(builtins);
     CodeGenStmt(program);
 
     std::optional<size_t> addr = funcs.FindFunction(kEntryFunctionName);
@@ -30,12 +48,41 @@ void CodeGen::GenerateProgram(Node* program, const std::string& fileName) {
         throw BackendExcept::CodeGeneratorException("Function not found: " + kEntryFunctionName);
     }
 
+    if (asmGen.HasUnresolvedFixups()) {
+        throw BackendExcept::CodeGeneratorException("Jump to an unbound label");
+    }
+
+    if (options.peephole) {
+        PeepholeOptimizer peephole;
+        peephole.Run(asmGen, funcs.GetOffsets());
+        if (options.peepholeStats) {
+            peephole.PrintStats(std::cerr);
+        }
+    }
+
+    if (options.relax) {
+        asmGen.Relax();
+    }
+
     Elf64_Ehdr ehdr;
     CreateElfHeader(&ehdr);
-    ehdr.e_entry += addr.value();
+    ehdr.e_entry += asmGen.MapOffset(addr.value());
+
+    // read-only data starts on its own page so it can be mapped without execute rights
+    uint64_t rodataOffset = (kCodeOffset + asmGen.GetCodeSize() + kPageSize - 1) / kPageSize * kPageSize;
+
+    // without read-only data the segment is left as PT_NULL, which the loader skips
+    bool hasRodata = data.GetRodataSize() > 0;
+    if (!hasRodata) {
+        rodataOffset = kCodeOffset + asmGen.GetCodeSize();
+    }
 
-    Elf64_Phdr phdr;
-    CreateProgramHeader(&phdr, asmGen.GetCodeSize());
+    Elf64_Phdr phdr[kProgramHeaderCount] {};
+    CreateProgramHeader(&phdr[0], asmGen.GetCodeSize());
+    if (hasRodata) {
+        CreateRodataProgramHeader(&phdr[1], rodataOffset, data.GetRodataSize());
+    }
+    CreateBssProgramHeader(&phdr[2], data.GetBssSize());
 
     std::ofstream file(fileName, std::ios::binary); 
     if (!file) {
@@ -47,8 +94,11 @@ void CodeGen::GenerateProgram(Node* program, const std::string& fileName) {
     }
 
     file.write(reinterpret_cast<const char*>(&ehdr), kElfHeaderSize);
-    file.write(reinterpret_cast<const char*>(&phdr), kProgramHeaderSize);
+    file.write(reinterpret_cast<const char*>(phdr), kProgramHeaderSize * kProgramHeaderCount);
     file.write(reinterpret_cast<const char*>(asmGen.GetCodeData()), asmGen.GetCodeSize() * sizeof(uint8_t));
+    std::vector<char> padding(rodataOffset - kCodeOffset - asmGen.GetCodeSize(), 0);
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char*>(data.GetRodataData()), data.GetRodataSize());
 
     if (!file.good()) {
         throw BackendExcept::FileException("Error writing to file: " + fileName);
@@ -57,12 +107,25 @@ void CodeGen::GenerateProgram(Node* program, const std::string& fileName) {
     file.close();
 }
 
+int32_t CodeGen::GetDataAddress(const std::string& name) const {
+    std::optional<uint64_t> addr = data.FindData(name);
+    if (!addr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined runtime data: " + name);
+    }
+    return static_cast<int32_t>(addr.value());
+}
+
 void CodeGen::CodeGenExpr(Node* node) {
     switch (node->GetType()) {
         case Number:            EmitNumber(node);          break;
         case Identifier:        EmitIdentifier(node);      break;      
         case Call:              EmitCallInt(node);         break;
         case ReadInt:           EmitReadInt();             break;     
+        case MapFile:           EmitMapFile(node);         break;
+        case MapReadInt:        EmitMapReadInt(node);      break;
+        case MapEof:            EmitMapEof(node);          break;
+        case ClockNs:           EmitClockNs();             break;
+        case Cycles:            EmitCycles();              break;
         case Add:               EmitAdd(node);             break;
         case Sub:               EmitSub(node);             break;
         case Mul:               EmitMul(node);             break;
@@ -88,6 +151,7 @@ void CodeGen::CodeGenStmt(Node* node) {
         case Equal:         EmitEqual(node);           break;
         case PrintAscii:    EmitPrintAscii(node);      break;
         case PrintInt:      EmitPrintInt(node);        break;
+        case PrintStr:      EmitPrintStr(node);        break;
         case If:            EmitIf(node);              break;
         case While:         EmitWhile(node);           break;
         case Return:        EmitReturn(node);          break;
@@ -100,20 +164,62 @@ void CodeGen::CodeGenStmt(Node* node) {
 }
 
 void CodeGen::EmitNumber(Node* node) {
-    asmGen.push(std::stoi(node->GetValue()));
+    int64_t value = std::stoll(node->GetValue());
+    if (FitsImm32(value)) {
+        asmGen.push(static_cast<int32_t>(value));
+        return;
+    }
+    asmGen.movabs(r64::rax, value);
+    asmGen.push(r64::rax);
 }
 
 void CodeGen::EmitIdentifier(Node* node) {
-    std::optional<int> offset = vars.FindSymbol(node->GetValue());
-    if (!offset.has_value()) {
+    LoadVariable(FindVariable(node), r64::rax);
+    asmGen.push(r64::rax);
+}
+
+VarLocation CodeGen::FindVariable(Node* node) const {
+    std::optional<VarLocation> location = vars.FindSymbol(node->GetValue());
+    if (!location.has_value()) {
         throw BackendExcept::CodeGeneratorException("Undefined variable: " + node->GetValue());
     }
+    return location.value();
+}
 
-    asmGen.mov(r64::rax, r64::rbp, -offset.value());
-    asmGen.push(r64::rax);
+std::optional<r64> CodeGen::AssignedRegister(const Node* decl) const {
+    auto iter = assignment.registers.find(decl);
+    return iter == assignment.registers.end() ? std::nullopt : std::make_optional(iter->second);
+}
+
+// the register holding the node's value, if it is a variable that lives in one
+std::optional<r64> CodeGen::VariableRegister(Node* node) const {
+    if (node->GetType() != Identifier) {
+        return std::nullopt;
+    }
+    return FindVariable(node).reg;
+}
+
+void CodeGen::LoadVariable(const VarLocation& location, r64 dst) {
+    if (!location.reg.has_value()) {
+        asmGen.mov(dst, r64::rbp, -location.offset);
+    } else if (location.reg.value() != dst) {
+        asmGen.mov(dst, location.reg.value());
+    }
+}
+
+void CodeGen::StoreVariable(const VarLocation& location, r64 src) {
+    if (!location.reg.has_value()) {
+        asmGen.mov(r64::rbp, -location.offset, src);
+    } else if (location.reg.value() != src) {
+        asmGen.mov(location.reg.value(), src);
+    }
 }
 
 void CodeGen::EmitAdd(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -125,6 +231,10 @@ void CodeGen::EmitAdd(Node* node) {
 }
 
 void CodeGen::EmitSub(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -136,6 +246,10 @@ void CodeGen::EmitSub(Node* node) {
 }
 
 void CodeGen::EmitMul(Node* node) {
+    if (EmitStackByConstant(node) || EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -147,18 +261,26 @@ void CodeGen::EmitMul(Node* node) {
 }
 
 void CodeGen::EmitDiv(Node* node) {
+    if (EmitStackByConstant(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
     asmGen.pop(r64::rax);
 
-    asmGen.mov(r64::rdx, 0);
+    asmGen.cqo();
     asmGen.idiv(r64::rbx);
 
     asmGen.push(r64::rax);
 }
 
 void CodeGen::EmitGreater(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -172,6 +294,10 @@ void CodeGen::EmitGreater(Node* node) {
 }
 
 void CodeGen::EmitGreaterOrEqual(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -185,6 +311,10 @@ void CodeGen::EmitGreaterOrEqual(Node* node) {
 }
 
 void CodeGen::EmitLess(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -198,6 +328,10 @@ void CodeGen::EmitLess(Node* node) {
 }
 
 void CodeGen::EmitLessOrEqual(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -211,6 +345,10 @@ void CodeGen::EmitLessOrEqual(Node* node) {
 }
 
 void CodeGen::EmitIdentical(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -224,6 +362,10 @@ void CodeGen::EmitIdentical(Node* node) {
 }
 
 void CodeGen::EmitNotIdentical(Node* node) {
+    if (EmitStackImmediate(node)) {
+        return;
+    }
+
     CodeGenExpr(node->GetLeft());
     CodeGenExpr(node->GetRight());
     asmGen.pop(r64::rbx);
@@ -236,22 +378,49 @@ void CodeGen::EmitNotIdentical(Node* node) {
     asmGen.push(r64::rax);
 }
 
-void CodeGen::EmitCallVoid(Node* node) {
-    asmGen.push(r64::rdi);
-    asmGen.push(r64::rsi);
-    asmGen.push(r64::rdx);
-    asmGen.push(r64::rcx);
-    asmGen.push(r64::r8);
-    asmGen.push(r64::r9);
-
+void CodeGen::LoadCallArgs(Node* node) {
     Node* arg = node->GetLeft();
 
+    // an argument register is taken before its argument is computed, so neither that argument
+    // nor the ones after it can get it as a temporary
+    std::vector<r64> scratchBeforeCall = freeScratch;
     size_t argCount = 0;
     while (arg && argCount < 6) {
-        CodeGenExpr(arg);
-        asmGen.pop(kArgRegs[argCount++]);
+        std::erase(freeScratch, kArgRegs[argCount]);
+        CodeGenExprTo(arg, kArgRegs[argCount++]);
         arg = arg->GetLeft();
     }
+    freeScratch = scratchBeforeCall;
+}
+
+// Saves the registers a call destroys that still hold something. Calls are never nested in
+// expressions and variables the allocator keeps in caller-saved registers never live across one,
+// so the only candidates are pending expression results; usually nothing is saved at all.
+std::vector<r64> CodeGen::SaveLiveRegisters(std::span<const r64> clobbers, bool returnsValue) {
+    std::vector<r64> saved;
+    for (r64 reg : clobbers) {
+        if (std::find(liveResults.begin(), liveResults.end(), reg) == liveResults.end()) {
+            continue;
+        }
+        if (returnsValue && reg == r64::rax) {
+            throw BackendExcept::CodeGeneratorException("Result register is live across a call");
+        }
+        saved.push_back(reg);
+        asmGen.push(reg);
+    }
+    return saved;
+}
+
+void CodeGen::RestoreLiveRegisters(const std::vector<r64>& saved) {
+    for (auto reg = saved.rbegin(); reg != saved.rend(); ++reg) {
+        asmGen.pop(*reg);
+    }
+}
+
+void CodeGen::EmitCallVoid(Node* node) {
+    std::vector<r64> saved = SaveLiveRegisters(kCallClobbers, false);
+
+    LoadCallArgs(node);
 
     std::optional<size_t> addr = funcs.FindFunction(node->GetValue());
     if (!addr.has_value()) {
@@ -259,43 +428,21 @@ void CodeGen::EmitCallVoid(Node* node) {
     }
     asmGen.call((int32_t)(addr.value() - (asmGen.GetCodeSize() + 5)));
 
-    asmGen.pop(r64::r9);
-    asmGen.pop(r64::r8);
-    asmGen.pop(r64::rcx);
-    asmGen.pop(r64::rdx);
-    asmGen.pop(r64::rsi);
-    asmGen.pop(r64::rdi);
+    RestoreLiveRegisters(saved);
 }
 
 void CodeGen::EmitCallInt(Node* node) {
-    asmGen.push(r64::rdi);
-    asmGen.push(r64::rsi);
-    asmGen.push(r64::rdx);
-    asmGen.push(r64::rcx);
-    asmGen.push(r64::r8);
-    asmGen.push(r64::r9);
+    std::vector<r64> saved = SaveLiveRegisters(kCallClobbers, true);
 
-    Node* arg = node->GetLeft();
+    LoadCallArgs(node);
 
-    size_t argCount = 0;
-    while (arg && argCount < 6) {
-        CodeGenExpr(arg);
-        asmGen.pop(kArgRegs[argCount++]);
-        arg = arg->GetLeft();
-    }
-    
     std::optional<size_t> addr = funcs.FindFunction(node->GetValue());
     if (!addr.has_value()) {
         throw BackendExcept::CodeGeneratorException("Undefined function: " + node->GetValue());
     }
     asmGen.call((int32_t)(addr.value() - (asmGen.GetCodeSize() + 5)));
 
-    asmGen.pop(r64::r9);
-    asmGen.pop(r64::r8);
-    asmGen.pop(r64::rcx);
-    asmGen.pop(r64::rdx);
-    asmGen.pop(r64::rsi);
-    asmGen.pop(r64::rdi);
+    RestoreLiveRegisters(saved);
 
     asmGen.push(r64::rax);
 }
@@ -306,45 +453,178 @@ void CodeGen::EmitReadInt() {
         throw BackendExcept::CodeGeneratorException("Undefined function: " + keyReadInt);
     }
   
-    asmGen.push(r64::rcx);
-    asmGen.push(r64::rdx);
-    asmGen.push(r64::rdi);
+    std::vector<r64> saved = SaveLiveRegisters(kRuntimeClobbers, true);
 
     asmGen.call((int32_t)(readIntAddr.value() - (asmGen.GetCodeSize() + 5)));
 
-    asmGen.pop(r64::rdi);
-    asmGen.pop(r64::rdx);
-    asmGen.pop(r64::rcx);
+    RestoreLiveRegisters(saved);
+
+    asmGen.push(r64::rax);
+}
+
+void CodeGen::EmitMapFile(Node* node) {
+    std::optional<size_t> mapFileAddr = funcs.FindFunction(keyMapFile);
+    if (!mapFileAddr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + keyMapFile);
+    }
+
+    uint64_t addr = PathLiteralAddress(node->GetLeft()->GetValue());
+
+    std::vector<r64> saved = SaveLiveRegisters(kRuntimeClobbers, true);
+
+    asmGen.mov(r64::rdi, static_cast<int32_t>(addr));
+    asmGen.call((int32_t)(mapFileAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    RestoreLiveRegisters(saved);
+
+    asmGen.push(r64::rax);
+}
+
+void CodeGen::EmitMapReadInt(Node* node) {
+    std::optional<size_t> mapReadIntAddr = funcs.FindFunction(keyMapReadInt);
+    if (!mapReadIntAddr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + keyMapReadInt);
+    }
+
+    std::vector<r64> saved = SaveLiveRegisters(kRuntimeClobbers, true);
+
+    CodeGenExprTo(node->GetLeft(), r64::rdi);
+
+    asmGen.call((int32_t)(mapReadIntAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    RestoreLiveRegisters(saved);
+
+    asmGen.push(r64::rax);
+}
+
+void CodeGen::EmitMapEof(Node* node) {
+    std::optional<size_t> mapEofAddr = funcs.FindFunction(keyMapEof);
+    if (!mapEofAddr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + keyMapEof);
+    }
+
+    std::vector<r64> saved = SaveLiveRegisters(kRuntimeClobbers, true);
+
+    CodeGenExprTo(node->GetLeft(), r64::rdi);
+
+    asmGen.call((int32_t)(mapEofAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    RestoreLiveRegisters(saved);
+
+    asmGen.push(r64::rax);
+}
+
+void CodeGen::EmitClockNs() {
+    std::optional<size_t> clockNsAddr = funcs.FindFunction(keyClockNs);
+    if (!clockNsAddr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + keyClockNs);
+    }
+
+    std::vector<r64> saved = SaveLiveRegisters(kClockNsClobbers, true);
+
+    asmGen.call((int32_t)(clockNsAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    RestoreLiveRegisters(saved);
 
     asmGen.push(r64::rax);
 }
 
+void CodeGen::EmitCycles() {
+    std::optional<size_t> cyclesAddr = funcs.FindFunction(keyCycles);
+    if (!cyclesAddr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + keyCycles);
+    }
+
+    std::vector<r64> saved = SaveLiveRegisters(kCyclesClobbers, true);
+
+    asmGen.call((int32_t)(cyclesAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    RestoreLiveRegisters(saved);
+
+    asmGen.push(r64::rax);
+}
+
+// "x = call f(...); return x;" -> "return call f(...);", so EmitReturn sees the call in tail position
+void CodeGen::PromoteTailCalls(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            PromoteTailCalls(node->GetLeft());
+            PromoteTailCalls(node->GetRight());
+
+            Node* last = node->GetLeft();
+            while (last->GetType() == Semicolon) {
+                last = last->GetRight();
+            }
+            Node* ret = node->GetRight();
+            if (last->GetType() == Equal && last->GetRight()->GetType() == Call &&
+                ret->GetType() == Return && ret->GetLeft()->GetType() == Identifier &&
+                ret->GetLeft()->GetValue() == last->GetLeft()->GetValue()) {
+                last->SetType(Return);
+                last->SetValue(ret->GetValue());
+                last->SetLeft(last->GetRight());
+                last->SetRight(nullptr);
+                ret->SetType(End);
+                ret->SetValue(keyEnd);
+                ret->SetLeft(nullptr);
+            }
+            break;
+        }
+        case If:
+        case While: {
+            PromoteTailCalls(node->GetRight());
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
 void CodeGen::EmitDef(Node* node) {
+    if (options.mode == CodeGenMode::Ssa) {
+        EmitSsaDef(node);
+        return;
+    }
+
     funcs.AddFunction(node->GetValue(), asmGen.GetCodeSize());
+    currentFunction = node->GetValue();
     vars.EnterScope();
 
-    asmGen.push(r64::rbp);
-    asmGen.mov(r64::rbp, r64::rsp);
+    if (options.tailCalls) {
+        PromoteTailCalls(node->GetRight());
+    }
+
+    switch (options.mode) {
+        case CodeGenMode::Stack:        assignment = {};                                    break;
+        case CodeGenMode::Accumulator:  assignment = RegisterAllocator::FrameOnly();        break;
+        case CodeGenMode::RegAlloc:     assignment = RegisterAllocator().Allocate(node);    break;
+        case CodeGenMode::Ssa:          break;
+    }
+    freeScratch = assignment.scratch;
+    // main never returns, so there is nobody to preserve registers for
+    savedRegs = currentFunction == kEntryFunctionName ? std::vector<r64>{} : assignment.calleeSaved;
+
+    EmitPrologue(FrameLayout().Size(node, assignment));
 
     Node* arg = node->GetLeft();
     int argCount = 0;
     while (arg && argCount < 6) {
-        int offset = vars.AddSymbol(arg->GetValue());
-        asmGen.mov(r64::rbp, -offset, kArgRegs[argCount]);
+        VarLocation location = vars.AddSymbol(arg->GetValue(), AssignedRegister(arg));
+        StoreVariable(location, kArgRegs[argCount]);
         arg = arg->GetLeft();
         ++argCount;
     }
-    asmGen.sub(r64::rsp, 8 * argCount);
 
     CodeGenStmt(node->GetRight());
 
-    asmGen.mov(r64::rsp, r64::rbp);
-    asmGen.pop(r64::rbp);
+    EmitEpilogue();
 
     if (node->GetValue() == kEntryFunctionName) {
-        asmGen.mov(r64::rax, 60);
-        asmGen.mov(r64::rdi, 0);
-        asmGen.syscall();
+        EmitExit();
     }
 
     asmGen.mov(r64::rax, -1);
@@ -359,16 +639,26 @@ void CodeGen::EmitSemicolon(Node* node) {
 }
 
 void CodeGen::EmitEqual(Node* node) {
-    CodeGenExpr(node->GetRight());
-    asmGen.pop(r64::rax);
+    Node* lhs = node->GetLeft();
+    std::optional<VarLocation> location = vars.FindSymbol(lhs->GetValue());
+
+    // a register variable is computed in place unless that would destroy a value still to be read
+    std::optional<r64> target = location.has_value() ? location->reg : AssignedRegister(lhs);
+    if (target.has_value() && !(location.has_value() && OverwritesBeforeRead(node->GetRight(), lhs->GetValue()))) {
+        CodeGenExprTo(node->GetRight(), target.value());
+        if (!location.has_value()) {
+            vars.AddSymbol(lhs->GetValue(), target);
+        }
+        return;
+    }
 
-    std::optional<int> offset = vars.FindSymbol(node->GetLeft()->GetValue());
-    if (!offset.has_value()) {
-        offset = vars.AddSymbol(node->GetLeft()->GetValue());
-        asmGen.sub(r64::rsp, 8);
+    CodeGenExprTo(node->GetRight(), r64::rax);
+
+    if (!location.has_value()) {
+        location = vars.AddSymbol(lhs->GetValue(), target);
     }
 
-    asmGen.mov(r64::rbp, -offset.value(), r64::rax);
+    StoreVariable(location.value(), r64::rax);
 }
 
 void CodeGen::EmitPrintAscii(Node* node) {
@@ -377,22 +667,13 @@ void CodeGen::EmitPrintAscii(Node* node) {
         throw BackendExcept::CodeGeneratorException("Undefined function: " + keyPrintAscii);
     }
 
-    CodeGenExpr(node->GetLeft());
-    asmGen.pop(r64::rdi);  
+    CodeGenExprTo(node->GetLeft(), r64::rdi);
 
-    asmGen.push(r64::rax);
-    asmGen.push(r64::rcx);
-    asmGen.push(r64::rdx);
-    asmGen.push(r64::rsi);
-    asmGen.push(r64::rdi);
+    std::vector<r64> saved = SaveLiveRegisters(kRuntimeClobbers, false);
 
     asmGen.call((int32_t)(printAsciiAddr.value() - (asmGen.GetCodeSize() + 5)));
 
-    asmGen.pop(r64::rdi);
-    asmGen.pop(r64::rsi);
-    asmGen.pop(r64::rdx);
-    asmGen.pop(r64::rcx);
-    asmGen.pop(r64::rax);
+    RestoreLiveRegisters(saved);
 }
 
 void CodeGen::EmitPrintInt(Node* node) { 
@@ -401,29 +682,103 @@ void CodeGen::EmitPrintInt(Node* node) {
         throw BackendExcept::CodeGeneratorException("Undefined function: " + keyPrintInt);
     }
 
-    CodeGenExpr(node->GetLeft());
-    asmGen.pop(r64::rdi);  
+    CodeGenExprTo(node->GetLeft(), r64::rdi);
 
-    asmGen.push(r64::rax);    
-    asmGen.push(r64::rcx);
-    asmGen.push(r64::rdx);
-    asmGen.push(r64::rdi);
+    std::vector<r64> saved = SaveLiveRegisters(kRuntimeClobbers, false);
 
     asmGen.call((int32_t)(printIntAddr.value() - (asmGen.GetCodeSize() + 5)));
 
-    asmGen.pop(r64::rdi);
-    asmGen.pop(r64::rdx);
-    asmGen.pop(r64::rcx);
-    asmGen.pop(r64::rax);
+    RestoreLiveRegisters(saved);
+}
+
+void CodeGen::EmitPrintStr(Node* node) {
+    std::optional<size_t> printStrAddr = funcs.FindFunction(keyPrintStr);
+    if (!printStrAddr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + keyPrintStr);
+    }
+
+    std::string literal = node->GetLeft()->GetValue();
+    uint64_t addr = StringLiteralAddress(literal);
+
+    std::vector<r64> saved = SaveLiveRegisters(kRuntimeClobbers, false);
+
+    asmGen.mov(r64::rdi, static_cast<int32_t>(addr));
+    asmGen.mov(r64::rsi, static_cast<int32_t>(literal.size()));
+
+    asmGen.call((int32_t)(printStrAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    RestoreLiveRegisters(saved);
+}
+
+// Sets the flags an If/While condition is branched on. A comparison goes straight to flags,
+// skipping setcc/movzx and the test of the materialized boolean; anything else is compared
+// with zero.
+void CodeGen::EmitConditionFlags(Node* cond) {
+    switch (cond->GetType()) {
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            if (options.mode == CodeGenMode::Stack) {
+                if (EmitStackCompareImmediate(cond)) {
+                    break;
+                }
+                CodeGenExpr(cond->GetLeft());
+                CodeGenExpr(cond->GetRight());
+                asmGen.pop(r64::rbx);
+                asmGen.pop(r64::rax);
+                asmGen.cmp(r64::rax, r64::rbx);
+            } else {
+                EmitRegCompare(cond);
+            }
+            break;
+        }
+        default: {
+            std::optional<r64> reg = VariableRegister(cond);
+            if (reg.has_value()) {
+                asmGen.test(reg.value(), reg.value());
+            } else {
+                CodeGenExprTo(cond, r64::rax);
+                asmGen.cmp(r64::rax, 0);
+            }
+            break;
+        }
+    }
+}
+
+void CodeGen::EmitBranchIfFalse(Node* cond, Label target) {
+    EmitConditionFlags(cond);
+    switch (cond->GetType()) {
+        case Greater:           asmGen.jle(target); break;
+        case GreaterOrEqual:    asmGen.jl(target);  break;
+        case Less:              asmGen.jge(target); break;
+        case LessOrEqual:       asmGen.jg(target);  break;
+        case Identical:         asmGen.jne(target); break;
+        default:                asmGen.je(target);  break;
+    }
+}
+
+void CodeGen::EmitBranchIfTrue(Node* cond, Label target) {
+    EmitConditionFlags(cond);
+    switch (cond->GetType()) {
+        case Greater:           asmGen.jg(target);  break;
+        case GreaterOrEqual:    asmGen.jge(target); break;
+        case Less:              asmGen.jl(target);  break;
+        case LessOrEqual:       asmGen.jle(target); break;
+        case Identical:         asmGen.je(target);  break;
+        default:                asmGen.jne(target); break;
+    }
 }
 
 void CodeGen::EmitIf(Node* node) {
-    CodeGenExpr(node->GetLeft());
-    asmGen.pop(r64::rax);
-    
-    asmGen.cmp(r64::rax, 0);
-    int32_t jmpPos_1 = (int32_t)asmGen.GetCodeSize();
-    asmGen.je(0);
+    if (EmitConditionalMove(node)) {
+        return;
+    }
+
+    Label end = asmGen.NewLabel();
+    EmitBranchIfFalse(node->GetLeft(), end);
 
     vars.EnterScope();
 
@@ -431,42 +786,147 @@ void CodeGen::EmitIf(Node* node) {
 
     vars.ExitScope();
 
-    int32_t jmpTarget_1 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_1 = jmpTarget_1 - (jmpPos_1 + 6);
-    asmGen.InsertNumber(jmpOffset_1, jmpPos_1 + 2);
+    asmGen.Bind(end);
 }
 
+// The loop is rotated: a guard skips it when the condition fails on entry and the test at
+// the bottom jumps back to the body, so an iteration runs one branch instead of two.
 void CodeGen::EmitWhile(Node* node) {
-    int32_t jmpTarget_2 = (int32_t)asmGen.GetCodeSize();
-    
-    CodeGenExpr(node->GetLeft());
-    asmGen.pop(r64::rax);
+    Node* cond = node->GetLeft();
+    bool alwaysTrue = cond->GetType() == Number && std::stoll(cond->GetValue()) != 0;
+    Label body = asmGen.NewLabel();
+    Label end = asmGen.NewLabel();
 
-    asmGen.cmp(r64::rax, 0);
-    int32_t jmpPos_1 = (int32_t)asmGen.GetCodeSize();
-    asmGen.je(0);
+    if (!alwaysTrue) {
+        EmitBranchIfFalse(cond, end);
+    }
+    if (options.loopAlign > 1) {
+        asmGen.Align(options.loopAlign);
+    }
+    asmGen.Bind(body);
 
     vars.EnterScope();
 
     CodeGenStmt(node->GetRight());
 
     vars.ExitScope();
-    
-    int32_t jmpPos_2 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_2 = jmpTarget_2 - (jmpPos_2 + 5);
-    asmGen.jmp(jmpOffset_2);
 
-    int32_t jmpTarget_1 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_1 = jmpTarget_1 - (jmpPos_1 + 6);
-    asmGen.InsertNumber(jmpOffset_1, jmpPos_1 + 2);
+    if (alwaysTrue) {
+        asmGen.jmp(body);
+    } else {
+        EmitBranchIfTrue(cond, body);
+    }
+    asmGen.Bind(end);
 }
 
 void CodeGen::EmitReturn(Node* node) {
-    CodeGenExpr(node->GetLeft());
-    asmGen.pop(r64::rax);
+    // main exits instead of returning, so its calls cannot replace its frame
+    if (options.tailCalls && node->GetLeft()->GetType() == Call && currentFunction != kEntryFunctionName) {
+        EmitTailCall(node->GetLeft());
+        return;
+    }
 
-    asmGen.mov(r64::rsp, r64::rbp);
-    asmGen.pop(r64::rbp);
+    CodeGenExprTo(node->GetLeft(), r64::rax);
 
+    if (currentFunction == kEntryFunctionName) {
+        EmitExit();
+        return;
+    }
+
+    EmitEpilogue();
     asmGen.ret();
 }
+
+// Arguments travel in registers only, so any callee can take over the frame: the caller's
+// registers are restored as for a return and the callee returns straight to our caller.
+void CodeGen::EmitTailCall(Node* node) {
+    std::optional<size_t> addr = funcs.FindFunction(node->GetValue());
+    if (!addr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + node->GetValue());
+    }
+
+    LoadCallArgs(node);
+
+    if (node->GetValue() == currentFunction) {
+        if (framePointer) {
+            asmGen.mov(r64::rsp, r64::rbp);
+        }
+        asmGen.jmp(bodyEntry);
+        return;
+    }
+
+    EmitEpilogue();
+    asmGen.jmp((int32_t)(addr.value() - (asmGen.GetCodeSize() + 5)));
+}
+
+// The frame is sized up front, so rsp moves once on entry and never inside a loop. A function
+// with nothing in its frame leaves rbp alone; a self tail call re-enters at bodyEntry either way.
+void CodeGen::EmitPrologue(int32_t frameSize) {
+    for (r64 reg : savedRegs) {
+        asmGen.push(reg);
+    }
+
+    framePointer = frameSize != 0;
+    if (framePointer) {
+        asmGen.push(r64::rbp);
+        asmGen.mov(r64::rbp, r64::rsp);
+    }
+
+    bodyEntry = asmGen.NewLabel();
+    asmGen.Bind(bodyEntry);
+
+    if (frameSize != 0) {
+        asmGen.sub(r64::rsp, frameSize);
+    }
+}
+
+void CodeGen::EmitEpilogue() {
+    if (framePointer) {
+        asmGen.mov(r64::rsp, r64::rbp);
+        asmGen.pop(r64::rbp);
+    }
+    for (auto reg = savedRegs.rbegin(); reg != savedRegs.rend(); ++reg) {
+        asmGen.pop(*reg);
+    }
+}
+
+void CodeGen::EmitExit() {
+    std::optional<size_t> flushAddr = funcs.FindFunction(kRuntimeFlushStdout);
+    if (!flushAddr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + kRuntimeFlushStdout);
+    }
+
+    asmGen.call((int32_t)(flushAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    asmGen.mov(r64::rax, 60);
+    asmGen.mov(r64::rdi, 0);
+    asmGen.syscall();
+}
+
+// identical literals share their bytes
+uint64_t CodeGen::StringLiteralAddress(const std::string& literal) {
+    std::string name = kStringLiteralPrefix + literal;
+    std::optional<uint64_t> addr = data.FindData(name);
+    if (!addr.has_value()) {
+        addr = data.AddRodata(name, std::span(reinterpret_cast<const uint8_t*>(literal.data()), literal.size()));
+    }
+    return addr.value();
+}
+
+// open(2) wants a NUL-terminated path
+uint64_t CodeGen::PathLiteralAddress(const std::string& path) {
+    std::string name = kPathLiteralPrefix + path;
+    std::optional<uint64_t> addr = data.FindData(name);
+    if (!addr.has_value()) {
+        addr = data.AddRodata(name, std::span(reinterpret_cast<const uint8_t*>(path.c_str()), path.size() + 1));
+    }
+    return addr.value();
+}
+
+void CodeGen::EmitCallTo(const std::string& name) {
+    std::optional<size_t> addr = funcs.FindFunction(name);
+    if (!addr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + name);
+    }
+    asmGen.call((int32_t)(addr.value() - (asmGen.GetCodeSize() + 5)));
+}
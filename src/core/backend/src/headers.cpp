@@ -1,13 +1,13 @@
 #include "headers.h"
 
 #include <cstdint>
+#include <algorithm>
 
 #include "generator.h"
 
 namespace {
 
 static const uint64_t kBaseLoadAddress = 0x400000;
-static const uint64_t kPageSize = 0x1000;
 
 } // namespace
 
@@ -26,13 +26,13 @@ void CodeGen::CreateElfHeader(Elf64_Ehdr* ehdr) {
     ehdr->e_type = ET_EXEC;
     ehdr->e_machine = EM_X86_64;
     ehdr->e_version = EV_CURRENT;
-    ehdr->e_entry = kBaseLoadAddress + kElfHeaderSize + kProgramHeaderSize;
+    ehdr->e_entry = kBaseLoadAddress + kCodeOffset;
     ehdr->e_phoff = kElfHeaderSize;
     ehdr->e_shoff = 0;
     ehdr->e_flags = 0;
     ehdr->e_ehsize = kElfHeaderSize;
     ehdr->e_phentsize = kProgramHeaderSize;
-    ehdr->e_phnum = 1;
+    ehdr->e_phnum = kProgramHeaderCount;
     ehdr->e_shentsize = 0;
     ehdr->e_shnum = 0;
     ehdr->e_shstrndx = 0;
@@ -41,10 +41,32 @@ void CodeGen::CreateElfHeader(Elf64_Ehdr* ehdr) {
 void CodeGen::CreateProgramHeader(Elf64_Phdr* phdr, uint64_t filesz) {
     phdr->p_type = PT_LOAD;
     phdr->p_flags = PF_X | PF_R;
-    phdr->p_offset = kElfHeaderSize + kProgramHeaderSize;
-    phdr->p_vaddr = kBaseLoadAddress + kElfHeaderSize + kProgramHeaderSize;
-    phdr->p_paddr = kBaseLoadAddress + kElfHeaderSize + kProgramHeaderSize;
+    phdr->p_offset = kCodeOffset;
+    phdr->p_vaddr = kBaseLoadAddress + kCodeOffset;
+    phdr->p_paddr = kBaseLoadAddress + kCodeOffset;
     phdr->p_filesz = filesz;
     phdr->p_memsz = filesz;
     phdr->p_align = kPageSize;
 }
+
+void CodeGen::CreateRodataProgramHeader(Elf64_Phdr* phdr, uint64_t offset, uint64_t filesz) {
+    phdr->p_type = PT_LOAD;
+    phdr->p_flags = PF_R;
+    phdr->p_offset = offset;
+    phdr->p_vaddr = kRodataLoadAddress;
+    phdr->p_paddr = kRodataLoadAddress;
+    phdr->p_filesz = filesz;
+    phdr->p_memsz = filesz;
+    phdr->p_align = kPageSize;
+}
+
+void CodeGen::CreateBssProgramHeader(Elf64_Phdr* phdr, uint64_t memsz) {
+    phdr->p_type = PT_LOAD;
+    phdr->p_flags = PF_R | PF_W;
+    phdr->p_offset = 0;
+    phdr->p_vaddr = kBssLoadAddress;
+    phdr->p_paddr = kBssLoadAddress;
+    phdr->p_filesz = 0;
+    phdr->p_memsz = std::max(memsz, kPageSize);
+    phdr->p_align = kPageSize;
+}
@@ -0,0 +1,136 @@
+#include "generator.h"
+
+#include <limits>
+
+#include "backendExceptions.h"
+#include "node.hpp"
+
+namespace {
+
+r8 LowByte(r64 reg) {
+    return static_cast<r8>(static_cast<int>(reg));
+}
+
+std::optional<int32_t> Imm32(const Node* node) {
+    if (node->GetType() != Number) {
+        return std::nullopt;
+    }
+    int64_t value = std::stoll(node->GetValue());
+    return FitsImm32(value) ? std::make_optional(static_cast<int32_t>(value)) : std::nullopt;
+}
+
+// the literal operand an instruction can take as an immediate: the right one of any
+// operator below, or the left one of a commutative operator
+const Node* ImmediateOperand(const Node* node) {
+    switch (node->GetType()) {
+        case Add:
+        case Mul: {
+            if (Imm32(node->GetRight()).has_value()) return node->GetRight();
+            if (Imm32(node->GetLeft()).has_value()) return node->GetLeft();
+            return nullptr;
+        }
+        case Sub:
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            return Imm32(node->GetRight()).has_value() ? node->GetRight() : nullptr;
+        }
+        default: {
+            return nullptr;
+        }
+    }
+}
+
+} // namespace
+
+// inc/dec for a step of one, the flags they leave are never read
+void CodeGen::EmitAddImmediate(r64 dst, int32_t imm) {
+    if (imm == 1) {
+        asmGen.inc(dst);
+    } else if (imm == -1) {
+        asmGen.dec(dst);
+    } else {
+        asmGen.add(dst, imm);
+    }
+}
+
+void CodeGen::EmitSubImmediate(r64 dst, int32_t imm) {
+    if (imm == std::numeric_limits<int32_t>::min()) {
+        asmGen.sub(dst, imm);
+    } else {
+        EmitAddImmediate(dst, -imm);
+    }
+}
+
+// dst = dst op imm, comparisons materialized as 0 or 1
+void CodeGen::EmitImmediateOp(NodeType type, r64 dst, int32_t imm) {
+    switch (type) {
+        case Add:               EmitAddImmediate(dst, imm);     break;
+        case Sub:               EmitSubImmediate(dst, imm);     break;
+        case Mul:               asmGen.imul(dst, dst, imm);     break;
+        case Greater:           asmGen.cmp(dst, imm); asmGen.setg(dst);  break;
+        case GreaterOrEqual:    asmGen.cmp(dst, imm); asmGen.setge(dst); break;
+        case Less:              asmGen.cmp(dst, imm); asmGen.setl(dst);  break;
+        case LessOrEqual:       asmGen.cmp(dst, imm); asmGen.setle(dst); break;
+        case Identical:         asmGen.cmp(dst, imm); asmGen.sete(dst);  break;
+        case NotIdentical:      asmGen.cmp(dst, imm); asmGen.setne(dst); break;
+
+        default: {
+            throw BackendExcept::CodeGeneratorException("Unknown node type: " + std::to_string(type));
+        }
+    }
+
+    switch (type) {
+        case Add:
+        case Sub:
+        case Mul: {
+            break;
+        }
+        default: {
+            asmGen.movzx(dst, LowByte(dst));
+            break;
+        }
+    }
+}
+
+// Stack mode: the other operand goes through rax and the literal is never pushed.
+bool CodeGen::EmitStackImmediate(Node* node) {
+    const Node* constant = ImmediateOperand(node);
+    if (!constant) {
+        return false;
+    }
+    Node* operand = constant == node->GetRight() ? node->GetLeft() : node->GetRight();
+
+    CodeGenExpr(operand);
+    asmGen.pop(r64::rax);
+    EmitImmediateOp(node->GetType(), r64::rax, Imm32(constant).value());
+    asmGen.push(r64::rax);
+    return true;
+}
+
+bool CodeGen::EmitRegImmediate(Node* node, r64 dst) {
+    const Node* constant = ImmediateOperand(node);
+    if (!constant) {
+        return false;
+    }
+    Node* operand = constant == node->GetRight() ? node->GetLeft() : node->GetRight();
+
+    CodeGenExprTo(operand, dst);
+    EmitImmediateOp(node->GetType(), dst, Imm32(constant).value());
+    return true;
+}
+
+// Stack mode flags for `left cmp right` when the right operand is an imm32 literal.
+bool CodeGen::EmitStackCompareImmediate(Node* node) {
+    std::optional<int32_t> imm = Imm32(node->GetRight());
+    if (!imm.has_value()) {
+        return false;
+    }
+    CodeGenExpr(node->GetLeft());
+    asmGen.pop(r64::rax);
+    asmGen.cmp(r64::rax, imm.value());
+    return true;
+}
@@ -0,0 +1,259 @@
+#include "inliner.h"
+
+#include <algorithm>
+
+namespace {
+
+const std::string kEntryFunctionName = "main";
+constexpr size_t kMaxRegisterArgs = 6;
+
+size_t CountNodes(const Node* node) {
+    if (!node) {
+        return 0;
+    }
+    return 1 + CountNodes(node->GetLeft()) + CountNodes(node->GetRight());
+}
+
+size_t ChainLength(const Node* node) {
+    size_t length = 0;
+    for (; node; node = node->GetLeft()) {
+        ++length;
+    }
+    return length;
+}
+
+bool Contains(const Node* node, NodeType type) {
+    if (!node) {
+        return false;
+    }
+    return node->GetType() == type || Contains(node->GetLeft(), type) || Contains(node->GetRight(), type);
+}
+
+// a Return inside a loop would need a real jump out of it
+bool ReturnsFromLoop(const Node* node) {
+    if (!node) {
+        return false;
+    }
+    switch (node->GetType()) {
+        case Semicolon:     return ReturnsFromLoop(node->GetLeft()) || ReturnsFromLoop(node->GetRight());
+        case If:            return ReturnsFromLoop(node->GetRight());
+        case While:         return Contains(node->GetRight(), Return);
+        default:            return false;
+    }
+}
+
+void Flatten(const Node* node, std::vector<const Node*>& stmts) {
+    if (!node || node->GetType() == End) {
+        return;
+    }
+    if (node->GetType() == Semicolon) {
+        Flatten(node->GetLeft(), stmts);
+        Flatten(node->GetRight(), stmts);
+        return;
+    }
+    stmts.push_back(node);
+}
+
+std::vector<const Node*> Statements(const Node* body) {
+    std::vector<const Node*> stmts;
+    Flatten(body, stmts);
+    return stmts;
+}
+
+} // namespace
+
+void Inliner::Run(Node* program) {
+    std::vector<Node*> defs;
+    std::vector<Node*> pending {program};
+    while (!pending.empty()) {
+        Node* node = pending.back();
+        pending.pop_back();
+        if (!node) {
+            continue;
+        }
+        if (node->GetType() == Semicolon) {
+            pending.push_back(node->GetRight());
+            pending.push_back(node->GetLeft());
+        } else if (node->GetType() == Def) {
+            defs.push_back(node);
+        }
+    }
+
+    for (const Node* def : defs) {
+        if (IsCandidate(def)) {
+            candidates[def->GetValue()] = def;
+        }
+    }
+    for (Node* def : defs) {
+        VisitStmt(def->GetRight());
+    }
+}
+
+bool Inliner::IsCandidate(const Node* def) const {
+    return def->GetValue() != kEntryFunctionName &&
+           ChainLength(def->GetLeft()) <= kMaxRegisterArgs &&
+           CountNodes(def->GetRight()) <= limit &&
+           !Contains(def->GetRight(), Call) &&
+           !ReturnsFromLoop(def->GetRight());
+}
+
+void Inliner::VisitStmt(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    auto inlinable = [&](const Node* call) {
+        auto iter = candidates.find(call->GetValue());
+        return call->GetType() == Call && iter != candidates.end() &&
+               ChainLength(call->GetLeft()) == ChainLength(iter->second->GetLeft());
+    };
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            VisitStmt(node->GetLeft());
+            VisitStmt(node->GetRight());
+            break;
+        }
+        case If:
+        case While: {
+            VisitStmt(node->GetRight());
+            break;
+        }
+        case Equal: {
+            if (inlinable(node->GetRight())) {
+                Expand(node, node->GetRight(), node->GetLeft()->GetValue(), false);
+            }
+            break;
+        }
+        case Return: {
+            if (inlinable(node->GetLeft())) {
+                Expand(node, node->GetLeft(), "", true);
+            }
+            break;
+        }
+        case Call: {
+            if (inlinable(node)) {
+                Expand(node, node, "", false);
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// Replaces stmt, which performs `call`, with the callee's body. The result goes to `target`,
+// to a fresh variable that is then returned if returnTarget is set, or nowhere.
+void Inliner::Expand(Node* stmt, const Node* call, const std::string& target, bool returnTarget) {
+    const Node* def = candidates.at(call->GetValue());
+    std::string site = "__inl" + std::to_string(siteCount++);
+    Site expansion {site + "_", returnTarget ? site + ".result" : target, site + ".done"};
+
+    // parameters are bound first, so the target may safely appear among the arguments
+    std::vector<Node*> out;
+    const Node* arg = call->GetLeft();
+    for (const Node* param = def->GetLeft(); param; param = param->GetLeft(), arg = arg->GetLeft()) {
+        out.push_back(Assign(expansion.prefix + param->GetValue(), tree.Create(arg->GetType(), arg->GetValue())));
+    }
+
+    // a function that falls off its end returns -1
+    std::vector<const Node*> stmts = Statements(def->GetRight());
+    bool nested = std::any_of(stmts.begin(), stmts.end(), [](const Node* node) {
+        return node->GetType() != Return && Contains(node, Return);
+    });
+    bool returns = std::any_of(stmts.begin(), stmts.end(), [](const Node* node) {
+        return node->GetType() == Return;
+    });
+    if (nested) {
+        if (!expansion.target.empty()) {
+            out.push_back(Assign(expansion.target, tree.Create(Number, "-1")));
+        }
+        out.push_back(Assign(expansion.flag, tree.Create(Number, "0")));
+    }
+
+    std::vector<Node*> body = Lower(stmts, expansion, false);
+    out.insert(out.end(), body.begin(), body.end());
+
+    if (!nested && !returns && !expansion.target.empty()) {
+        out.push_back(Assign(expansion.target, tree.Create(Number, "-1")));
+    }
+    if (returnTarget) {
+        out.push_back(tree.Create(Return, keyReturn, tree.Create(Identifier, expansion.target), nullptr));
+    }
+
+    Node* chain = Chain(out);
+    stmt->SetType(chain->GetType());
+    stmt->SetValue(chain->GetValue());
+    stmt->SetLeft(chain->GetLeft());
+    stmt->SetRight(chain->GetRight());
+}
+
+// Copies a statement list without its Returns; `nested` marks code that runs inside an If,
+// where a Return has to raise the done flag for the guards around the rest of the body.
+std::vector<Node*> Inliner::Lower(const std::vector<const Node*>& stmts, const Site& site, bool nested) {
+    std::vector<Node*> out;
+
+    for (size_t i = 0; i < stmts.size(); ++i) {
+        const Node* stmt = stmts[i];
+
+        if (stmt->GetType() == Return) {
+            std::vector<Node*> lowered = LowerReturn(stmt, site, nested);
+            out.insert(out.end(), lowered.begin(), lowered.end());
+            // anything after a Return at this level is unreachable
+            return out;
+        }
+
+        if (stmt->GetType() != If || !Contains(stmt->GetRight(), Return)) {
+            out.push_back(Clone(stmt, site.prefix));
+            continue;
+        }
+
+        Node* taken = Chain(Lower(Statements(stmt->GetRight()), site, true));
+        out.push_back(tree.Create(If, keyIf, Clone(stmt->GetLeft(), site.prefix), taken));
+
+        if (i + 1 < stmts.size()) {
+            std::vector<const Node*> rest(stmts.begin() + i + 1, stmts.end());
+            Node* notDone = tree.Create(Identical, keyIdentical, tree.Create(Identifier, site.flag), tree.Create(Number, "0"));
+            out.push_back(tree.Create(If, keyIf, notDone, Chain(Lower(rest, site, true))));
+        }
+        return out;
+    }
+    return out;
+}
+
+std::vector<Node*> Inliner::LowerReturn(const Node* ret, const Site& site, bool nested) {
+    // candidates make no calls, so a discarded return value has no effects to keep
+    std::vector<Node*> out;
+    if (!site.target.empty()) {
+        out.push_back(Assign(site.target, Clone(ret->GetLeft(), site.prefix)));
+    }
+    if (nested) {
+        out.push_back(Assign(site.flag, tree.Create(Number, "1")));
+    }
+    return out;
+}
+
+// every identifier in a function body names one of its locals or parameters
+Node* Inliner::Clone(const Node* node, const std::string& prefix) {
+    if (!node) {
+        return nullptr;
+    }
+    std::string value = node->GetType() == Identifier ? prefix + node->GetValue() : node->GetValue();
+    return tree.Create(node->GetType(), value, Clone(node->GetLeft(), prefix), Clone(node->GetRight(), prefix));
+}
+
+Node* Inliner::Chain(const std::vector<Node*>& stmts) {
+    if (stmts.empty()) {
+        return tree.Create(End, keyEnd);
+    }
+    Node* chain = stmts.front();
+    for (size_t i = 1; i < stmts.size(); ++i) {
+        chain = tree.Create(Semicolon, keySemicolon, chain, stmts[i]);
+    }
+    return chain;
+}
+
+Node* Inliner::Assign(const std::string& name, Node* value) {
+    return tree.Create(Equal, keyEqual, tree.Create(Identifier, name), value);
+}
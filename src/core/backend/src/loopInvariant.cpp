@@ -0,0 +1,212 @@
+#include "loopInvariant.h"
+
+namespace {
+
+const std::string kTempPrefix = "__inv_";
+
+bool IsLeaf(const Node* node) {
+    return node->GetType() == Number || node->GetType() == Identifier;
+}
+
+// identical expressions in one loop share a temporary
+std::string Key(const Node* node) {
+    if (!node) {
+        return "";
+    }
+    return std::to_string(node->GetType()) + ":" + node->GetValue() +
+           "(" + Key(node->GetLeft()) + "," + Key(node->GetRight()) + ")";
+}
+
+void CollectAssigned(const Node* node, std::unordered_set<std::string>& names) {
+    if (!node) {
+        return;
+    }
+    if (node->GetType() == Equal) {
+        names.insert(node->GetLeft()->GetValue());
+    }
+    if (node->GetType() == Semicolon || node->GetType() == If || node->GetType() == While) {
+        CollectAssigned(node->GetLeft(), names);
+        CollectAssigned(node->GetRight(), names);
+    }
+}
+
+} // namespace
+
+void LoopInvariantMotion::Run(Node* program) {
+    if (!program) {
+        return;
+    }
+
+    switch (program->GetType()) {
+        case Semicolon: {
+            Run(program->GetLeft());
+            Run(program->GetRight());
+            break;
+        }
+        case Def: {
+            VisitStmt(program->GetRight());
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void LoopInvariantMotion::VisitStmt(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            VisitStmt(node->GetLeft());
+            VisitStmt(node->GetRight());
+            break;
+        }
+        case If:            VisitStmt(node->GetRight());    break;
+        case While:         HoistLoop(node);                break;
+
+        default: {
+            break;
+        }
+    }
+}
+
+void LoopInvariantMotion::HoistLoop(Node* loop) {
+    assigned.clear();
+    temps.clear();
+    hoisted.clear();
+    CollectAssigned(loop->GetRight(), assigned);
+
+    HoistInExpr(loop->GetLeft());
+    HoistInStmt(loop->GetRight());
+
+    if (!hoisted.empty()) {
+        // the While node turns into "temporaries; while" in place, so its parent keeps pointing at it
+        Node* inner = tree.Create(While, loop->GetValue(), loop->GetLeft(), loop->GetRight());
+        Node* prefix = hoisted.front();
+        for (size_t i = 1; i < hoisted.size(); ++i) {
+            prefix = tree.Create(Semicolon, keySemicolon, prefix, hoisted[i]);
+        }
+        loop->SetType(Semicolon);
+        loop->SetValue(keySemicolon);
+        loop->SetLeft(prefix);
+        loop->SetRight(inner);
+        loop = inner;
+    }
+
+    // nested loops see the temporaries as plain variables they never assign
+    VisitStmt(loop->GetRight());
+}
+
+void LoopInvariantMotion::HoistInStmt(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            HoistInStmt(node->GetLeft());
+            HoistInStmt(node->GetRight());
+            break;
+        }
+        case If:
+        case While: {
+            HoistInExpr(node->GetLeft());
+            HoistInStmt(node->GetRight());
+            break;
+        }
+        case Equal:         HoistInExpr(node->GetRight());  break;
+        case PrintAscii:
+        case PrintInt:
+        case Return:        HoistInExpr(node->GetLeft());   break;
+
+        default: {
+            break;
+        }
+    }
+}
+
+void LoopInvariantMotion::HoistInExpr(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    if (!IsLeaf(node) && IsInvariant(node)) {
+        std::string name = TempFor(node);
+        node->SetType(Identifier);
+        node->SetValue(name);
+        node->SetLeft(nullptr);
+        node->SetRight(nullptr);
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Add:
+        case Sub:
+        case Mul:
+        case Div:
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            HoistInExpr(node->GetLeft());
+            HoistInExpr(node->GetRight());
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// Hoisted code runs even when the loop body never does, so besides being pure an
+// invariant expression must not trap: a division qualifies only by a constant other than 0 and -1.
+bool LoopInvariantMotion::IsInvariant(const Node* node) const {
+    switch (node->GetType()) {
+        case Number: {
+            return true;
+        }
+        case Identifier: {
+            return assigned.count(node->GetValue()) == 0;
+        }
+        case Add:
+        case Sub:
+        case Mul:
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            return IsInvariant(node->GetLeft()) && IsInvariant(node->GetRight());
+        }
+        case Div: {
+            const Node* divisor = node->GetRight();
+            if (divisor->GetType() != Number) {
+                return false;
+            }
+            int64_t value = std::stoll(divisor->GetValue());
+            return value != 0 && value != -1 && IsInvariant(node->GetLeft());
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+std::string LoopInvariantMotion::TempFor(Node* expr) {
+    std::string key = Key(expr);
+    if (auto iter = temps.find(key); iter != temps.end()) {
+        return iter->second;
+    }
+
+    std::string name = kTempPrefix + std::to_string(tempCount++);
+    Node* value = tree.Create(expr->GetType(), expr->GetValue(), expr->GetLeft(), expr->GetRight());
+    hoisted.push_back(tree.Create(Equal, keyEqual, tree.Create(Identifier, name), value));
+    temps.emplace(key, name);
+    return name;
+}
@@ -0,0 +1,328 @@
+#include "loopUnroll.h"
+
+#include <limits>
+#include <unordered_set>
+
+namespace {
+
+// loops whose unrolled body would exceed this many AST nodes are left alone
+constexpr size_t kMaxUnrolledNodes = 160;
+// constant-trip loops up to this many iterations are replaced by their bodies
+constexpr int64_t kMaxFullTrips = 16;
+
+size_t CountNodes(const Node* node) {
+    if (!node) {
+        return 0;
+    }
+    return 1 + CountNodes(node->GetLeft()) + CountNodes(node->GetRight());
+}
+
+void CollectAssigned(const Node* node, std::unordered_set<std::string>& names) {
+    if (!node) {
+        return;
+    }
+    if (node->GetType() == Equal) {
+        names.insert(node->GetLeft()->GetValue());
+    }
+    if (node->GetType() == Semicolon || node->GetType() == If || node->GetType() == While) {
+        CollectAssigned(node->GetLeft(), names);
+        CollectAssigned(node->GetRight(), names);
+    }
+}
+
+void Flatten(const Node* node, std::vector<const Node*>& stmts) {
+    if (!node || node->GetType() == End) {
+        return;
+    }
+    if (node->GetType() == Semicolon) {
+        Flatten(node->GetLeft(), stmts);
+        Flatten(node->GetRight(), stmts);
+        return;
+    }
+    stmts.push_back(node);
+}
+
+bool IsIncreasing(NodeType compare) {
+    return compare == Less || compare == LessOrEqual;
+}
+
+// the bound is read once per test, so it has to give the same value every time
+bool IsStableBound(const Node* node, const std::unordered_set<std::string>& assigned) {
+    switch (node->GetType()) {
+        case Number: {
+            return true;
+        }
+        case Identifier: {
+            return assigned.count(node->GetValue()) == 0;
+        }
+        case Add:
+        case Sub:
+        case Mul: {
+            return IsStableBound(node->GetLeft(), assigned) && IsStableBound(node->GetRight(), assigned);
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+// the step of `index = index + c`, `index = c + index` or `index = index - c` for a literal c > 0
+std::optional<int64_t> Step(const Node* stmt, const std::string& index) {
+    if (stmt->GetType() != Equal || stmt->GetLeft()->GetValue() != index) {
+        return std::nullopt;
+    }
+
+    auto isIndex = [&](const Node* node) {
+        return node->GetType() == Identifier && node->GetValue() == index;
+    };
+    auto literal = [](const Node* node) -> std::optional<int64_t> {
+        if (node->GetType() != Number) {
+            return std::nullopt;
+        }
+        int64_t value = std::stoll(node->GetValue());
+        if (value <= 0 || value > std::numeric_limits<int32_t>::max()) {
+            return std::nullopt;
+        }
+        return value;
+    };
+
+    const Node* value = stmt->GetRight();
+    const Node* left = value->GetLeft();
+    const Node* right = value->GetRight();
+    if (value->GetType() == Add) {
+        if (isIndex(left)) {
+            return literal(right);
+        }
+        if (isIndex(right)) {
+            return literal(left);
+        }
+    } else if (value->GetType() == Sub && isIndex(left)) {
+        std::optional<int64_t> step = literal(right);
+        return step.has_value() ? std::make_optional(-step.value()) : std::nullopt;
+    }
+    return std::nullopt;
+}
+
+bool FitsInt64(__int128 value) {
+    return value >= std::numeric_limits<int64_t>::min() && value <= std::numeric_limits<int64_t>::max();
+}
+
+} // namespace
+
+void LoopUnroller::Run(Node* program) {
+    if (!program) {
+        return;
+    }
+
+    switch (program->GetType()) {
+        case Semicolon: {
+            Run(program->GetLeft());
+            Run(program->GetRight());
+            break;
+        }
+        case Def: {
+            constants.clear();
+            VisitStmt(program->GetRight());
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void LoopUnroller::VisitStmt(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            VisitStmt(node->GetLeft());
+            VisitStmt(node->GetRight());
+            break;
+        }
+        case Equal: {
+            const std::string& name = node->GetLeft()->GetValue();
+            if (node->GetRight()->GetType() == Number) {
+                constants[name] = std::stoll(node->GetRight()->GetValue());
+            } else {
+                constants.erase(name);
+            }
+            break;
+        }
+        case If: {
+            std::unordered_map<std::string, int64_t> outer = constants;
+            VisitStmt(node->GetRight());
+            constants = std::move(outer);
+            Forget(node->GetRight());
+            break;
+        }
+        case While: {
+            // whatever the loop assigns is unknown inside it and after it
+            std::unordered_map<std::string, int64_t> entry = constants;
+            Forget(node->GetRight());
+            std::unordered_map<std::string, int64_t> carried = constants;
+            VisitStmt(node->GetRight());
+            constants = std::move(carried);
+            Unroll(node, entry);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void LoopUnroller::Unroll(Node* loop, const std::unordered_map<std::string, int64_t>& entry) {
+    std::optional<CountedLoop> counted = Match(loop);
+    if (!counted.has_value()) {
+        return;
+    }
+
+    auto start = entry.find(counted->index);
+    if (start != entry.end() && UnrollFully(loop, counted.value(), start->second)) {
+        return;
+    }
+    if (factor > 1) {
+        UnrollPartially(loop, counted.value());
+    }
+}
+
+std::optional<LoopUnroller::CountedLoop> LoopUnroller::Match(const Node* loop) const {
+    const Node* cond = loop->GetLeft();
+    NodeType compare = cond->GetType();
+    if (compare != Less && compare != LessOrEqual && compare != Greater && compare != GreaterOrEqual) {
+        return std::nullopt;
+    }
+    if (cond->GetLeft()->GetType() != Identifier) {
+        return std::nullopt;
+    }
+    std::string index = cond->GetLeft()->GetValue();
+
+    std::vector<const Node*> stmts;
+    Flatten(loop->GetRight(), stmts);
+    if (stmts.empty()) {
+        return std::nullopt;
+    }
+    std::optional<int64_t> step = Step(stmts.back(), index);
+    if (!step.has_value() || IsIncreasing(compare) != (step.value() > 0)) {
+        return std::nullopt;
+    }
+
+    std::unordered_set<std::string> assigned;
+    for (size_t i = 0; i + 1 < stmts.size(); ++i) {
+        CollectAssigned(stmts[i], assigned);
+    }
+    if (assigned.count(index) != 0) {
+        return std::nullopt;
+    }
+    assigned.insert(index);
+    if (!IsStableBound(cond->GetRight(), assigned)) {
+        return std::nullopt;
+    }
+
+    return CountedLoop {index, compare, cond->GetRight(), step.value()};
+}
+
+// The loop becomes its body repeated once per iteration; the index keeps its increments,
+// so constant folding can turn every copy's reads of it into literals.
+bool LoopUnroller::UnrollFully(Node* loop, const CountedLoop& counted, int64_t start) {
+    if (counted.bound->GetType() != Number) {
+        return false;
+    }
+
+    __int128 first = start;
+    __int128 limit = std::stoll(counted.bound->GetValue());
+    __int128 step = counted.step;
+    __int128 trips = 0;
+    switch (counted.compare) {
+        case Less:              trips = first < limit ? (limit - first + step - 1) / step : 0;      break;
+        case LessOrEqual:       trips = first <= limit ? (limit - first) / step + 1 : 0;            break;
+        case Greater:           trips = first > limit ? (first - limit - step - 1) / -step : 0;     break;
+        default:                trips = first >= limit ? (first - limit) / -step + 1 : 0;           break;
+    }
+
+    // an index that wraps around on the way would make the rolled loop run differently
+    if (trips > kMaxFullTrips || !FitsInt64(first + trips * step)) {
+        return false;
+    }
+    if (static_cast<size_t>(trips) * CountNodes(loop->GetRight()) > kMaxUnrolledNodes) {
+        return false;
+    }
+
+    Node* copies = trips == 0 ? tree.Create(End, keyEnd) : Repeat(loop->GetRight(), static_cast<size_t>(trips));
+    loop->SetType(copies->GetType());
+    loop->SetValue(copies->GetValue());
+    loop->SetLeft(copies->GetLeft());
+    loop->SetRight(copies->GetRight());
+    return true;
+}
+
+// The While node turns into "unrolled; while" in place: the unrolled loop runs `factor`
+// bodies while all of their index values pass the test, the original finishes the rest.
+void LoopUnroller::UnrollPartially(Node* loop, const CountedLoop& counted) {
+    if (CountNodes(loop->GetRight()) * factor > kMaxUnrolledNodes) {
+        return;
+    }
+
+    // the unrolled test compares the index against the bound moved `reach` towards it
+    __int128 reach = static_cast<__int128>(factor - 1) * (counted.step > 0 ? counted.step : -counted.step);
+    NodeType towards = counted.step > 0 ? Sub : Add;
+    // the last bound the moved one cannot wrap around from
+    __int128 safeBound = counted.step > 0 ? std::numeric_limits<int64_t>::min() + reach
+                                          : std::numeric_limits<int64_t>::max() - reach;
+    if (!FitsInt64(reach) || !FitsInt64(safeBound)) {
+        return;
+    }
+
+    bool guarded = true;
+    if (counted.bound->GetType() == Number) {
+        __int128 bound = std::stoll(counted.bound->GetValue());
+        if (counted.step > 0 ? bound < safeBound : bound > safeBound) {
+            return;
+        }
+        guarded = false;
+    }
+
+    Node* movedBound = tree.Create(towards, towards == Sub ? keySub : keyAdd, Clone(counted.bound),
+                                   tree.Create(Number, std::to_string(static_cast<int64_t>(reach))));
+    Node* test = tree.Create(counted.compare, loop->GetLeft()->GetValue(), tree.Create(Identifier, counted.index), movedBound);
+    Node* unrolled = tree.Create(While, loop->GetValue(), test, Repeat(loop->GetRight(), factor));
+
+    if (guarded) {
+        NodeType check = counted.step > 0 ? GreaterOrEqual : LessOrEqual;
+        Node* cond = tree.Create(check, check == GreaterOrEqual ? keyGreaterOrEqual : keyLessOrEqual, Clone(counted.bound),
+                                 tree.Create(Number, std::to_string(static_cast<int64_t>(safeBound))));
+        unrolled = tree.Create(If, keyIf, cond, unrolled);
+    }
+
+    Node* remainder = tree.Create(While, loop->GetValue(), loop->GetLeft(), loop->GetRight());
+    loop->SetType(Semicolon);
+    loop->SetValue(keySemicolon);
+    loop->SetLeft(unrolled);
+    loop->SetRight(remainder);
+}
+
+Node* LoopUnroller::Clone(const Node* node) {
+    if (!node) {
+        return nullptr;
+    }
+    return tree.Create(node->GetType(), node->GetValue(), Clone(node->GetLeft()), Clone(node->GetRight()));
+}
+
+Node* LoopUnroller::Repeat(const Node* body, size_t times) {
+    Node* chain = Clone(body);
+    for (size_t i = 1; i < times; ++i) {
+        chain = tree.Create(Semicolon, keySemicolon, chain, Clone(body));
+    }
+    return chain;
+}
+
+void LoopUnroller::Forget(const Node* stmt) {
+    std::unordered_set<std::string> assigned;
+    CollectAssigned(stmt, assigned);
+    for (const std::string& name : assigned) {
+        constants.erase(name);
+    }
+}
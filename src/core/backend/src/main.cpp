@@ -1,23 +1,139 @@
+#include <bit>
 #include <iostream>
+#include <string>
 
 #include "tree.hpp"
 #include "generator.h"
+#include "constFolder.h"
+#include "deadCode.h"
+#include "inliner.h"
+#include "loopInvariant.h"
+#include "loopUnroll.h"
+#include "valueNumbering.h"
 #include "backendExceptions.h"
 #include "treeExceptions.hpp"
+#include "middleExceptions.hpp"
+
+namespace {
+
+const std::string kCodeGenOption = "--codegen=";
+const std::string kNoPeepholeOption = "--no-peephole";
+const std::string kPeepholeStatsOption = "--peephole-stats";
+const std::string kInlineLimitOption = "--inline-limit=";
+const std::string kNoFoldOption = "--no-fold";
+const std::string kNoLicmOption = "--no-licm";
+const std::string kNoCseOption = "--no-cse";
+const std::string kNoCmovOption = "--no-cmov";
+const std::string kUnrollOption = "--unroll=";
+const std::string kNoTailCallsOption = "--no-tail-calls";
+const std::string kNoRelaxOption = "--no-relax";
+const std::string kNoDceOption = "--no-dce";
+const std::string kDumpSsaOption = "--dump-ssa";
+const std::string kLoopAlignOption = "--loop-align=";
+
+size_t ParseCount(const std::string& value, const std::string& arg) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.size() > 9) {
+        throw BackendExcept::OptionException("invalid value in option: " + arg);
+    }
+    return std::stoul(value);
+}
+
+// usage: backend <ast-file> <output-file> [--codegen=stack|accumulator|regalloc|ssa] [--no-peephole] [--peephole-stats] [--inline-limit=N] [--no-fold] [--no-licm] [--no-cse] [--no-cmov] [--unroll=N] [--no-tail-calls] [--no-relax] [--no-dce] [--dump-ssa] [--loop-align=N]
+CodeGenOptions ParseOptions(int argc, const char** argv) {
+    if (argc < 3) {
+        throw BackendExcept::OptionException(
+            "usage: backend <ast-file> <output-file> [--codegen=stack|accumulator|regalloc|ssa] [--no-peephole] [--peephole-stats] [--inline-limit=N] [--no-fold] [--no-licm] [--no-cse] [--no-cmov] [--unroll=N] [--no-tail-calls] [--no-relax] [--no-dce] [--dump-ssa] [--loop-align=N]"
+        );
+    }
+
+    CodeGenOptions options;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == kCodeGenOption + "stack") {
+            options.mode = CodeGenMode::Stack;
+        } else if (arg == kCodeGenOption + "accumulator") {
+            options.mode = CodeGenMode::Accumulator;
+        } else if (arg == kCodeGenOption + "regalloc") {
+            options.mode = CodeGenMode::RegAlloc;
+        } else if (arg == kCodeGenOption + "ssa") {
+            options.mode = CodeGenMode::Ssa;
+        } else if (arg == kNoPeepholeOption) {
+            options.peephole = false;
+        } else if (arg == kPeepholeStatsOption) {
+            options.peepholeStats = true;
+        } else if (arg.starts_with(kInlineLimitOption)) {
+            options.inlineLimit = ParseCount(arg.substr(kInlineLimitOption.size()), arg);
+        } else if (arg == kNoFoldOption) {
+            options.fold = false;
+        } else if (arg == kNoLicmOption) {
+            options.licm = false;
+        } else if (arg == kNoCseOption) {
+            options.cse = false;
+        } else if (arg == kNoCmovOption) {
+            options.cmov = false;
+        } else if (arg.starts_with(kUnrollOption)) {
+            options.unrollFactor = ParseCount(arg.substr(kUnrollOption.size()), arg);
+        } else if (arg == kNoTailCallsOption) {
+            options.tailCalls = false;
+        } else if (arg == kNoRelaxOption) {
+            options.relax = false;
+        } else if (arg == kNoDceOption) {
+            options.dce = false;
+        } else if (arg == kDumpSsaOption) {
+            options.dumpSsa = true;
+        } else if (arg.starts_with(kLoopAlignOption)) {
+            options.loopAlign = ParseCount(arg.substr(kLoopAlignOption.size()), arg);
+            if (!std::has_single_bit(options.loopAlign)) {
+                throw BackendExcept::OptionException("loop alignment is not a power of two: " + arg);
+            }
+        } else {
+            throw BackendExcept::OptionException("unknown option: " + arg);
+        }
+    }
+    return options;
+}
+
+} // namespace
 
 int main(int argc, const char** argv) {
     try {
+        CodeGenOptions options = ParseOptions(argc, argv);
         Tree ast;
         ast.Deserialize(argv[1]);
-        CodeGen cg;
+        if (options.inlineLimit > 0) {
+            Inliner(ast, options.inlineLimit).Run(ast.GetRoot());
+        }
+        if (options.unrollFactor > 1) {
+            LoopUnroller(ast, options.unrollFactor).Run(ast.GetRoot());
+        }
+        if (options.fold) {
+            ConstantFolder().Run(ast.GetRoot());
+        }
+        if (options.dce) {
+            DeadCodeEliminator().Run(ast.GetRoot());
+        }
+        // the ssa middle end numbers values itself, across the whole dominator tree
+        if (options.cse && options.mode != CodeGenMode::Ssa) {
+            ValueNumbering(ast).Run(ast.GetRoot());
+        }
+        if (options.licm) {
+            LoopInvariantMotion(ast).Run(ast.GetRoot());
+        }
+        CodeGen cg(options);
         cg.GenerateProgram(ast.GetRoot(), argv[2]);
         return 0;
+    } catch (const BackendExcept::OptionException& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
     } catch (const BackendExcept::FileException& e) {
         std::cerr << e.what() << std::endl;
         return 1;
     } catch (const BackendExcept::CodeGeneratorException& e) {
         std::cerr << e.what() << std::endl;
         return 1;
+    } catch (const MiddleExcept::LoweringException& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
     } catch (const TreeExcept::TreeException& e) {
         std::cerr << e.what() << std::endl;
         return 1; 
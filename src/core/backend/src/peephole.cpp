@@ -0,0 +1,184 @@
+#include "peephole.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+namespace {
+
+using Replacement = std::optional<std::vector<Instruction>>;
+
+// Encodes freshly built instructions; Run gives them their place in the original layout.
+template <typename Emit>
+std::vector<Instruction> Encode(Emit emit) {
+    x86_64 encoder;
+    emit(encoder);
+    return encoder.GetInstructions();
+}
+
+bool IsMove(const Instruction& instr) {
+    return instr.op == Op::MovImm || instr.op == Op::MovReg || instr.op == Op::Load;
+}
+
+bool ReadsRegister(const Instruction& instr, r64 reg) {
+    return (instr.op == Op::MovReg || instr.op == Op::Load) && instr.src == reg;
+}
+
+bool TouchesStack(const Instruction& instr) {
+    return instr.dst == r64::rsp || ReadsRegister(instr, r64::rsp);
+}
+
+// the instruction overwrites reg without looking at its old value
+bool Kills(const Instruction* instr, r64 reg) {
+    if (!instr) {
+        return false;
+    }
+    return (instr->op == Op::Pop || IsMove(*instr)) && instr->dst == reg && !ReadsRegister(*instr, reg);
+}
+
+} // namespace
+
+PeepholeOptimizer::PeepholeOptimizer() {
+    // push r; pop r
+    rules.push_back({"push-pop-same", 2, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if (w[0].op != Op::Push || w[1].op != Op::Pop || w[0].dst != w[1].dst) return std::nullopt;
+        return std::vector<Instruction>{};
+    }});
+
+    // push a; pop b  ->  mov b, a
+    rules.push_back({"push-pop-move", 2, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if (w[0].op != Op::Push || w[1].op != Op::Pop) return std::nullopt;
+        return Encode([&](x86_64& e) { e.mov(w[1].dst, w[0].dst); });
+    }});
+
+    // push imm; pop r  ->  mov r, imm
+    rules.push_back({"push-imm-pop", 2, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if (w[0].op != Op::PushImm || w[1].op != Op::Pop) return std::nullopt;
+        return Encode([&](x86_64& e) { e.mov(w[1].dst, static_cast<int32_t>(w[0].imm)); });
+    }});
+
+    // push a; <move not writing a>; pop b  ->  <move>; mov b, a
+    rules.push_back({"push-over-move", 3, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if (w[0].op != Op::Push || !IsMove(w[1]) || w[2].op != Op::Pop) return std::nullopt;
+        if (w[1].dst == w[0].dst || TouchesStack(w[1])) return std::nullopt;
+        std::vector<Instruction> out {w[1]};
+        if (w[2].dst != w[0].dst) {
+            std::vector<Instruction> copy = Encode([&](x86_64& e) { e.mov(w[2].dst, w[0].dst); });
+            out.insert(out.end(), copy.begin(), copy.end());
+        }
+        return out;
+    }});
+
+    // mov a, x; mov b, a; <a overwritten>  ->  mov b, x
+    rules.push_back({"forward-copy", 2, [](std::span<const Instruction> w, const Instruction* next) -> Replacement {
+        if (!IsMove(w[0]) || w[1].op != Op::MovReg || w[1].src != w[0].dst) return std::nullopt;
+        if (w[1].dst == r64::rsp || !Kills(next, w[0].dst)) return std::nullopt;
+        return Encode([&](x86_64& e) {
+            switch (w[0].op) {
+                case Op::MovImm:    e.mov(w[1].dst, static_cast<int32_t>(w[0].imm));                break;
+                case Op::MovReg:    e.mov(w[1].dst, w[0].src);                                       break;
+                default:            e.mov(w[1].dst, w[0].src, static_cast<int32_t>(w[0].imm));       break;
+            }
+        });
+    }});
+
+    // mov r, r
+    rules.push_back({"self-move", 1, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if (w[0].op != Op::MovReg || w[0].dst != w[0].src) return std::nullopt;
+        return std::vector<Instruction>{};
+    }});
+
+    // sub rsp, 0 / add rsp, 0; the generated code never branches on these flags
+    rules.push_back({"rsp-adjust-zero", 1, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if ((w[0].op != Op::SubImm && w[0].op != Op::AddImm) || w[0].dst != r64::rsp || w[0].imm != 0) return std::nullopt;
+        return std::vector<Instruction>{};
+    }});
+
+    // sub rsp, a; sub rsp, b  ->  sub rsp, a + b
+    rules.push_back({"rsp-adjust-merge", 2, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if (w[0].op != Op::SubImm || w[1].op != Op::SubImm || w[0].dst != r64::rsp || w[1].dst != r64::rsp) return std::nullopt;
+        int64_t total = w[0].imm + w[1].imm;
+        if (total > std::numeric_limits<int32_t>::max()) return std::nullopt;
+        return Encode([&](x86_64& e) { e.sub(r64::rsp, static_cast<int32_t>(total)); });
+    }});
+
+    // jmp to the instruction right after it
+    rules.push_back({"jump-to-next", 1, [](std::span<const Instruction> w, const Instruction* next) -> Replacement {
+        if (w[0].op != Op::Jmp || !next) return std::nullopt;
+        if (w[0].target.value() <= w[0].offset || w[0].target.value() > next->offset) return std::nullopt;
+        return std::vector<Instruction>{};
+    }});
+
+    // cmp r, 0  ->  test r, r (same flags, no immediate)
+    rules.push_back({"compare-zero", 1, [](std::span<const Instruction> w, const Instruction*) -> Replacement {
+        if (w[0].op != Op::CmpImm || w[0].imm != 0) return std::nullopt;
+        return Encode([&](x86_64& e) { e.test(w[0].dst, w[0].dst); });
+    }});
+}
+
+void PeepholeOptimizer::Run(x86_64& code, const std::vector<size_t>& entries) {
+    std::vector<Instruction> list = code.GetInstructions();
+
+    std::unordered_set<size_t> targets(entries.begin(), entries.end());
+    for (const Instruction& instr : list) {
+        if (instr.target.has_value()) {
+            targets.insert(instr.target.value());
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        std::vector<Instruction> out;
+        out.reserve(list.size());
+
+        size_t i = 0;
+        while (i < list.size()) {
+            bool applied = false;
+            for (Rule& rule : rules) {
+                if (i + rule.window > list.size()) {
+                    continue;
+                }
+                std::span<const Instruction> window(list.data() + i, rule.window);
+                bool entered = std::any_of(window.begin() + 1, window.end(), [&](const Instruction& instr) {
+                    return targets.count(instr.offset) != 0;
+                });
+                if (entered) {
+                    continue;
+                }
+
+                const Instruction* next = i + rule.window < list.size() ? &list[i + rule.window] : nullptr;
+                std::optional<std::vector<Instruction>> replacement = rule.rewrite(window, next);
+                if (!replacement.has_value()) {
+                    continue;
+                }
+
+                // new instructions take the place of the first one they replace
+                size_t offset = window.front().offset;
+                for (Instruction& instr : replacement.value()) {
+                    offset = std::max(offset, instr.offset);
+                    instr.offset = offset;
+                    out.push_back(instr);
+                }
+                ++rule.hits;
+                i += rule.window;
+                applied = changed = true;
+                break;
+            }
+
+            if (!applied) {
+                out.push_back(list[i++]);
+            }
+        }
+
+        list = std::move(out);
+    }
+
+    code.Assemble(list);
+}
+
+void PeepholeOptimizer::PrintStats(std::ostream& out) const {
+    for (const Rule& rule : rules) {
+        out << rule.name << ": " << rule.hits << '\n';
+    }
+}
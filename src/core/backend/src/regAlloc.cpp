@@ -0,0 +1,303 @@
+#include "regAlloc.h"
+
+#include <algorithm>
+#include <optional>
+
+namespace {
+
+// Survive calls: every generated function saves the ones it uses.
+const r64 kCalleeSavedRegs[] {
+    r64::rbx,
+    r64::r12,
+    r64::r13,
+    r64::r14,
+    r64::r15,
+};
+
+// Clobbered by calls (syscall destroys r11), but neither carries arguments nor is
+// touched by division, so a variable that is not live across a call can sit here.
+const r64 kCallerSavedRegs[] {
+    r64::r10,
+    r64::r11,
+};
+
+// rax and rdx are left out: division and call results need them.
+const r64 kScratchRegs[] {
+    r64::rcx,
+    r64::rsi,
+    r64::rdi,
+    r64::r8,
+    r64::r9,
+    r64::r10,
+    r64::r11,
+};
+
+} // namespace
+
+RegisterAssignment RegisterAllocator::Allocate(const Node* def) {
+    intervals.clear();
+    scopes.clear();
+    loops.clear();
+    calls.clear();
+    position = 0;
+
+    scopes.emplace_back();
+    for (const Node* arg = def->GetLeft(); arg; arg = arg->GetLeft()) {
+        Declare(arg, position++);
+    }
+    VisitStmt(def->GetRight());
+    scopes.pop_back();
+
+    ExtendOverLoops();
+    MarkCallCrossings();
+    return LinearScan();
+}
+
+RegisterAssignment RegisterAllocator::FrameOnly() {
+    RegisterAssignment result;
+    result.scratch.assign(std::begin(kScratchRegs), std::end(kScratchRegs));
+    return result;
+}
+
+void RegisterAllocator::Declare(const Node* decl, int pos) {
+    scopes.back()[decl->GetValue()] = intervals.size();
+    intervals.push_back({decl, pos, pos, {pos}});
+}
+
+void RegisterAllocator::Touch(const std::string& name) {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        if (auto iter = scope->find(name); iter != scope->end()) {
+            Interval& interval = intervals[iter->second];
+            interval.uses.push_back(position);
+            interval.end = position;
+            break;
+        }
+    }
+    // unresolved names are reported by the generator
+    ++position;
+}
+
+void RegisterAllocator::MarkCall() {
+    calls.push_back(position++);
+}
+
+void RegisterAllocator::VisitStmt(const Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            VisitStmt(node->GetLeft());
+            VisitStmt(node->GetRight());
+            break;
+        }
+        case Equal: {
+            std::string name = node->GetLeft()->GetValue();
+            bool declared = std::any_of(scopes.begin(), scopes.end(), [&](const auto& scope) {
+                return scope.count(name) != 0;
+            });
+            if (declared) {
+                VisitExpr(node->GetRight());
+                Touch(name);
+            } else {
+                // a new variable is live while its right side is evaluated, so it never
+                // shares a register with anything that right side reads
+                int pos = position++;
+                VisitExpr(node->GetRight());
+                Declare(node->GetLeft(), pos);
+            }
+            break;
+        }
+        case PrintAscii:
+        case PrintInt: {
+            VisitExpr(node->GetLeft());
+            MarkCall();
+            break;
+        }
+        case PrintStr: {
+            MarkCall();
+            break;
+        }
+        case If: {
+            VisitExpr(node->GetLeft());
+            scopes.emplace_back();
+            VisitStmt(node->GetRight());
+            scopes.pop_back();
+            break;
+        }
+        case While: {
+            int start = position;
+            VisitExpr(node->GetLeft());
+            scopes.emplace_back();
+            VisitStmt(node->GetRight());
+            scopes.pop_back();
+            // the rotated loop tests the condition again after the body
+            VisitExpr(node->GetLeft());
+            loops.emplace_back(start, position++);
+            break;
+        }
+        case Return: {
+            VisitExpr(node->GetLeft());
+            break;
+        }
+        case Call: {
+            VisitExpr(node);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void RegisterAllocator::VisitExpr(const Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Number: {
+            break;
+        }
+        case Identifier: {
+            Touch(node->GetValue());
+            break;
+        }
+        case Call: {
+            // arguments are chained through the left links
+            for (const Node* arg = node->GetLeft(); arg; arg = arg->GetLeft()) {
+                if (arg->GetType() == Identifier) {
+                    Touch(arg->GetValue());
+                } else {
+                    VisitExpr(arg);
+                }
+            }
+            MarkCall();
+            break;
+        }
+        case ReadInt:
+        case MapFile:
+        case ClockNs:
+        case Cycles: {
+            MarkCall();
+            break;
+        }
+        case MapReadInt:
+        case MapEof: {
+            VisitExpr(node->GetLeft());
+            MarkCall();
+            break;
+        }
+        default: {
+            VisitExpr(node->GetLeft());
+            VisitExpr(node->GetRight());
+            break;
+        }
+    }
+}
+
+void RegisterAllocator::ExtendOverLoops() {
+    // the next iteration reads whatever an outer variable holds at the back edge
+    for (const auto& [loopStart, loopEnd] : loops) {
+        for (Interval& interval : intervals) {
+            if (interval.start >= loopStart) {
+                continue;
+            }
+            bool usedInLoop = std::any_of(interval.uses.begin(), interval.uses.end(), [&](int use) {
+                return use >= loopStart && use <= loopEnd;
+            });
+            if (usedInLoop) {
+                interval.end = std::max(interval.end, loopEnd);
+            }
+        }
+    }
+}
+
+void RegisterAllocator::MarkCallCrossings() {
+    for (Interval& interval : intervals) {
+        interval.crossesCall = std::any_of(calls.begin(), calls.end(), [&](int call) {
+            return call > interval.start && call < interval.end;
+        });
+    }
+}
+
+RegisterAssignment RegisterAllocator::LinearScan() {
+    std::vector<size_t> order(intervals.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return intervals[lhs].start < intervals[rhs].start;
+    });
+
+    std::unordered_map<size_t, r64> assigned;
+    std::vector<size_t> active;
+    std::vector<r64> used;
+
+    for (size_t current : order) {
+        const Interval& interval = intervals[current];
+
+        std::erase_if(active, [&](size_t other) {
+            return intervals[other].end < interval.start;
+        });
+
+        std::vector<r64> candidates;
+        if (!interval.crossesCall) {
+            candidates.insert(candidates.end(), std::begin(kCallerSavedRegs), std::end(kCallerSavedRegs));
+        }
+        candidates.insert(candidates.end(), std::begin(kCalleeSavedRegs), std::end(kCalleeSavedRegs));
+
+        std::optional<r64> free;
+        for (r64 reg : candidates) {
+            bool taken = std::any_of(active.begin(), active.end(), [&](size_t other) {
+                return assigned.at(other) == reg;
+            });
+            if (!taken) {
+                free = reg;
+                break;
+            }
+        }
+
+        if (free.has_value()) {
+            assigned[current] = free.value();
+            active.push_back(current);
+            used.push_back(free.value());
+            continue;
+        }
+
+        // spill whichever compatible interval reaches furthest
+        auto victim = active.end();
+        for (auto iter = active.begin(); iter != active.end(); ++iter) {
+            r64 reg = assigned.at(*iter);
+            if (std::find(candidates.begin(), candidates.end(), reg) == candidates.end()) {
+                continue;
+            }
+            if (victim == active.end() || intervals[*iter].end > intervals[*victim].end) {
+                victim = iter;
+            }
+        }
+        if (victim != active.end() && intervals[*victim].end > interval.end) {
+            assigned[current] = assigned.at(*victim);
+            assigned.erase(*victim);
+            active.erase(victim);
+            active.push_back(current);
+        }
+    }
+
+    RegisterAssignment result;
+    for (const auto& [index, reg] : assigned) {
+        result.registers[intervals[index].decl] = reg;
+    }
+    for (r64 reg : kCalleeSavedRegs) {
+        if (std::find(used.begin(), used.end(), reg) != used.end()) {
+            result.calleeSaved.push_back(reg);
+        }
+    }
+    for (r64 reg : kScratchRegs) {
+        if (std::find(used.begin(), used.end(), reg) == used.end()) {
+            result.scratch.push_back(reg);
+        }
+    }
+    return result;
+}
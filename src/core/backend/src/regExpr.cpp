@@ -0,0 +1,272 @@
+#include "generator.h"
+
+#include <algorithm>
+
+#include "asmCommands.h"
+#include "backendExceptions.h"
+#include "node.hpp"
+
+namespace {
+
+r8 LowByte(r64 reg) {
+    return static_cast<r8>(static_cast<int>(reg));
+}
+
+bool IsBinaryOperator(NodeType type) {
+    switch (type) {
+        case Add:
+        case Sub:
+        case Mul:
+        case Div:
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+bool ReadsVariable(const Node* node, const std::string& name) {
+    if (!node) {
+        return false;
+    }
+    if (node->GetType() == Identifier && node->GetValue() == name) {
+        return true;
+    }
+    return ReadsVariable(node->GetLeft(), name) || ReadsVariable(node->GetRight(), name);
+}
+
+// A literal left operand of a commutative Add or Mul is taken as an immediate (or a strength
+// reduced multiplier), with the right operand computed straight into the destination.
+bool ComputesRightInPlace(const Node* node) {
+    return (node->GetType() == Add || node->GetType() == Mul) && node->GetLeft()->GetType() == Number;
+}
+
+} // namespace
+
+void CodeGen::CodeGenExprTo(Node* node, r64 dst) {
+    if (options.mode == CodeGenMode::Stack) {
+        CodeGenExpr(node);
+        asmGen.pop(dst);
+        return;
+    }
+
+    // dst holds the partly built result from here on, so no operand may borrow it as scratch
+    auto freeIter = std::find(freeScratch.begin(), freeScratch.end(), dst);
+    std::optional<size_t> freeIndex;
+    if (freeIter != freeScratch.end()) {
+        freeIndex = freeIter - freeScratch.begin();
+        freeScratch.erase(freeIter);
+    }
+
+    switch (node->GetType()) {
+        case Number: {
+            int64_t value = std::stoll(node->GetValue());
+            if (FitsImm32(value)) {
+                asmGen.mov(dst, static_cast<int32_t>(value));
+            } else {
+                asmGen.movabs(dst, value);
+            }
+            break;
+        }
+        case Identifier: {
+            LoadVariable(FindVariable(node), dst);
+            break;
+        }
+        default: {
+            if (IsBinaryOperator(node->GetType())) {
+                EmitRegBinary(node, dst);
+                break;
+            }
+            // calls and runtime builtins leave their result on the stack
+            CodeGenExpr(node);
+            asmGen.pop(dst);
+            break;
+        }
+    }
+
+    if (freeIndex.has_value()) {
+        freeScratch.insert(freeScratch.begin() + freeIndex.value(), dst);
+    }
+}
+
+// Sethi-Ullman number: registers needed to evaluate the subtree without spilling.
+int CodeGen::RegisterNeed(const Node* node) {
+    if (!IsBinaryOperator(node->GetType())) {
+        return 1;
+    }
+    int left = RegisterNeed(node->GetLeft());
+    int right = RegisterNeed(node->GetRight());
+    return left == right ? left + 1 : std::max(left, right);
+}
+
+// The hungrier operand goes first so its registers are free again while the other one is held.
+bool CodeGen::EvaluatesRightFirst(const Node* node) {
+    return RegisterNeed(node->GetRight()) > RegisterNeed(node->GetLeft());
+}
+
+// Computing an expression into a variable's register writes that register once the left
+// operand's evaluation starts, so nothing evaluated after that point may read the variable.
+bool CodeGen::OverwritesBeforeRead(const Node* node, const std::string& name) {
+    if (!IsBinaryOperator(node->GetType())) {
+        return false;
+    }
+    if (ComputesRightInPlace(node) && OverwritesBeforeRead(node->GetRight(), name)) {
+        return true;
+    }
+    if (EvaluatesRightFirst(node)) {
+        return OverwritesBeforeRead(node->GetLeft(), name);
+    }
+    return OverwritesBeforeRead(node->GetLeft(), name) || ReadsVariable(node->GetRight(), name);
+}
+
+// Leaves the left operand in dst and the right one in the returned scratch register.
+CodeGen::ScratchReg CodeGen::EmitRegOperands(Node* node, r64 dst) {
+    ScratchReg rhs {};
+    if (EvaluatesRightFirst(node)) {
+        rhs = AcquireScratch(dst);
+        CodeGenExprTo(node->GetRight(), rhs.reg);
+
+        liveResults.push_back(rhs.reg);
+        CodeGenExprTo(node->GetLeft(), dst);
+        liveResults.pop_back();
+    } else {
+        CodeGenExprTo(node->GetLeft(), dst);
+
+        liveResults.push_back(dst);
+        rhs = AcquireScratch(dst);
+        CodeGenExprTo(node->GetRight(), rhs.reg);
+        liveResults.pop_back();
+    }
+    return rhs;
+}
+
+void CodeGen::EmitRegBinary(Node* node, r64 dst) {
+    if (EmitRegByConstant(node, dst) || EmitRegImmediate(node, dst)) {
+        return;
+    }
+
+    ScratchReg rhs = EmitRegOperands(node, dst);
+
+    switch (node->GetType()) {
+        case Add:               asmGen.add(dst, rhs.reg);    break;
+        case Sub:               asmGen.sub(dst, rhs.reg);    break;
+        case Mul:               asmGen.imul(dst, rhs.reg);   break;
+        case Div:               EmitRegDiv(dst, rhs.reg);    break;
+        case Greater:           asmGen.cmp(dst, rhs.reg); asmGen.setg(dst);  break;
+        case GreaterOrEqual:    asmGen.cmp(dst, rhs.reg); asmGen.setge(dst); break;
+        case Less:              asmGen.cmp(dst, rhs.reg); asmGen.setl(dst);  break;
+        case LessOrEqual:       asmGen.cmp(dst, rhs.reg); asmGen.setle(dst); break;
+        case Identical:         asmGen.cmp(dst, rhs.reg); asmGen.sete(dst);  break;
+        case NotIdentical:      asmGen.cmp(dst, rhs.reg); asmGen.setne(dst); break;
+
+        default: {
+            throw BackendExcept::CodeGeneratorException("Unknown node type: " + node->GetValue());
+        }
+    }
+
+    switch (node->GetType()) {
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            asmGen.movzx(dst, LowByte(dst));
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+
+    ReleaseScratch(rhs);
+}
+
+// Sets the flags for `left cmp right`, reading register variables in place and taking
+// an imm32 right operand directly instead of materializing either side.
+void CodeGen::EmitRegCompare(Node* node) {
+    Node* left = node->GetLeft();
+    Node* right = node->GetRight();
+    std::optional<r64> leftReg = VariableRegister(left);
+    std::optional<r64> rightReg = VariableRegister(right);
+
+    if (right->GetType() == Number && FitsImm32(std::stoll(right->GetValue()))) {
+        if (!leftReg.has_value()) {
+            CodeGenExprTo(left, r64::rax);
+        }
+        asmGen.cmp(leftReg.value_or(r64::rax), std::stoi(right->GetValue()));
+        return;
+    }
+
+    if (rightReg.has_value()) {
+        if (!leftReg.has_value()) {
+            CodeGenExprTo(left, r64::rax);
+        }
+        asmGen.cmp(leftReg.value_or(r64::rax), rightReg.value());
+        return;
+    }
+
+    if (leftReg.has_value()) {
+        CodeGenExprTo(right, r64::rax);
+        asmGen.cmp(leftReg.value(), r64::rax);
+        return;
+    }
+
+    ScratchReg rhs = EmitRegOperands(node, r64::rax);
+    asmGen.cmp(r64::rax, rhs.reg);
+    ReleaseScratch(rhs);
+}
+
+void CodeGen::EmitRegDiv(r64 dst, r64 divisor) {
+    // idiv works on rdx:rax; keep whatever an enclosing expression parked there
+    bool saveRax = dst != r64::rax && std::find(liveResults.begin(), liveResults.end(), r64::rax) != liveResults.end();
+    bool saveRdx = dst != r64::rdx && std::find(liveResults.begin(), liveResults.end(), r64::rdx) != liveResults.end();
+
+    if (saveRax) asmGen.push(r64::rax);
+    if (saveRdx) asmGen.push(r64::rdx);
+
+    if (dst != r64::rax) {
+        asmGen.mov(r64::rax, dst);
+    }
+    asmGen.cqo();
+    asmGen.idiv(divisor);
+    if (dst != r64::rax) {
+        asmGen.mov(dst, r64::rax);
+    }
+
+    if (saveRdx) asmGen.pop(r64::rdx);
+    if (saveRax) asmGen.pop(r64::rax);
+}
+
+CodeGen::ScratchReg CodeGen::AcquireScratch(r64 dst) {
+    if (!freeScratch.empty()) {
+        r64 reg = freeScratch.back();
+        freeScratch.pop_back();
+        return {reg, false};
+    }
+
+    // out of registers: borrow one that is busy and restore it afterwards
+    for (r64 reg : assignment.scratch) {
+        if (reg != dst) {
+            asmGen.push(reg);
+            return {reg, true};
+        }
+    }
+
+    throw BackendExcept::CodeGeneratorException("No scratch register available in: " + currentFunction);
+}
+
+void CodeGen::ReleaseScratch(const ScratchReg& scratch) {
+    if (scratch.spilled) {
+        asmGen.pop(scratch.reg);
+    } else {
+        freeScratch.push_back(scratch.reg);
+    }
+}
@@ -0,0 +1,632 @@
+#include "generator.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "asmCommands.h"
+#include "backendExceptions.h"
+#include "callingConvention.h"
+#include "cfg.hpp"
+#include "ifConversion.hpp"
+#include "optimizer.hpp"
+#include "ssaBuilder.hpp"
+
+namespace {
+
+const std::string kEntryFunctionName = "main";
+// bytes below rsp the System V ABI keeps safe from signal handlers
+constexpr int32_t kRedZoneSize = 128;
+
+r8 LowByte(r64 reg) {
+    return static_cast<r8>(static_cast<int>(reg));
+}
+
+// the comparison that holds with the operands swapped
+ssa::Opcode Mirror(ssa::Opcode op) {
+    switch (op) {
+        case ssa::Opcode::Less:             return ssa::Opcode::Greater;
+        case ssa::Opcode::LessOrEqual:      return ssa::Opcode::GreaterOrEqual;
+        case ssa::Opcode::Greater:          return ssa::Opcode::Less;
+        case ssa::Opcode::GreaterOrEqual:   return ssa::Opcode::LessOrEqual;
+        default:                            return op;
+    }
+}
+
+// the comparison that holds exactly when this one does not
+ssa::Opcode Negate(ssa::Opcode op) {
+    switch (op) {
+        case ssa::Opcode::Less:             return ssa::Opcode::GreaterOrEqual;
+        case ssa::Opcode::LessOrEqual:      return ssa::Opcode::Greater;
+        case ssa::Opcode::Greater:          return ssa::Opcode::LessOrEqual;
+        case ssa::Opcode::GreaterOrEqual:   return ssa::Opcode::Less;
+        case ssa::Opcode::Identical:        return ssa::Opcode::NotIdentical;
+        default:                            return ssa::Opcode::Identical;
+    }
+}
+
+bool SameStorage(const SsaLocation& lhs, const SsaLocation& rhs) {
+    if (lhs.kind != rhs.kind) {
+        return false;
+    }
+    switch (lhs.kind) {
+        case SsaLocation::Kind::Register:   return lhs.reg == rhs.reg;
+        case SsaLocation::Kind::Stack:      return lhs.offset == rhs.offset;
+        default:                            return false;
+    }
+}
+
+} // namespace
+
+// Lowers the Def through the middle end: SSA construction, the optimizer, then one label per
+// block in layout order. Every value stays where the allocator put it, so an instruction is
+// emitted on its own without looking at its neighbours, except for a comparison fused into the
+// branch after it and a call returned right away.
+void CodeGen::EmitSsaDef(Node* node) {
+    funcs.AddFunction(node->GetValue(), asmGen.GetCodeSize());
+    currentFunction = node->GetValue();
+
+    ssa::Function func = ssa::SsaBuilder().Build(node);
+    ssa::Optimizer().Run(func);
+    if (options.cmov) {
+        ssa::IfConverter().Run(func);
+    }
+    ssa::SplitCriticalEdges(func);
+    if (options.dumpSsa) {
+        func.Print(std::cerr);
+    }
+
+    ssaFunc = &func;
+    ssaAssignment = SsaRegisterAllocator().Allocate(func);
+    // main never returns, so there is nobody to preserve registers for
+    savedRegs = currentFunction == kEntryFunctionName ? std::vector<r64>{} : ssaAssignment.calleeSaved;
+
+    // Nothing in the body pushes, so a function that calls nothing can keep its spill slots
+    // in the red zone below rsp. The flush call EmitExit adds to main comes after every read.
+    bool leaf = std::none_of(func.values.begin(), func.values.end(), [](const ssa::Inst& inst) {
+        return inst.op >= ssa::Opcode::Call && !ssa::IsTerminator(inst.op);
+    });
+    bool redZone = leaf && ssaAssignment.frameSize <= kRedZoneSize;
+    ssaFrameBase = redZone ? r64::rsp : r64::rbp;
+    EmitPrologue(redZone ? 0 : ssaAssignment.frameSize);
+
+    std::vector<std::pair<SsaLocation, SsaLocation>> params;
+    for (ssa::ValueId id : func.blocks[ssa::kEntryBlock].insts) {
+        const ssa::Inst& inst = func.values[id];
+        if (inst.op == ssa::Opcode::Param) {
+            params.push_back({ssaAssignment.locations[id], {.kind = SsaLocation::Kind::Register, .reg = kArgRegs[inst.imm]}});
+        }
+    }
+    EmitParallelMove(params);
+
+    blockLabels.clear();
+    for (size_t b = 0; b < func.blocks.size(); ++b) {
+        blockLabels.push_back(asmGen.NewLabel());
+    }
+
+    for (ssa::BlockId b = 0; b < func.blocks.size(); ++b) {
+        // every branch into a forwarder goes straight on to its target
+        if (IsSsaForwarder(b)) {
+            continue;
+        }
+        bool loopHeader = std::any_of(func.blocks[b].preds.begin(), func.blocks[b].preds.end(), [&](ssa::BlockId pred) {
+            return pred >= b;
+        });
+        if (loopHeader && options.loopAlign > 1) {
+            asmGen.Align(options.loopAlign);
+        }
+        asmGen.Bind(blockLabels[b]);
+        for (ssa::ValueId id : func.blocks[b].insts) {
+            if (!ssa::IsTerminator(func.values[id].op) && !IsSsaTailCall(id)) {
+                EmitSsaInst(id);
+            }
+        }
+        EmitSsaTerminator(b);
+    }
+
+    ssaFunc = nullptr;
+}
+
+const SsaLocation& CodeGen::SsaLocationOf(ssa::ValueId value) const {
+    return ssaAssignment.locations[value];
+}
+
+std::optional<r64> CodeGen::SsaRegister(ssa::ValueId value) const {
+    const SsaLocation& location = SsaLocationOf(value);
+    return location.kind == SsaLocation::Kind::Register ? std::make_optional(location.reg) : std::nullopt;
+}
+
+std::optional<int32_t> CodeGen::SsaImmediate(ssa::ValueId value) const {
+    const SsaLocation& location = SsaLocationOf(value);
+    if (location.kind != SsaLocation::Kind::Constant || !FitsImm32(location.value)) {
+        return std::nullopt;
+    }
+    return static_cast<int32_t>(location.value);
+}
+
+void CodeGen::LoadSsaValue(ssa::ValueId value, r64 dst) {
+    EmitSsaMove({.kind = SsaLocation::Kind::Register, .reg = dst}, SsaLocationOf(value));
+}
+
+void CodeGen::StoreSsaValue(ssa::ValueId value, r64 src) {
+    const SsaLocation& location = SsaLocationOf(value);
+    if (location.kind != SsaLocation::Kind::None) {
+        EmitSsaMove(location, {.kind = SsaLocation::Kind::Register, .reg = src});
+    }
+}
+
+// the value's register, or the value loaded into scratch
+r64 CodeGen::SsaOperand(ssa::ValueId value, r64 scratch) {
+    std::optional<r64> reg = SsaRegister(value);
+    if (reg.has_value()) {
+        return reg.value();
+    }
+    LoadSsaValue(value, scratch);
+    return scratch;
+}
+
+// memory to memory goes through rdx, which is never allocated and never a parallel move source
+void CodeGen::EmitSsaMove(const SsaLocation& dst, const SsaLocation& src) {
+    if (SameStorage(dst, src)) {
+        return;
+    }
+
+    r64 reg = dst.kind == SsaLocation::Kind::Register ? dst.reg : r64::rdx;
+    switch (src.kind) {
+        case SsaLocation::Kind::Register: {
+            reg = src.reg;
+            if (dst.kind == SsaLocation::Kind::Register) {
+                asmGen.mov(dst.reg, src.reg);
+                return;
+            }
+            break;
+        }
+        case SsaLocation::Kind::Stack: {
+            asmGen.mov(reg, ssaFrameBase, -src.offset);
+            break;
+        }
+        case SsaLocation::Kind::Constant: {
+            if (FitsImm32(src.value)) {
+                asmGen.mov(reg, static_cast<int32_t>(src.value));
+            } else {
+                asmGen.movabs(reg, src.value);
+            }
+            break;
+        }
+        case SsaLocation::Kind::None: {
+            throw BackendExcept::CodeGeneratorException("Value without a location in: " + currentFunction);
+        }
+    }
+
+    if (dst.kind == SsaLocation::Kind::Stack) {
+        asmGen.mov(ssaFrameBase, -dst.offset, reg);
+    }
+}
+
+// Moves (destination, source) pairs as if all at once. A move goes out once nothing still
+// needs its destination; when only cycles are left, one destination is parked in rax and its
+// readers take it from there.
+void CodeGen::EmitParallelMove(std::vector<std::pair<SsaLocation, SsaLocation>> moves) {
+    std::erase_if(moves, [](const auto& move) {
+        return move.first.kind == SsaLocation::Kind::None || SameStorage(move.first, move.second);
+    });
+
+    while (!moves.empty()) {
+        auto ready = std::find_if(moves.begin(), moves.end(), [&](const auto& move) {
+            return std::none_of(moves.begin(), moves.end(), [&](const auto& other) {
+                return SameStorage(other.second, move.first);
+            });
+        });
+
+        if (ready == moves.end()) {
+            SsaLocation parked = moves.front().first;
+            SsaLocation rax {.kind = SsaLocation::Kind::Register, .reg = r64::rax};
+            EmitSsaMove(rax, parked);
+            for (auto& [dst, src] : moves) {
+                if (SameStorage(src, parked)) {
+                    src = rax;
+                }
+            }
+            continue;
+        }
+
+        EmitSsaMove(ready->first, ready->second);
+        moves.erase(ready);
+    }
+}
+
+void CodeGen::EmitSsaInst(ssa::ValueId value) {
+    const ssa::Inst& inst = ssaFunc->values[value];
+    switch (inst.op) {
+        case ssa::Opcode::Const:
+        case ssa::Opcode::Param:
+        case ssa::Opcode::Phi: {
+            break;
+        }
+        case ssa::Opcode::Div: {
+            EmitSsaDiv(value);
+            break;
+        }
+        case ssa::Opcode::Select: {
+            EmitSsaSelect(value);
+            break;
+        }
+        case ssa::Opcode::Call: {
+            EmitSsaCallArgs(inst);
+            EmitCallTo(inst.name);
+            StoreSsaValue(value, r64::rax);
+            break;
+        }
+        default: {
+            if (ssa::IsComparison(inst.op)) {
+                if (!ssaAssignment.fused[value]) {
+                    r64 target = SsaRegister(value).value_or(r64::rax);
+                    EmitSetcc(EmitSsaCompare(inst), target);
+                    asmGen.movzx(target, LowByte(target));
+                    StoreSsaValue(value, target);
+                }
+            } else if (ssa::IsBinary(inst.op)) {
+                EmitSsaBinary(value);
+            } else {
+                EmitSsaBuiltin(value);
+            }
+            break;
+        }
+    }
+}
+
+// The result is built in its own register when it has one, else in rax. Operands are read in
+// place; constants that fit go in as immediates and everything else through r11.
+void CodeGen::EmitSsaBinary(ssa::ValueId value) {
+    const ssa::Inst& inst = ssaFunc->values[value];
+    ssa::ValueId lhs = inst.args[0];
+    ssa::ValueId rhs = inst.args[1];
+    r64 target = SsaRegister(value).value_or(r64::rax);
+
+    bool lhsConstant = SsaLocationOf(lhs).kind == SsaLocation::Kind::Constant;
+    bool rhsConstant = SsaLocationOf(rhs).kind == SsaLocation::Kind::Constant;
+    if (ssa::IsCommutative(inst.op) && lhsConstant && !rhsConstant) {
+        std::swap(lhs, rhs);
+        std::swap(lhsConstant, rhsConstant);
+    }
+    // loading lhs into the target would destroy rhs
+    if (SsaRegister(rhs) == target && SsaRegister(lhs) != target) {
+        if (ssa::IsCommutative(inst.op)) {
+            std::swap(lhs, rhs);
+        } else {
+            target = r64::rax;
+        }
+    }
+
+    std::optional<int32_t> imm = SsaImmediate(rhs);
+    if (inst.op == ssa::Opcode::Mul && rhsConstant) {
+        if (std::optional<MulPlan> plan = PlanMultiply(SsaLocationOf(rhs).value); plan.has_value()) {
+            LoadSsaValue(lhs, target);
+            EmitMulByConstant(target, plan.value(), r64::r11);
+            StoreSsaValue(value, target);
+            return;
+        }
+        // the three-operand imul reads lhs in place
+        if (imm.has_value()) {
+            asmGen.imul(target, SsaOperand(lhs, target), imm.value());
+            StoreSsaValue(value, target);
+            return;
+        }
+    }
+
+    LoadSsaValue(lhs, target);
+    switch (inst.op) {
+        case ssa::Opcode::Add: {
+            if (imm.has_value()) {
+                EmitAddImmediate(target, imm.value());
+            } else {
+                asmGen.add(target, SsaOperand(rhs, r64::r11));
+            }
+            break;
+        }
+        case ssa::Opcode::Sub: {
+            if (imm.has_value()) {
+                EmitSubImmediate(target, imm.value());
+            } else {
+                asmGen.sub(target, SsaOperand(rhs, r64::r11));
+            }
+            break;
+        }
+        case ssa::Opcode::Mul: {
+            asmGen.imul(target, SsaOperand(rhs, r64::r11));
+            break;
+        }
+        default: {
+            throw BackendExcept::CodeGeneratorException("Unexpected binary instruction in: " + currentFunction);
+        }
+    }
+    StoreSsaValue(value, target);
+}
+
+// idiv works on rdx:rax, neither of which is ever allocated
+void CodeGen::EmitSsaDiv(ssa::ValueId value) {
+    const ssa::Inst& inst = ssaFunc->values[value];
+    const SsaLocation& divisor = SsaLocationOf(inst.args[1]);
+
+    if (divisor.kind == SsaLocation::Kind::Constant && IsReducibleDivisor(divisor.value)) {
+        r64 target = SsaRegister(value).value_or(r64::rax);
+        LoadSsaValue(inst.args[0], target);
+        EmitDivByConstant(target, divisor.value, r64::r11);
+        StoreSsaValue(value, target);
+        return;
+    }
+
+    LoadSsaValue(inst.args[0], r64::rax);
+    asmGen.cqo();
+    asmGen.idiv(SsaOperand(inst.args[1], r64::r11));
+    StoreSsaValue(value, r64::rax);
+}
+
+// Sets the flags for the comparison and returns the condition to test them for, which is
+// mirrored when a constant left operand is swapped to the right as an immediate.
+ssa::Opcode CodeGen::EmitSsaCompare(const ssa::Inst& inst) {
+    ssa::ValueId lhs = inst.args[0];
+    ssa::ValueId rhs = inst.args[1];
+    ssa::Opcode op = inst.op;
+    if (SsaImmediate(lhs).has_value() && !SsaImmediate(rhs).has_value()) {
+        std::swap(lhs, rhs);
+        op = Mirror(op);
+    }
+
+    r64 left = SsaOperand(lhs, r64::rax);
+    if (std::optional<int32_t> imm = SsaImmediate(rhs); imm.has_value()) {
+        asmGen.cmp(left, imm.value());
+    } else {
+        asmGen.cmp(left, SsaOperand(rhs, r64::r11));
+    }
+    return op;
+}
+
+// The flags are set first, since the moves that follow leave them alone. The result is built
+// in its own register, or in rax, starting from whichever choice is not already sitting there.
+void CodeGen::EmitSsaSelect(ssa::ValueId value) {
+    const ssa::Inst& inst = ssaFunc->values[value];
+    ssa::ValueId cond = inst.args[0];
+    ssa::ValueId chosen = inst.args[1];
+    ssa::ValueId other = inst.args[2];
+
+    ssa::Opcode op = ssa::Opcode::NotIdentical;
+    if (ssaAssignment.fused[cond]) {
+        op = EmitSsaCompare(ssaFunc->values[cond]);
+    } else {
+        r64 reg = SsaOperand(cond, r64::rax);
+        asmGen.test(reg, reg);
+    }
+
+    r64 target = SsaRegister(value).value_or(r64::rax);
+    if (SsaRegister(chosen) == target) {
+        std::swap(chosen, other);
+        op = Negate(op);
+    }
+    LoadSsaValue(other, target);
+    EmitCmovcc(op, target, SsaOperand(chosen, r64::r11));
+    StoreSsaValue(value, target);
+}
+
+void CodeGen::EmitSetcc(ssa::Opcode op, r64 reg) {
+    switch (op) {
+        case ssa::Opcode::Less:             asmGen.setl(reg);   break;
+        case ssa::Opcode::LessOrEqual:      asmGen.setle(reg);  break;
+        case ssa::Opcode::Greater:          asmGen.setg(reg);   break;
+        case ssa::Opcode::GreaterOrEqual:   asmGen.setge(reg);  break;
+        case ssa::Opcode::Identical:        asmGen.sete(reg);   break;
+        default:                            asmGen.setne(reg);  break;
+    }
+}
+
+void CodeGen::EmitJcc(ssa::Opcode op, Label target) {
+    switch (op) {
+        case ssa::Opcode::Less:             asmGen.jl(target);  break;
+        case ssa::Opcode::LessOrEqual:      asmGen.jle(target); break;
+        case ssa::Opcode::Greater:          asmGen.jg(target);  break;
+        case ssa::Opcode::GreaterOrEqual:   asmGen.jge(target); break;
+        case ssa::Opcode::Identical:        asmGen.je(target);  break;
+        default:                            asmGen.jne(target); break;
+    }
+}
+
+void CodeGen::EmitCmovcc(ssa::Opcode op, r64 dst, r64 src) {
+    switch (op) {
+        case ssa::Opcode::Less:             asmGen.cmovl(dst, src);     break;
+        case ssa::Opcode::LessOrEqual:      asmGen.cmovle(dst, src);    break;
+        case ssa::Opcode::Greater:          asmGen.cmovg(dst, src);     break;
+        case ssa::Opcode::GreaterOrEqual:   asmGen.cmovge(dst, src);    break;
+        case ssa::Opcode::Identical:        asmGen.cmove(dst, src);     break;
+        default:                            asmGen.cmovne(dst, src);    break;
+    }
+}
+
+void CodeGen::EmitSsaCallArgs(const ssa::Inst& call) {
+    std::vector<std::pair<SsaLocation, SsaLocation>> args;
+    for (size_t i = 0; i < call.args.size(); ++i) {
+        args.push_back({{.kind = SsaLocation::Kind::Register, .reg = kArgRegs[i]}, SsaLocationOf(call.args[i])});
+    }
+    EmitParallelMove(args);
+}
+
+// The runtime routines take their operand in rdi, and literals as rdi = address, rsi = length.
+// Values that outlive the call were kept out of the registers they clobber.
+void CodeGen::EmitSsaBuiltin(ssa::ValueId value) {
+    const ssa::Inst& inst = ssaFunc->values[value];
+    switch (inst.op) {
+        case ssa::Opcode::ReadInt:      EmitCallTo(keyReadInt);         break;
+        case ssa::Opcode::ClockNs:      EmitCallTo(keyClockNs);         break;
+        case ssa::Opcode::Cycles:       EmitCallTo(keyCycles);          break;
+        case ssa::Opcode::MapFile: {
+            asmGen.mov(r64::rdi, static_cast<int32_t>(PathLiteralAddress(inst.name)));
+            EmitCallTo(keyMapFile);
+            break;
+        }
+        case ssa::Opcode::MapReadInt: {
+            LoadSsaValue(inst.args[0], r64::rdi);
+            EmitCallTo(keyMapReadInt);
+            break;
+        }
+        case ssa::Opcode::MapEof: {
+            LoadSsaValue(inst.args[0], r64::rdi);
+            EmitCallTo(keyMapEof);
+            break;
+        }
+        case ssa::Opcode::PrintAscii: {
+            LoadSsaValue(inst.args[0], r64::rdi);
+            EmitCallTo(keyPrintAscii);
+            break;
+        }
+        case ssa::Opcode::PrintInt: {
+            LoadSsaValue(inst.args[0], r64::rdi);
+            EmitCallTo(keyPrintInt);
+            break;
+        }
+        case ssa::Opcode::PrintStr: {
+            asmGen.mov(r64::rdi, static_cast<int32_t>(StringLiteralAddress(inst.name)));
+            asmGen.mov(r64::rsi, static_cast<int32_t>(inst.name.size()));
+            EmitCallTo(keyPrintStr);
+            break;
+        }
+        default: {
+            throw BackendExcept::CodeGeneratorException("Unexpected instruction in: " + currentFunction);
+        }
+    }
+    StoreSsaValue(value, r64::rax);
+}
+
+// a call whose result is returned right away, which outside main can take over the frame
+bool CodeGen::IsSsaTailCall(ssa::ValueId value) const {
+    const ssa::Inst& inst = ssaFunc->values[value];
+    if (!options.tailCalls || inst.op != ssa::Opcode::Call || currentFunction == kEntryFunctionName) {
+        return false;
+    }
+    const std::vector<ssa::ValueId>& insts = ssaFunc->blocks[inst.block].insts;
+    const ssa::Inst& term = ssaFunc->values[insts.back()];
+    return insts.size() >= 2 && insts[insts.size() - 2] == value &&
+           term.op == ssa::Opcode::Return && term.args[0] == value;
+}
+
+// A block split off an edge that ended up with nothing to copy: it only jumps on.
+bool CodeGen::IsSsaForwarder(ssa::BlockId block) const {
+    const ssa::Block& data = ssaFunc->blocks[block];
+    if (block == ssa::kEntryBlock || data.insts.size() != 1 || ssaFunc->values[data.insts[0]].op != ssa::Opcode::Jump) {
+        return false;
+    }
+    ssa::BlockId target = data.succs[0];
+    size_t index = ssaFunc->PredIndex(target, block);
+    for (ssa::ValueId phi : ssaFunc->Phis(target)) {
+        if (!SameStorage(SsaLocationOf(phi), SsaLocationOf(ssaFunc->values[phi].args[index]))) {
+            return false;
+        }
+    }
+    return target != block;
+}
+
+// where control entering the block really goes, past any forwarders
+ssa::BlockId CodeGen::SsaJumpTarget(ssa::BlockId block) const {
+    while (IsSsaForwarder(block)) {
+        block = ssaFunc->blocks[block].succs[0];
+    }
+    return block;
+}
+
+// the block emitted right after this one, which it falls through into
+ssa::BlockId CodeGen::NextSsaBlock(ssa::BlockId block) const {
+    ssa::BlockId next = block + 1;
+    while (next < ssaFunc->blocks.size() && IsSsaForwarder(next)) {
+        ++next;
+    }
+    return next;
+}
+
+void CodeGen::EmitSsaTerminator(ssa::BlockId block) {
+    const std::vector<ssa::ValueId>& insts = ssaFunc->blocks[block].insts;
+    const std::vector<ssa::BlockId>& succs = ssaFunc->blocks[block].succs;
+    const ssa::Inst& term = ssaFunc->values[insts.back()];
+
+    switch (term.op) {
+        case ssa::Opcode::Jump: {
+            ssa::BlockId target = succs[0];
+            size_t index = ssaFunc->PredIndex(target, block);
+            std::vector<std::pair<SsaLocation, SsaLocation>> phis;
+            for (ssa::ValueId phi : ssaFunc->Phis(target)) {
+                phis.push_back({SsaLocationOf(phi), SsaLocationOf(ssaFunc->values[phi].args[index])});
+            }
+            EmitParallelMove(phis);
+            target = SsaJumpTarget(target);
+            if (target != NextSsaBlock(block)) {
+                asmGen.jmp(blockLabels[target]);
+            }
+            break;
+        }
+        case ssa::Opcode::Branch: {
+            // critical edges are split, so phi copies only ever sit on jumps
+            for (ssa::BlockId succ : succs) {
+                if (!ssaFunc->Phis(succ).empty()) {
+                    throw BackendExcept::CodeGeneratorException("Branch into a phi in: " + currentFunction);
+                }
+            }
+
+            ssa::ValueId cond = term.args[0];
+            ssa::Opcode op = ssa::Opcode::NotIdentical;
+            if (ssaAssignment.fused[cond]) {
+                op = EmitSsaCompare(ssaFunc->values[cond]);
+            } else {
+                r64 reg = SsaOperand(cond, r64::rax);
+                asmGen.test(reg, reg);
+            }
+
+            ssa::BlockId taken = SsaJumpTarget(succs[0]);
+            ssa::BlockId other = SsaJumpTarget(succs[1]);
+            ssa::BlockId next = NextSsaBlock(block);
+            if (other == next) {
+                EmitJcc(op, blockLabels[taken]);
+            } else if (taken == next) {
+                EmitJcc(Negate(op), blockLabels[other]);
+            } else {
+                EmitJcc(op, blockLabels[taken]);
+                asmGen.jmp(blockLabels[other]);
+            }
+            break;
+        }
+        case ssa::Opcode::Return: {
+            ssa::ValueId result = term.args[0];
+            if (insts.size() >= 2 && IsSsaTailCall(insts[insts.size() - 2])) {
+                EmitSsaTailCall(ssaFunc->values[result]);
+                break;
+            }
+
+            LoadSsaValue(result, r64::rax);
+            if (currentFunction == kEntryFunctionName) {
+                EmitExit();
+                break;
+            }
+            EmitEpilogue();
+            asmGen.ret();
+            break;
+        }
+        default: {
+            throw BackendExcept::CodeGeneratorException("Block without a terminator in: " + currentFunction);
+        }
+    }
+}
+
+void CodeGen::EmitSsaTailCall(const ssa::Inst& call) {
+    std::optional<size_t> addr = funcs.FindFunction(call.name);
+    if (!addr.has_value()) {
+        throw BackendExcept::CodeGeneratorException("Undefined function: " + call.name);
+    }
+
+    EmitSsaCallArgs(call);
+
+    if (call.name == currentFunction) {
+        if (framePointer) {
+            asmGen.mov(r64::rsp, r64::rbp);
+        }
+        asmGen.jmp(bodyEntry);
+        return;
+    }
+
+    EmitEpilogue();
+    asmGen.jmp((int32_t)(addr.value() - (asmGen.GetCodeSize() + 5)));
+}
@@ -0,0 +1,394 @@
+#include "ssaRegAlloc.h"
+
+#include <algorithm>
+#include <span>
+
+#include "callingConvention.h"
+
+namespace {
+
+// Caller-saved first: a value that does not live across a call costs nothing to keep there.
+// rax, rdx and r11 stay with the emitter.
+const r64 kAllocatableRegs[] {
+    r64::rcx,
+    r64::rsi,
+    r64::rdi,
+    r64::r8,
+    r64::r9,
+    r64::r10,
+    r64::rbx,
+    r64::r12,
+    r64::r13,
+    r64::r14,
+    r64::r15,
+};
+
+const r64 kCalleeSavedRegs[] {
+    r64::rbx,
+    r64::r12,
+    r64::r13,
+    r64::r14,
+    r64::r15,
+};
+
+constexpr int32_t kWordSize = 8;
+
+// what the instruction destroys, empty for anything that is not a call
+std::span<const r64> Clobbers(ssa::Opcode op) {
+    switch (op) {
+        case ssa::Opcode::Call:         return kCallClobbers;
+        case ssa::Opcode::ClockNs:      return kClockNsClobbers;
+        case ssa::Opcode::Cycles:       return kCyclesClobbers;
+        case ssa::Opcode::ReadInt:
+        case ssa::Opcode::MapFile:
+        case ssa::Opcode::MapReadInt:
+        case ssa::Opcode::MapEof:
+        case ssa::Opcode::PrintAscii:
+        case ssa::Opcode::PrintInt:
+        case ssa::Opcode::PrintStr:     return kRuntimeClobbers;
+
+        default: {
+            return {};
+        }
+    }
+}
+
+} // namespace
+
+SsaAssignment SsaRegisterAllocator::Allocate(const ssa::Function& function) {
+    func = &function;
+    assignment = {};
+    assignment.locations.resize(func->values.size());
+    assignment.fused.assign(func->values.size(), false);
+    intervals.clear();
+
+    Number();
+    FindFusedComparisons();
+    BuildIntervals();
+    AddHints();
+    LinearScan();
+    return std::move(assignment);
+}
+
+// Every instruction gets an even position in layout order. A block's phis are defined at its
+// start, one below its first instruction, and its terminator marks its end.
+void SsaRegisterAllocator::Number() {
+    positions.assign(func->values.size(), 0);
+    blockStart.assign(func->blocks.size(), 0);
+    blockEnd.assign(func->blocks.size(), 0);
+
+    int position = 0;
+    for (ssa::BlockId b = 0; b < func->blocks.size(); ++b) {
+        blockStart[b] = position;
+        for (ssa::ValueId id : func->blocks[b].insts) {
+            if (func->values[id].op == ssa::Opcode::Phi) {
+                positions[id] = blockStart[b];
+                continue;
+            }
+            position += 2;
+            positions[id] = position;
+        }
+        blockEnd[b] = position;
+        position += 1;
+    }
+
+    // parameters arrive in registers before the first instruction
+    for (ssa::ValueId id : func->blocks[ssa::kEntryBlock].insts) {
+        if (func->values[id].op == ssa::Opcode::Param) {
+            positions[id] = 0;
+        }
+    }
+}
+
+// A comparison read only by the branch or select right after it becomes cmp + jcc or
+// cmp + cmovcc there. Its operands are read before the select writes its result.
+void SsaRegisterAllocator::FindFusedComparisons() {
+    std::vector<int> useCount(func->values.size(), 0);
+    for (const ssa::Block& block : func->blocks) {
+        for (ssa::ValueId id : block.insts) {
+            for (ssa::ValueId arg : func->values[id].args) {
+                ++useCount[arg];
+            }
+        }
+    }
+
+    for (const ssa::Block& block : func->blocks) {
+        for (size_t i = 1; i < block.insts.size(); ++i) {
+            const ssa::Inst& user = func->values[block.insts[i]];
+            ssa::ValueId cond = block.insts[i - 1];
+            if ((user.op == ssa::Opcode::Branch || user.op == ssa::Opcode::Select) && user.args[0] == cond &&
+                ssa::IsComparison(func->values[cond].op) && useCount[cond] == 1) {
+                assignment.fused[cond] = true;
+            }
+        }
+    }
+}
+
+bool SsaRegisterAllocator::NeedsLocation(ssa::ValueId value) const {
+    ssa::Opcode op = func->values[value].op;
+    return !assignment.fused[value] && !ssa::IsTerminator(op) && op < ssa::Opcode::PrintAscii;
+}
+
+// Liveness by the usual backward dataflow. A phi argument is live out of its predecessor
+// rather than into the phi's block, and every value then spans one interval from its first
+// to its last live position.
+void SsaRegisterAllocator::BuildIntervals() {
+    size_t valueCount = func->values.size();
+    size_t blockCount = func->blocks.size();
+
+    std::vector<std::vector<bool>> defs(blockCount, std::vector<bool>(valueCount, false));
+    std::vector<std::vector<bool>> uses(blockCount, std::vector<bool>(valueCount, false));
+    std::vector<int> first(valueCount, -1);
+    std::vector<int> last(valueCount, -1);
+    auto extend = [&](ssa::ValueId value, int position) {
+        first[value] = first[value] < 0 ? position : std::min(first[value], position);
+        last[value] = std::max(last[value], position);
+    };
+
+    for (ssa::BlockId b = 0; b < blockCount; ++b) {
+        for (ssa::ValueId id : func->blocks[b].insts) {
+            const ssa::Inst& inst = func->values[id];
+            if (inst.op != ssa::Opcode::Phi) {
+                // a fused comparison reads its operands at the branch
+                for (ssa::ValueId arg : inst.args) {
+                    if (!defs[b][arg]) {
+                        uses[b][arg] = true;
+                    }
+                    extend(arg, positions[id]);
+                }
+            }
+            defs[b][id] = true;
+            extend(id, positions[id]);
+        }
+    }
+
+    // The copy into a phi happens at the end of each predecessor. Along a back edge the phi is
+    // not stretched over the loop: everything live there is live into the header as well, so
+    // it already overlaps the phi, and the phi's register is free for the next iteration's value.
+    std::vector<std::vector<bool>> phiUses(blockCount, std::vector<bool>(valueCount, false));
+    for (ssa::BlockId b = 0; b < blockCount; ++b) {
+        const ssa::Block& block = func->blocks[b];
+        for (ssa::ValueId phi : func->Phis(b)) {
+            for (size_t i = 0; i < block.preds.size(); ++i) {
+                ssa::BlockId pred = block.preds[i];
+                phiUses[pred][func->values[phi].args[i]] = true;
+                extend(func->values[phi].args[i], blockEnd[pred]);
+                if (pred < b) {
+                    extend(phi, blockEnd[pred]);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<bool>> liveIn(blockCount, std::vector<bool>(valueCount, false));
+    std::vector<std::vector<bool>> liveOut(blockCount, std::vector<bool>(valueCount, false));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (ssa::BlockId b = static_cast<ssa::BlockId>(blockCount); b-- > 0;) {
+            std::vector<bool> out = phiUses[b];
+            for (ssa::BlockId succ : func->blocks[b].succs) {
+                for (size_t v = 0; v < valueCount; ++v) {
+                    if (liveIn[succ][v] && !defs[succ][v]) {
+                        out[v] = true;
+                    }
+                }
+            }
+            std::vector<bool> in = uses[b];
+            for (size_t v = 0; v < valueCount; ++v) {
+                if (out[v] && !defs[b][v]) {
+                    in[v] = true;
+                }
+            }
+            if (out != liveOut[b] || in != liveIn[b]) {
+                liveOut[b] = std::move(out);
+                liveIn[b] = std::move(in);
+                changed = true;
+            }
+        }
+    }
+
+    for (ssa::BlockId b = 0; b < blockCount; ++b) {
+        for (size_t v = 0; v < valueCount; ++v) {
+            if (liveIn[b][v]) {
+                extend(static_cast<ssa::ValueId>(v), blockStart[b]);
+            }
+            if (liveOut[b][v]) {
+                extend(static_cast<ssa::ValueId>(v), blockEnd[b]);
+            }
+        }
+    }
+
+    std::vector<bool> read(valueCount, false);
+    for (const ssa::Block& block : func->blocks) {
+        for (ssa::ValueId id : block.insts) {
+            for (ssa::ValueId arg : func->values[id].args) {
+                read[arg] = true;
+            }
+        }
+    }
+
+    std::vector<ssa::ValueId> calls;
+    for (const ssa::Block& block : func->blocks) {
+        for (ssa::ValueId id : block.insts) {
+            if (!Clobbers(func->values[id].op).empty()) {
+                calls.push_back(id);
+            }
+        }
+    }
+
+    for (const ssa::Block& block : func->blocks) {
+        for (ssa::ValueId id : block.insts) {
+            const ssa::Inst& inst = func->values[id];
+            if (!NeedsLocation(id) || !read[id]) {
+                continue;
+            }
+            if (inst.op == ssa::Opcode::Const) {
+                assignment.locations[id] = {.kind = SsaLocation::Kind::Constant, .value = inst.imm};
+                continue;
+            }
+
+            Interval interval {id, first[id], last[id], {}, std::nullopt};
+            for (ssa::ValueId call : calls) {
+                int position = positions[call];
+                if (position > interval.start && position < interval.end) {
+                    std::span<const r64> clobbers = Clobbers(func->values[call].op);
+                    interval.forbidden.insert(interval.forbidden.end(), clobbers.begin(), clobbers.end());
+                }
+            }
+            intervals.push_back(interval);
+        }
+    }
+}
+
+// parameters stay where they arrive, and call arguments start where they are passed
+void SsaRegisterAllocator::AddHints() {
+    std::vector<std::optional<r64>> hints(func->values.size());
+    for (const ssa::Block& block : func->blocks) {
+        for (ssa::ValueId id : block.insts) {
+            const ssa::Inst& inst = func->values[id];
+            if (inst.op == ssa::Opcode::Param) {
+                hints[id] = kArgRegs[inst.imm];
+            } else if (inst.op == ssa::Opcode::Call) {
+                for (size_t i = 0; i < inst.args.size(); ++i) {
+                    if (!hints[inst.args[i]].has_value()) {
+                        hints[inst.args[i]] = kArgRegs[i];
+                    }
+                }
+            } else if (inst.op >= ssa::Opcode::MapReadInt && inst.op <= ssa::Opcode::PrintInt && !inst.args.empty()) {
+                if (!hints[inst.args[0]].has_value()) {
+                    hints[inst.args[0]] = r64::rdi;
+                }
+            }
+        }
+    }
+    for (Interval& interval : intervals) {
+        interval.hint = hints[interval.value];
+    }
+}
+
+void SsaRegisterAllocator::LinearScan() {
+    std::stable_sort(intervals.begin(), intervals.end(), [](const Interval& lhs, const Interval& rhs) {
+        return lhs.start < rhs.start;
+    });
+
+    // a phi and its arguments share a register when they can, which turns their copies into nothing
+    std::vector<std::vector<ssa::ValueId>> partners(func->values.size());
+    for (ssa::BlockId b = 0; b < func->blocks.size(); ++b) {
+        for (ssa::ValueId phi : func->Phis(b)) {
+            for (ssa::ValueId arg : func->values[phi].args) {
+                partners[phi].push_back(arg);
+                partners[arg].push_back(phi);
+            }
+        }
+    }
+
+    std::vector<size_t> active;
+    std::vector<int> slotFreeAt;
+    std::vector<r64> used;
+
+    auto spill = [&](const Interval& interval) {
+        size_t slot = 0;
+        while (slot < slotFreeAt.size() && slotFreeAt[slot] >= interval.start) {
+            ++slot;
+        }
+        if (slot == slotFreeAt.size()) {
+            slotFreeAt.push_back(0);
+        }
+        slotFreeAt[slot] = interval.end;
+        assignment.locations[interval.value] = {
+            .kind = SsaLocation::Kind::Stack,
+            .offset = static_cast<int32_t>((slot + 1) * kWordSize),
+        };
+    };
+
+    for (size_t current = 0; current < intervals.size(); ++current) {
+        const Interval& interval = intervals[current];
+
+        std::erase_if(active, [&](size_t other) {
+            return intervals[other].end <= interval.start;
+        });
+
+        std::vector<r64> candidates;
+        for (r64 reg : kAllocatableRegs) {
+            if (std::find(interval.forbidden.begin(), interval.forbidden.end(), reg) == interval.forbidden.end()) {
+                candidates.push_back(reg);
+            }
+        }
+        auto isFree = [&](r64 reg) {
+            if (std::find(candidates.begin(), candidates.end(), reg) == candidates.end()) {
+                return false;
+            }
+            return std::none_of(active.begin(), active.end(), [&](size_t other) {
+                return assignment.locations[intervals[other].value].reg == reg;
+            });
+        };
+
+        std::vector<r64> preferred;
+        for (ssa::ValueId partner : partners[interval.value]) {
+            const SsaLocation& location = assignment.locations[partner];
+            if (location.kind == SsaLocation::Kind::Register) {
+                preferred.push_back(location.reg);
+            }
+        }
+        if (interval.hint.has_value()) {
+            preferred.push_back(interval.hint.value());
+        }
+        preferred.insert(preferred.end(), candidates.begin(), candidates.end());
+
+        auto free = std::find_if(preferred.begin(), preferred.end(), isFree);
+        if (free != preferred.end()) {
+            assignment.locations[interval.value] = {.kind = SsaLocation::Kind::Register, .reg = *free};
+            active.push_back(current);
+            used.push_back(*free);
+            continue;
+        }
+
+        // take the register of whichever compatible interval reaches furthest, or spill this one
+        auto victim = active.end();
+        for (auto iter = active.begin(); iter != active.end(); ++iter) {
+            r64 reg = assignment.locations[intervals[*iter].value].reg;
+            if (std::find(candidates.begin(), candidates.end(), reg) == candidates.end()) {
+                continue;
+            }
+            if (victim == active.end() || intervals[*iter].end > intervals[*victim].end) {
+                victim = iter;
+            }
+        }
+        if (victim != active.end() && intervals[*victim].end > interval.end) {
+            assignment.locations[interval.value] = assignment.locations[intervals[*victim].value];
+            spill(intervals[*victim]);
+            active.erase(victim);
+            active.push_back(current);
+            continue;
+        }
+        spill(interval);
+    }
+
+    for (r64 reg : kCalleeSavedRegs) {
+        if (std::find(used.begin(), used.end(), reg) != used.end()) {
+            assignment.calleeSaved.push_back(reg);
+        }
+    }
+    assignment.frameSize = static_cast<int32_t>(slotFreeAt.size()) * kWordSize;
+}
@@ -1,257 +1,840 @@
 #include "asmCommands.h"
 #include "generator.h"
 
-void CodeGen::CreateStandartFunctions() {
-    CreatePrintAscii();
-    CreatePrintInt();
-    CreateReadInt();
+namespace {
+
+const std::string kOutputBuffer = "__output_buffer";
+const std::string kOutputLength = "__output_length";
+const std::string kDigitPairs = "__digit_pairs";
+const std::string kInputBuffer = "__input_buffer";
+const std::string kStdinReader = "__stdin_reader";
+const std::string kStatBuffer = "__stat_buffer";
+const std::string kFileReaders = "__file_readers";
+const std::string kFileReaderCount = "__file_reader_count";
+
+const std::string kRuntimeWriteStdout = "__write_stdout";
+const std::string kRuntimeFillStdin = "__fill_stdin";
+const std::string kRuntimeInitStdin = "__init_stdin";
+const std::string kRuntimeParseInt = "__parse_int";
+
+constexpr int32_t kOutputBufferSize = 1 << 16;
+// large enough for "-9223372036854775808"
+constexpr int32_t kPrintIntScratchSize = 32;
+
+// floor(x / 100) == mulhi(x >> 2, kDivBy100Magic) >> 2 for every uint64_t x
+constexpr int64_t kDivBy100Magic = 0x28f5c28f5c28f5c3;
+
+constexpr int32_t kInputBufferSize = 1 << 16;
+
+// reader state: a window [ptr, end) over the input and how it can be refilled
+constexpr int32_t kReaderPtr = 0;
+constexpr int32_t kReaderEnd = 8;
+constexpr int32_t kReaderStatus = 16;
+constexpr int32_t kReaderSize = 24;
+
+constexpr int32_t kReaderUninitialized = 0;
+constexpr int32_t kReaderRefillable = 1;
+constexpr int32_t kReaderExhausted = 2;
+
+constexpr int32_t kMaxMappedFiles = 16;
+
+constexpr int32_t kClockMonotonic = 1;
+constexpr int32_t kNanosecondsPerSecond = 1000000000;
+
+// struct stat layout on x86-64 Linux
+constexpr int32_t kStatSize = 144;
+constexpr int32_t kStatModeOffset = 24;
+constexpr int32_t kStatSizeOffset = 48;
+constexpr int32_t kFileTypeMask = 0xf000;
+constexpr int32_t kRegularFileType = 0x8000;
+
+} // namespace
+
+void CodeGen::CreateStandartFunctions(const std::unordered_set<NodeType>& builtins) {
+    auto uses = [&](NodeType type) { return builtins.count(type) != 0; };
+    bool readsStdin = uses(ReadInt);
+    bool readsFiles = uses(MapFile) || uses(MapReadInt) || uses(MapEof);
+    // map_read_int shares the number parser with read_int, and the parser refills through __fill_stdin
+    bool parses = readsStdin || uses(MapReadInt);
+
+    // every program flushes its output on exit
+    data.AddBss(kOutputBuffer, kOutputBufferSize);
+    data.AddBss(kOutputLength, 8);
+    if (uses(PrintInt)) {
+        std::vector<uint8_t> digitPairs;
+        for (int i = 0; i < 100; ++i) {
+            digitPairs.push_back(static_cast<uint8_t>('0' + i / 10));
+            digitPairs.push_back(static_cast<uint8_t>('0' + i % 10));
+        }
+        data.AddRodata(kDigitPairs, digitPairs);
+    }
+    if (parses) {
+        data.AddBss(kInputBuffer, kInputBufferSize);
+    }
+    if (readsStdin) {
+        data.AddBss(kStdinReader, kReaderSize);
+    }
+    if (readsStdin || uses(MapFile)) {
+        data.AddBss(kStatBuffer, kStatSize);
+    }
+    if (readsFiles) {
+        data.AddBss(kFileReaders, kMaxMappedFiles * kReaderSize);
+        data.AddBss(kFileReaderCount, 8);
+    }
+
+    CreateWriteStdout();
+    CreateFlushStdout();
+    if (uses(PrintAscii))   CreatePrintAscii();
+    if (uses(PrintStr))     CreatePrintStr();
+    if (uses(PrintInt))     CreatePrintInt();
+    if (parses)             CreateFillStdin();
+    if (readsStdin)         CreateInitStdin();
+    if (parses)             CreateParseInt();
+    if (readsStdin)         CreateReadInt();
+    if (uses(MapFile))      CreateMapFile();
+    if (uses(MapReadInt))   CreateMapReadInt();
+    if (uses(MapEof))       CreateMapEof();
+    if (uses(ClockNs))      CreateClockNs();
+    if (uses(Cycles))       CreateCycles();
+}
+
+void CodeGen::CreateWriteStdout() {
+    // writes rdx bytes starting at rsi to stdout, retrying short writes
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(kRuntimeWriteStdout, asmGen.GetCodeSize());
+
+    Label loop = asmGen.NewLabel();
+    Label done = asmGen.NewLabel();
+    asmGen.Bind(loop);
+
+    asmGen.cmp(r64::rdx, 0);
+    asmGen.je(done);
+
+    asmGen.mov(r64::rax, 1);
+    asmGen.mov(r64::rdi, 1);
+    asmGen.syscall();
+
+    // on a write error the rest of the data is dropped
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jl(done);
+    asmGen.je(done);
+
+    asmGen.add(r64::rsi, r64::rax);
+    asmGen.sub(r64::rdx, r64::rax);
+    asmGen.jmp(loop);
+
+    asmGen.Bind(done);
+    asmGen.ret();
+}
+
+void CodeGen::CreateFlushStdout() {
+    // writes out the pending part of the output buffer and empties it
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(kRuntimeFlushStdout, asmGen.GetCodeSize());
+
+    asmGen.mov(r64::rsi, GetDataAddress(kOutputBuffer));
+    asmGen.mov(r64::rcx, GetDataAddress(kOutputLength));
+    asmGen.mov(r64::rdx, r64::rcx, 0);
+
+    std::optional<size_t> writeAddr = funcs.FindFunction(kRuntimeWriteStdout);
+    asmGen.call((int32_t)(writeAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    asmGen.mov(r64::rcx, GetDataAddress(kOutputLength));
+    asmGen.mov(r64::rax, 0);
+    asmGen.mov(r64::rcx, 0, r64::rax);
+
+    asmGen.ret();
 }
 
 void CodeGen::CreatePrintAscii() {
+    // appends the low byte of rdi to the output buffer
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
     funcs.AddFunction(keyPrintAscii, asmGen.GetCodeSize());
 
-    asmGen.push(r64::rbp);
-    asmGen.mov(r64::rbp, r64::rsp);
-    asmGen.sub(r64::rsp, 8);
+    Label done = asmGen.NewLabel();
+
+    asmGen.mov(r64::rcx, GetDataAddress(kOutputLength));
+    asmGen.mov(r64::rdx, r64::rcx, 0);
+
+    asmGen.mov(r64::rax, r64::rdi);
+    asmGen.mov(r64::rsi, GetDataAddress(kOutputBuffer));
+    asmGen.add(r64::rsi, r64::rdx);
+    asmGen.mov(r64::rsi, 0, r8::al);
+
+    asmGen.inc(r64::rdx);
+    asmGen.mov(r64::rcx, 0, r64::rdx);
 
+    asmGen.cmp(r64::rdx, kOutputBufferSize);
+    asmGen.jne(done);
+
+    std::optional<size_t> flushAddr = funcs.FindFunction(kRuntimeFlushStdout);
+    asmGen.call((int32_t)(flushAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    asmGen.Bind(done);
+    asmGen.ret();
+}
+
+void CodeGen::CreatePrintStr() {
+    // appends rsi bytes starting at rdi to the output buffer; a string that
+    // does not fit even into an empty buffer is written out directly
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(keyPrintStr, asmGen.GetCodeSize());
+
+    Label append = asmGen.NewLabel();
+
+    asmGen.mov(r64::rcx, GetDataAddress(kOutputLength));
+    asmGen.mov(r64::rax, r64::rcx, 0);
+    asmGen.add(r64::rax, r64::rsi);
+    asmGen.cmp(r64::rax, kOutputBufferSize);
+    asmGen.jl(append);
+
+    std::optional<size_t> flushAddr = funcs.FindFunction(kRuntimeFlushStdout);
     asmGen.push(r64::rdi);
+    asmGen.push(r64::rsi);
+    asmGen.call((int32_t)(flushAddr.value() - (asmGen.GetCodeSize() + 5)));
+    asmGen.pop(r64::rsi);
+    asmGen.pop(r64::rdi);
 
-    asmGen.mov(r64::rax, 1);
-    asmGen.mov(r64::rdi, 1);
-    asmGen.mov(r64::rsi, r64::rsp);
-    asmGen.mov(r64::rdx, 8);
+    asmGen.cmp(r64::rsi, kOutputBufferSize);
+    asmGen.jl(append);
 
-    asmGen.syscall();
+    asmGen.mov(r64::rdx, r64::rsi);
+    asmGen.mov(r64::rsi, r64::rdi);
+    std::optional<size_t> writeAddr = funcs.FindFunction(kRuntimeWriteStdout);
+    asmGen.call((int32_t)(writeAddr.value() - (asmGen.GetCodeSize() + 5)));
+    asmGen.ret();
+
+    // the whole literal is appended with a single rep movsb
+    asmGen.Bind(append);
+    asmGen.mov(r64::rcx, GetDataAddress(kOutputLength));
+    asmGen.mov(r64::rdx, r64::rcx, 0);
+    asmGen.mov(r64::rax, r64::rsi);
+    asmGen.mov(r64::rsi, r64::rdi);
+    asmGen.mov(r64::rdi, GetDataAddress(kOutputBuffer));
+    asmGen.add(r64::rdi, r64::rdx);
+    asmGen.add(r64::rdx, r64::rax);
+    asmGen.mov(r64::rcx, 0, r64::rdx);
+
+    asmGen.mov(r64::rcx, r64::rax);
+    asmGen.rep_movsb();
 
-    asmGen.mov(r64::rsp, r64::rbp);
-    asmGen.pop(r64::rbp);
     asmGen.ret();
 }
 
 void CodeGen::CreatePrintInt() {
+    // formats rdi as a signed decimal into the output buffer
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
     funcs.AddFunction(keyPrintInt, asmGen.GetCodeSize());
 
+    Label hasRoom = asmGen.NewLabel();
+    Label positive = asmGen.NewLabel();
+    Label pairLoop = asmGen.NewLabel();
+    Label writePair = asmGen.NewLabel();
+    Label singleDigit = asmGen.NewLabel();
+    Label digitsDone = asmGen.NewLabel();
+    Label copyOut = asmGen.NewLabel();
+
     asmGen.push(r64::rbx);
 
     asmGen.push(r64::rbp);
     asmGen.mov(r64::rbp, r64::rsp);
+    asmGen.sub(r64::rsp, kPrintIntScratchSize);
+
+    asmGen.mov(r64::rcx, GetDataAddress(kOutputLength));
+    asmGen.mov(r64::rax, r64::rcx, 0);
+    asmGen.cmp(r64::rax, kOutputBufferSize - kPrintIntScratchSize);
+    asmGen.jl(hasRoom);
 
-    asmGen.mov(r64::rcx, 0);
+    std::optional<size_t> flushAddr = funcs.FindFunction(kRuntimeFlushStdout);
+    asmGen.push(r64::rdi);
+    asmGen.call((int32_t)(flushAddr.value() - (asmGen.GetCodeSize() + 5)));
+    asmGen.pop(r64::rdi);
+
+    asmGen.Bind(hasRoom);
     asmGen.mov(r64::rax, r64::rdi);
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jge(positive);
 
-    asmGen.cmp(r64::rax, 0); 
-    int32_t jmpPos_1 = (int32_t)asmGen.GetCodeSize();
-    asmGen.jge(0);
+    asmGen.neg(r64::rax);
 
-    asmGen.neg(r64::rax); 
-                                   
-    asmGen.push(r64::rax);
-    asmGen.push(r64::rcx);
-    asmGen.push(r64::rdx);
-    asmGen.push(r64::rsi);
-    asmGen.push(r64::rdi);
+    asmGen.Bind(positive);
+
+    // the number is built backwards in the scratch area below rbp, two digits
+    // per step; the magnitude is treated as unsigned so INT64_MIN survives neg
+    asmGen.mov(r64::rsi, r64::rbp);
+    asmGen.mov(r64::rbx, 100);
+
+    asmGen.Bind(pairLoop);
+
+    // rax = x / 100 computed as mulhi(x >> 2, kDivBy100Magic) >> 2, rcx = x % 100
+    asmGen.mov(r64::rcx, r64::rax);
+    asmGen.shr(r64::rax, 2);
+    asmGen.movabs(r64::rdx, kDivBy100Magic);
+    asmGen.mul(r64::rdx);
+    asmGen.shr(r64::rdx, 2);
+    asmGen.mov(r64::rax, r64::rdx);
+    asmGen.imul(r64::rdx, r64::rbx);
+    asmGen.sub(r64::rcx, r64::rdx);
+
+    // a lone leading digit is written without the pair table
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jne(writePair);
+
+    asmGen.cmp(r64::rcx, 10);
+    asmGen.jl(singleDigit);
+
+    asmGen.Bind(writePair);
+    asmGen.mov(r64::rdx, GetDataAddress(kDigitPairs));
+    asmGen.add(r64::rdx, r64::rcx);
+    asmGen.add(r64::rdx, r64::rcx);
+    asmGen.movzxw(r64::rdx, r64::rdx, 0);
+    asmGen.sub(r64::rsi, 2);
+    asmGen.mov(r64::rsi, 0, r16::dx);
+
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jne(pairLoop);
+    asmGen.jmp(digitsDone);
+
+    asmGen.Bind(singleDigit);
+    asmGen.add(r64::rcx, '0');
+    asmGen.dec(r64::rsi);
+    asmGen.mov(r64::rsi, 0, r8::cl);
+
+    asmGen.Bind(digitsDone);
+    asmGen.cmp(r64::rdi, 0);
+    asmGen.jge(copyOut);
+
+    asmGen.dec(r64::rsi);
+    asmGen.mov(r64::rdx, '-');
+    asmGen.mov(r64::rsi, 0, r8::dl);
+
+    // copy the whole scratch area with three qword moves; the buffer always
+    // has kPrintIntScratchSize bytes of headroom, so the excess is harmless
+    asmGen.Bind(copyOut);
+    asmGen.mov(r64::rcx, GetDataAddress(kOutputLength));
+    asmGen.mov(r64::rdx, r64::rcx, 0);
+    asmGen.mov(r64::rdi, GetDataAddress(kOutputBuffer));
+    asmGen.add(r64::rdi, r64::rdx);
+
+    for (int32_t offset = 0; offset < 24; offset += 8) {
+        asmGen.mov(r64::rax, r64::rsi, offset);
+        asmGen.mov(r64::rdi, offset, r64::rax);
+    }
+
+    asmGen.add(r64::rdx, r64::rbp);
+    asmGen.sub(r64::rdx, r64::rsi);
+    asmGen.mov(r64::rcx, 0, r64::rdx);
+
+    asmGen.mov(r64::rsp, r64::rbp);
+    asmGen.pop(r64::rbp);
 
-    asmGen.push('-');
+    asmGen.pop(r64::rbx);
+
+    asmGen.ret();
+}
+
+void CodeGen::CreateFillStdin() {
+    // refills the reader in rbx with the next block of stdin
+    // returns: rax = 1 if data is available, 0 at end of input
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(kRuntimeFillStdin, asmGen.GetCodeSize());
+
+    Label exhausted = asmGen.NewLabel();
+    Label noData = asmGen.NewLabel();
+
+    asmGen.mov(r64::rax, r64::rbx, kReaderStatus);
+    asmGen.cmp(r64::rax, kReaderRefillable);
+    asmGen.jne(noData);
 
+    asmGen.mov(r64::rax, 0);
+    asmGen.mov(r64::rdi, 0);
+    asmGen.mov(r64::rsi, GetDataAddress(kInputBuffer));
+    asmGen.mov(r64::rdx, kInputBufferSize);
+    asmGen.syscall();
+
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jl(exhausted);
+    asmGen.je(exhausted);
+
+    asmGen.mov(r64::rsi, GetDataAddress(kInputBuffer));
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rsi);
+    asmGen.add(r64::rsi, r64::rax);
+    asmGen.mov(r64::rbx, kReaderEnd, r64::rsi);
     asmGen.mov(r64::rax, 1);
-    asmGen.mov(r64::rdi, 1);
-    asmGen.mov(r64::rsi, r64::rsp);
-    asmGen.mov(r64::rdx, 8);
+    asmGen.ret();
+
+    // rsi still points at the buffer, and the caller stores it back as the
+    // read position; leave an empty window there so the last block is not reread
+    asmGen.Bind(exhausted);
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rsi);
+    asmGen.mov(r64::rbx, kReaderEnd, r64::rsi);
+    asmGen.mov(r64::rax, kReaderExhausted);
+    asmGen.mov(r64::rbx, kReaderStatus, r64::rax);
+
+    asmGen.Bind(noData);
+    asmGen.mov(r64::rax, 0);
+    asmGen.ret();
+}
 
+void CodeGen::CreateInitStdin() {
+    // sets up the reader in rbx on first use: a regular file on stdin is mapped
+    // whole from its current offset, anything else is read block by block
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(kRuntimeInitStdin, asmGen.GetCodeSize());
+
+    Label mapFailed = asmGen.NewLabel();
+    Label done = asmGen.NewLabel();
+
+    asmGen.push(r64::r8);
+    asmGen.push(r64::r9);
+    asmGen.push(r64::r10);
+
+    asmGen.mov(r64::rax, GetDataAddress(kInputBuffer));
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rax);
+    asmGen.mov(r64::rbx, kReaderEnd, r64::rax);
+    asmGen.mov(r64::rax, kReaderRefillable);
+    asmGen.mov(r64::rbx, kReaderStatus, r64::rax);
+
+    // fstat(0, &stat)
+    asmGen.mov(r64::rax, 5);
+    asmGen.mov(r64::rdi, 0);
+    asmGen.mov(r64::rsi, GetDataAddress(kStatBuffer));
     asmGen.syscall();
 
-    asmGen.add(r64::rsp, 8);
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jne(done);
 
-    asmGen.pop(r64::rdi);
-    asmGen.pop(r64::rsi);
-    asmGen.pop(r64::rdx);
-    asmGen.pop(r64::rcx);
-    asmGen.pop(r64::rax);
+    asmGen.mov(r64::rsi, GetDataAddress(kStatBuffer));
+    asmGen.mov(r64::rax, r64::rsi, kStatModeOffset);
+    asmGen.and_(r64::rax, kFileTypeMask);
+    asmGen.cmp(r64::rax, kRegularFileType);
+    asmGen.jne(done);
 
-    int32_t jmpTarget_1 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_1 = jmpTarget_1 - (jmpPos_1 + 6);
-    asmGen.InsertNumber(jmpOffset_1, jmpPos_1 + 2);
+    // lseek(0, 0, SEEK_CUR)
+    asmGen.mov(r64::rax, 8);
+    asmGen.mov(r64::rdi, 0);
+    asmGen.mov(r64::rsi, 0);
+    asmGen.mov(r64::rdx, 1);
+    asmGen.syscall();
 
-    int32_t jmpTarget_2 = (int32_t)asmGen.GetCodeSize();
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jl(done);
 
-    asmGen.mov(r64::rdx, 0);
-    asmGen.mov(r64::rbx, 10);
-    asmGen.idiv(r64::rbx);
-    asmGen.push(r64::rdx);
-    asmGen.inc(r64::rcx);
+    asmGen.mov(r64::rcx, GetDataAddress(kStatBuffer));
+    asmGen.mov(r64::rsi, r64::rcx, kStatSizeOffset);
+    asmGen.cmp(r64::rax, r64::rsi);
+    asmGen.jge(done);
+
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rax);
+
+    // mmap(NULL, size, PROT_READ, MAP_PRIVATE, 0, 0)
+    asmGen.mov(r64::rax, 9);
+    asmGen.mov(r64::rdi, 0);
+    asmGen.mov(r64::rdx, 1);
+    asmGen.mov(r64::r10, 2);
+    asmGen.mov(r64::r8, 0);
+    asmGen.mov(r64::r9, 0);
+    asmGen.syscall();
 
     asmGen.cmp(r64::rax, 0);
-    int32_t jmpPos_2 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_2 = jmpTarget_2 - (jmpPos_2 + 6);
-    asmGen.jne(jmpOffset_2);
+    asmGen.jl(mapFailed);
 
-    int32_t jmpTarget_4 = (int32_t)asmGen.GetCodeSize();
+    asmGen.mov(r64::rcx, GetDataAddress(kStatBuffer));
+    asmGen.mov(r64::rdx, r64::rcx, kStatSizeOffset);
+    asmGen.add(r64::rdx, r64::rax);
+    asmGen.mov(r64::rbx, kReaderEnd, r64::rdx);
+    asmGen.mov(r64::rdx, r64::rbx, kReaderPtr);
+    asmGen.add(r64::rax, r64::rdx);
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rax);
+    asmGen.mov(r64::rax, kReaderExhausted);
+    asmGen.mov(r64::rbx, kReaderStatus, r64::rax);
+    asmGen.jmp(done);
 
-    asmGen.cmp(r64::rcx, 0);
-    int32_t jmpPos_3 = (int32_t)asmGen.GetCodeSize();
-    asmGen.je(0);
+    asmGen.Bind(mapFailed);
+    asmGen.mov(r64::rax, GetDataAddress(kInputBuffer));
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rax);
 
-    asmGen.pop(r64::rdi);
-    asmGen.add(r64::rdi, '0');
+    asmGen.Bind(done);
+    asmGen.pop(r64::r10);
+    asmGen.pop(r64::r9);
+    asmGen.pop(r64::r8);
 
-    asmGen.push(r64::rax);
-    asmGen.push(r64::rcx);
-    asmGen.push(r64::rdx);
-    asmGen.push(r64::rsi);
+    asmGen.ret();
+}
 
-    asmGen.push(r64::rdi);
+void CodeGen::CreateParseInt() {
+    // parses the next signed decimal from the reader in rbx, refilling it
+    // whenever its window runs out, so numbers may span block boundaries
+    // returns: rax = value, 0 at end of input
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(kRuntimeParseInt, asmGen.GetCodeSize());
 
-    asmGen.mov(r64::rax, 1);
+    std::optional<size_t> fillAddr = funcs.FindFunction(kRuntimeFillStdin);
+
+    Label skipSpace = asmGen.NewLabel();
+    Label haveChar = asmGen.NewLabel();
+    Label separator = asmGen.NewLabel();
+    Label notMinus = asmGen.NewLabel();
+    Label signDone = asmGen.NewLabel();
+    Label digits = asmGen.NewLabel();
+    Label haveDigit = asmGen.NewLabel();
+    Label end = asmGen.NewLabel();
+
+    asmGen.mov(r64::rax, 0);
     asmGen.mov(r64::rdi, 1);
-    asmGen.mov(r64::rsi, r64::rsp);
-    asmGen.mov(r64::rdx, 8);
+    asmGen.mov(r64::rsi, r64::rbx, kReaderPtr);
 
-    asmGen.syscall();
+    // skip leading separators: whitespace or any other byte that cannot start a number
+    asmGen.Bind(skipSpace);
+    asmGen.mov(r64::rcx, r64::rbx, kReaderEnd);
+    asmGen.cmp(r64::rsi, r64::rcx);
+    asmGen.jne(haveChar);
 
+    asmGen.push(r64::rax);
+    asmGen.push(r64::rdi);
+    asmGen.call((int32_t)(fillAddr.value() - (asmGen.GetCodeSize() + 5)));
+    asmGen.cmp(r64::rax, 0);
     asmGen.pop(r64::rdi);
+    asmGen.pop(r64::rax);
+    asmGen.je(end);
 
-    asmGen.pop(r64::rsi);
-    asmGen.pop(r64::rdx);
-    asmGen.pop(r64::rcx);
+    asmGen.mov(r64::rsi, r64::rbx, kReaderPtr);
+    asmGen.jmp(skipSpace);
+
+    asmGen.Bind(haveChar);
+    asmGen.movzx(r64::rdx, r64::rsi, 0);
+
+    // optional sign
+    asmGen.cmp(r64::rdx, '-');
+    asmGen.jne(notMinus);
+
+    asmGen.mov(r64::rdi, -1);
+    asmGen.jmp(signDone);
+
+    asmGen.Bind(notMinus);
+    asmGen.cmp(r64::rdx, '+');
+    asmGen.je(signDone);
+
+    asmGen.cmp(r64::rdx, '0');
+    asmGen.jl(separator);
+    asmGen.cmp(r64::rdx, '9');
+    asmGen.jg(separator);
+    asmGen.jmp(digits);
+
+    asmGen.Bind(signDone);
+    asmGen.inc(r64::rsi);
+
+    // digits
+    asmGen.Bind(digits);
+    asmGen.mov(r64::rcx, r64::rbx, kReaderEnd);
+    asmGen.cmp(r64::rsi, r64::rcx);
+    asmGen.jne(haveDigit);
+
+    asmGen.push(r64::rax);
+    asmGen.push(r64::rdi);
+    asmGen.call((int32_t)(fillAddr.value() - (asmGen.GetCodeSize() + 5)));
+    asmGen.cmp(r64::rax, 0);
+    asmGen.pop(r64::rdi);
     asmGen.pop(r64::rax);
+    asmGen.je(end);
 
-    asmGen.dec(r64::rcx);
+    asmGen.mov(r64::rsi, r64::rbx, kReaderPtr);
+    asmGen.jmp(digits);
 
-    int32_t jmpPos_4 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_4 = jmpTarget_4 - (jmpPos_4 + 5);
-    asmGen.jmp(jmpOffset_4); 
+    asmGen.Bind(haveDigit);
+    asmGen.movzx(r64::rdx, r64::rsi, 0);
+    asmGen.sub(r64::rdx, '0');
 
-    int32_t jmpTarget_3 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_3 = jmpTarget_3 - (jmpPos_3 + 6);
-    asmGen.InsertNumber(jmpOffset_3, jmpPos_3 + 2);
+    asmGen.cmp(r64::rdx, 0);
+    asmGen.jl(end);
 
-    asmGen.mov(r64::rsp, r64::rbp);
-    asmGen.pop(r64::rbp);
+    asmGen.cmp(r64::rdx, 9);
+    asmGen.jg(end);
 
-    asmGen.pop(r64::rbx);
+    asmGen.mov(r64::rcx, 10);
+    asmGen.imul(r64::rax, r64::rcx);
+    asmGen.add(r64::rax, r64::rdx);
+    asmGen.inc(r64::rsi);
+    asmGen.jmp(digits);
+
+    // separator: consume it so the reader always advances, and keep skipping
+    asmGen.Bind(separator);
+    asmGen.inc(r64::rsi);
+    asmGen.jmp(skipSpace);
+
+    // end of number
+    asmGen.Bind(end);
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rsi);
+    asmGen.imul(r64::rax, r64::rdi);
 
     asmGen.ret();
 }
 
 void CodeGen::CreateReadInt() {
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
     funcs.AddFunction(keyReadInt, asmGen.GetCodeSize());
 
+    Label initialized = asmGen.NewLabel();
+
     asmGen.push(r64::rbx);
+    asmGen.mov(r64::rbx, GetDataAddress(kStdinReader));
 
-    asmGen.push(r64::rbp);
-    asmGen.mov(r64::rbp, r64::rsp);
+    asmGen.mov(r64::rax, r64::rbx, kReaderStatus);
+    asmGen.cmp(r64::rax, kReaderUninitialized);
+    asmGen.jne(initialized);
 
-    asmGen.sub(r64::rsp, 32);
+    std::optional<size_t> initAddr = funcs.FindFunction(kRuntimeInitStdin);
+    asmGen.call((int32_t)(initAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    asmGen.Bind(initialized);
+    std::optional<size_t> parseAddr = funcs.FindFunction(kRuntimeParseInt);
+    asmGen.call((int32_t)(parseAddr.value() - (asmGen.GetCodeSize() + 5)));
+
+    asmGen.pop(r64::rbx);
+
+    asmGen.ret();
+}
+
+void CodeGen::CreateMapFile() {
+    // maps the file whose NUL-terminated path is in rdi and gives it the next
+    // free reader slot; the descriptor is closed right away, the mapping stays
+    // returns: rax = reader handle, -1 on failure
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(keyMapFile, asmGen.GetCodeSize());
+
+    Label mapped = asmGen.NewLabel();
+    Label closeAndFail = asmGen.NewLabel();
+    Label fail = asmGen.NewLabel();
+    Label done = asmGen.NewLabel();
+
+    asmGen.push(r64::rbx);
+    asmGen.push(r64::r8);
+    asmGen.push(r64::r9);
+    asmGen.push(r64::r10);
+
+    asmGen.mov(r64::rcx, GetDataAddress(kFileReaderCount));
+    asmGen.mov(r64::rax, r64::rcx, 0);
+    asmGen.cmp(r64::rax, kMaxMappedFiles);
+    asmGen.jge(fail);
+
+    // open(path, O_RDONLY)
+    asmGen.mov(r64::rax, 2);
+    asmGen.mov(r64::rsi, 0);
+    asmGen.mov(r64::rdx, 0);
+    asmGen.syscall();
+
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jl(fail);
+
+    asmGen.mov(r64::r8, r64::rax);
+
+    // fstat(fd, &stat)
+    asmGen.mov(r64::rax, 5);
+    asmGen.mov(r64::rdi, r64::r8);
+    asmGen.mov(r64::rsi, GetDataAddress(kStatBuffer));
+    asmGen.syscall();
+
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jne(closeAndFail);
+
+    // rbx = &readers[count], empty until the mapping succeeds
+    asmGen.mov(r64::rcx, GetDataAddress(kFileReaderCount));
+    asmGen.mov(r64::rbx, r64::rcx, 0);
+    asmGen.mov(r64::rax, kReaderSize);
+    asmGen.imul(r64::rbx, r64::rax);
+    asmGen.mov(r64::rax, GetDataAddress(kFileReaders));
+    asmGen.add(r64::rbx, r64::rax);
 
     asmGen.mov(r64::rax, 0);
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rax);
+    asmGen.mov(r64::rbx, kReaderEnd, r64::rax);
+    asmGen.mov(r64::rax, kReaderExhausted);
+    asmGen.mov(r64::rbx, kReaderStatus, r64::rax);
+
+    // an empty file cannot be mapped but is a valid, empty reader
+    asmGen.mov(r64::rcx, GetDataAddress(kStatBuffer));
+    asmGen.mov(r64::rsi, r64::rcx, kStatSizeOffset);
+    asmGen.cmp(r64::rsi, 0);
+    asmGen.je(mapped);
+
+    // mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+    asmGen.mov(r64::rax, 9);
     asmGen.mov(r64::rdi, 0);
-    asmGen.mov(r64::rsi, r64::rsp);
-    asmGen.mov(r64::rdx, 32);
+    asmGen.mov(r64::rdx, 1);
+    asmGen.mov(r64::r10, 2);
+    asmGen.mov(r64::r9, 0);
+    asmGen.syscall();
+
+    asmGen.cmp(r64::rax, 0);
+    asmGen.jl(closeAndFail);
+
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rax);
+    asmGen.add(r64::rax, r64::rsi);
+    asmGen.mov(r64::rbx, kReaderEnd, r64::rax);
 
+    // close(fd)
+    asmGen.Bind(mapped);
+    asmGen.mov(r64::rax, 3);
+    asmGen.mov(r64::rdi, r64::r8);
     asmGen.syscall();
 
-    asmGen.mov(r64::rcx, r64::rax);
-    asmGen.mov(r64::rax, 0);
-    asmGen.mov(r64::rdi, 1);
-    asmGen.mov(r64::rbx, r64::rsp);
+    asmGen.mov(r64::rcx, GetDataAddress(kFileReaderCount));
+    asmGen.mov(r64::rax, r64::rcx, 0);
+    asmGen.mov(r64::rdx, r64::rax);
+    asmGen.inc(r64::rdx);
+    asmGen.mov(r64::rcx, 0, r64::rdx);
+    asmGen.jmp(done);
 
-    int32_t jmpTarget_1 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpTarget_2 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpTarget_3 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpTarget_4 = (int32_t)asmGen.GetCodeSize();
+    asmGen.Bind(closeAndFail);
+    asmGen.mov(r64::rax, 3);
+    asmGen.mov(r64::rdi, r64::r8);
+    asmGen.syscall();
 
-    asmGen.cmp(r64::rcx, 0);
-    int32_t jmpPos_7 = (int32_t)asmGen.GetCodeSize();
-    asmGen.je(0);
+    asmGen.Bind(fail);
+    asmGen.mov(r64::rax, -1);
 
-    asmGen.mov(r64::rdx, r64::rbx, 0);
-    asmGen.movzx(r64::rdx, r8::dl);
+    asmGen.Bind(done);
+    asmGen.pop(r64::r10);
+    asmGen.pop(r64::r9);
+    asmGen.pop(r64::r8);
+    asmGen.pop(r64::rbx);
 
-    asmGen.inc(r64::rbx);
-    asmGen.dec(r64::rcx);
+    asmGen.ret();
+}
 
-    asmGen.cmp(r64::rdx, ' ');
-    int32_t jmpPos_1 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_1 = jmpTarget_1 - (jmpPos_1 + 6);
-    asmGen.je(jmpOffset_1);
+void CodeGen::CreateMapReadInt() {
+    // parses the next integer from the mapped file with handle rdi
+    // returns: rax = value, 0 at the end of the file or for a bad handle
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(keyMapReadInt, asmGen.GetCodeSize());
 
-    asmGen.cmp(r64::rdx, '\n');
-    int32_t jmpPos_2 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_2 = jmpTarget_2 - (jmpPos_2 + 6);
-    asmGen.je(jmpOffset_2);
+    Label badHandle = asmGen.NewLabel();
 
-    asmGen.cmp(r64::rdx, '-');
-    int32_t jmpPos_5 = (int32_t)asmGen.GetCodeSize();
-    asmGen.jne(0);
+    asmGen.push(r64::rbx);
 
-    asmGen.mov(r64::rdi, -1);
+    asmGen.cmp(r64::rdi, 0);
+    asmGen.jl(badHandle);
 
-    int32_t jmpPos_3 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_3 = jmpTarget_3 - (jmpPos_3 + 5);
-    asmGen.jmp(jmpOffset_3);
+    asmGen.mov(r64::rcx, GetDataAddress(kFileReaderCount));
+    asmGen.mov(r64::rax, r64::rcx, 0);
+    asmGen.cmp(r64::rdi, r64::rax);
+    asmGen.jge(badHandle);
 
-    int32_t jmpTarget_5 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_5 = jmpTarget_5 - (jmpPos_5 + 6);
-    asmGen.InsertNumber(jmpOffset_5, jmpPos_5 + 2);
+    asmGen.mov(r64::rbx, r64::rdi);
+    asmGen.mov(r64::rax, kReaderSize);
+    asmGen.imul(r64::rbx, r64::rax);
+    asmGen.mov(r64::rax, GetDataAddress(kFileReaders));
+    asmGen.add(r64::rbx, r64::rax);
 
-    asmGen.cmp(r64::rdx, '+');
-    int32_t jmpPos_4 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_4 = jmpTarget_4 - (jmpPos_4 + 6);
-    asmGen.je(jmpOffset_4);
+    std::optional<size_t> parseAddr = funcs.FindFunction(kRuntimeParseInt);
+    asmGen.call((int32_t)(parseAddr.value() - (asmGen.GetCodeSize() + 5)));
 
-    asmGen.mov(r64::rsi, 10);
+    asmGen.pop(r64::rbx);
+    asmGen.ret();
 
-    int32_t jmpTarget_6 = (int32_t)asmGen.GetCodeSize();
+    asmGen.Bind(badHandle);
+    asmGen.mov(r64::rax, 0);
+    asmGen.pop(r64::rbx);
+    asmGen.ret();
+}
 
-    asmGen.cmp(r64::rcx, 0);
-    int32_t jmpPos_8 = (int32_t)asmGen.GetCodeSize();
-    asmGen.je(0);
-    
-    asmGen.sub(r64::rdx, '0');
+void CodeGen::CreateMapEof() {
+    // skips separators in the mapped file with handle rdi, the bytes map_read_int would skip
+    // returns: rax = 1 if nothing but separators is left or the handle is bad, 0 otherwise
+    // clobbers: rax, rcx, rdx, rsi, rdi, r11
+    funcs.AddFunction(keyMapEof, asmGen.GetCodeSize());
 
-    asmGen.cmp(r64::rdx, 0);
-    int32_t jmpPos_9 = (int32_t)asmGen.GetCodeSize();
-    asmGen.jl(0);
+    Label loop = asmGen.NewLabel();
+    Label separator = asmGen.NewLabel();
+    Label haveNumber = asmGen.NewLabel();
+    Label atEnd = asmGen.NewLabel();
+    Label empty = asmGen.NewLabel();
 
-    asmGen.cmp(r64::rdx, 9);
-    int32_t jmpPos_10 = (int32_t)asmGen.GetCodeSize();
-    asmGen.jg(0);
+    asmGen.push(r64::rbx);
 
-    asmGen.imul(r64::rax, r64::rsi);
-    asmGen.add(r64::rax, r64::rdx);
+    asmGen.cmp(r64::rdi, 0);
+    asmGen.jl(empty);
 
-    asmGen.mov(r64::rdx, r64::rbx, 0);
-    asmGen.movzx(r64::rdx, r8::dl);
+    asmGen.mov(r64::rcx, GetDataAddress(kFileReaderCount));
+    asmGen.mov(r64::rax, r64::rcx, 0);
+    asmGen.cmp(r64::rdi, r64::rax);
+    asmGen.jge(empty);
 
-    asmGen.inc(r64::rbx);
-    asmGen.dec(r64::rcx);
+    asmGen.mov(r64::rbx, r64::rdi);
+    asmGen.mov(r64::rax, kReaderSize);
+    asmGen.imul(r64::rbx, r64::rax);
+    asmGen.mov(r64::rax, GetDataAddress(kFileReaders));
+    asmGen.add(r64::rbx, r64::rax);
 
-    int32_t jmpPos_6 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_6 = jmpTarget_6 - (jmpPos_6 + 5);
-    asmGen.jmp(jmpOffset_6);
+    asmGen.mov(r64::rsi, r64::rbx, kReaderPtr);
 
-    int32_t jmpTarget_7 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_7 = jmpTarget_7 - (jmpPos_7 + 6);
-    asmGen.InsertNumber(jmpOffset_7, jmpPos_7 + 2);
+    asmGen.Bind(loop);
+    asmGen.mov(r64::rcx, r64::rbx, kReaderEnd);
+    asmGen.cmp(r64::rsi, r64::rcx);
+    asmGen.je(atEnd);
 
-    int32_t jmpTarget_8 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_8 = jmpTarget_8 - (jmpPos_8 + 6);
-    asmGen.InsertNumber(jmpOffset_8, jmpPos_8 + 2);
+    asmGen.movzx(r64::rdx, r64::rsi, 0);
 
-    int32_t jmpTarget_9 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_9 = jmpTarget_9 - (jmpPos_9 + 6);
-    asmGen.InsertNumber(jmpOffset_9, jmpPos_9 + 2);
-    
-    int32_t jmpTarget_10 = (int32_t)asmGen.GetCodeSize();
-    int32_t jmpOffset_10 = jmpTarget_10 - (jmpPos_10 + 6);
-    asmGen.InsertNumber(jmpOffset_10, jmpPos_10 + 2);
+    // a sign or a digit starts the next number
+    asmGen.cmp(r64::rdx, '-');
+    asmGen.je(haveNumber);
+    asmGen.cmp(r64::rdx, '+');
+    asmGen.je(haveNumber);
+    asmGen.cmp(r64::rdx, '0');
+    asmGen.jl(separator);
+    asmGen.cmp(r64::rdx, '9');
+    asmGen.jg(separator);
+
+    asmGen.Bind(haveNumber);
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rsi);
+    asmGen.mov(r64::rax, 0);
+    asmGen.pop(r64::rbx);
+    asmGen.ret();
 
-    asmGen.imul(r64::rax, r64::rdi);
+    asmGen.Bind(separator);
+    asmGen.inc(r64::rsi);
+    asmGen.jmp(loop);
 
-    asmGen.mov(r64::rsp, r64::rbp);
-    asmGen.pop(r64::rbp);
+    asmGen.Bind(atEnd);
+    asmGen.mov(r64::rbx, kReaderPtr, r64::rsi);
 
+    asmGen.Bind(empty);
+    asmGen.mov(r64::rax, 1);
     asmGen.pop(r64::rbx);
+    asmGen.ret();
+}
+
+void CodeGen::CreateClockNs() {
+    // returns: rax = CLOCK_MONOTONIC time in nanoseconds
+    // clobbers: rax, rcx, rsi, rdi, r11
+    funcs.AddFunction(keyClockNs, asmGen.GetCodeSize());
+
+    asmGen.sub(r64::rsp, 16);
+
+    // clock_gettime(CLOCK_MONOTONIC, &ts)
+    asmGen.mov(r64::rax, 228);
+    asmGen.mov(r64::rdi, kClockMonotonic);
+    asmGen.mov(r64::rsi, r64::rsp);
+    asmGen.syscall();
+
+    asmGen.mov(r64::rax, r64::rsp, 0);
+    asmGen.mov(r64::rcx, kNanosecondsPerSecond);
+    asmGen.imul(r64::rax, r64::rcx);
+    asmGen.mov(r64::rcx, r64::rsp, 8);
+    asmGen.add(r64::rax, r64::rcx);
+
+    asmGen.add(r64::rsp, 16);
+    asmGen.ret();
+}
+
+void CodeGen::CreateCycles() {
+    // returns: rax = time stamp counter
+    // clobbers: rax, rdx
+    funcs.AddFunction(keyCycles, asmGen.GetCodeSize());
+
+    asmGen.rdtsc();
+    asmGen.shl(r64::rdx, 32);
+    asmGen.or_(r64::rax, r64::rdx);
 
     asmGen.ret();
 }
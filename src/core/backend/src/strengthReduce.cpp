@@ -0,0 +1,260 @@
+#include "strengthReduce.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "generator.h"
+#include "node.hpp"
+
+namespace {
+
+constexpr size_t kMaxMulSteps = 3;
+
+bool IsNumber(const Node* node) {
+    return node->GetType() == Number;
+}
+
+uint64_t Magnitude(int64_t value) {
+    return value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+}
+
+// the literal operand of a Mul or Div that can be strength reduced, if there is one
+const Node* ReducibleConstant(const Node* node) {
+    const Node* left = node->GetLeft();
+    const Node* right = node->GetRight();
+    switch (node->GetType()) {
+        case Mul: {
+            if (IsNumber(right) && PlanMultiply(std::stoll(right->GetValue())).has_value()) return right;
+            if (IsNumber(left) && PlanMultiply(std::stoll(left->GetValue())).has_value()) return left;
+            return nullptr;
+        }
+        case Div: {
+            return IsNumber(right) && IsReducibleDivisor(std::stoll(right->GetValue())) ? right : nullptr;
+        }
+        default: {
+            return nullptr;
+        }
+    }
+}
+
+} // namespace
+
+std::optional<MulPlan> PlanMultiply(int64_t factor) {
+    if (factor == 0) {
+        return std::nullopt;
+    }
+
+    MulPlan plan;
+    uint64_t magnitude = Magnitude(factor);
+    plan.negate = factor < 0;
+    plan.shift = static_cast<uint8_t>(std::countr_zero(magnitude));
+    uint64_t odd = magnitude >> plan.shift;
+
+    size_t steps = (plan.shift != 0) + plan.negate;
+    if (odd != 1) {
+        // 3, 5 and 9 are one lea each; their pairwise products take two
+        const uint64_t kLeaFactors[] = {3, 5, 9};
+        for (uint64_t first : kLeaFactors) {
+            for (uint64_t second : {uint64_t{1}, uint64_t{3}, uint64_t{5}, uint64_t{9}}) {
+                if (plan.leaScales.empty() && first * second == odd) {
+                    plan.leaScales.push_back(static_cast<uint8_t>(first - 1));
+                    if (second != 1) {
+                        plan.leaScales.push_back(static_cast<uint8_t>(second - 1));
+                    }
+                }
+            }
+        }
+
+        if (!plan.leaScales.empty()) {
+            steps += plan.leaScales.size();
+        } else if (std::has_single_bit(odd + 1)) {
+            plan.addShift = static_cast<uint8_t>(std::countr_zero(odd + 1));
+            plan.addSign = -1;
+            steps += 3;
+        } else if (std::has_single_bit(odd - 1)) {
+            plan.addShift = static_cast<uint8_t>(std::countr_zero(odd - 1));
+            plan.addSign = 1;
+            steps += 3;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (steps > kMaxMulSteps) {
+        return std::nullopt;
+    }
+    return plan;
+}
+
+bool IsReducibleDivisor(int64_t divisor) {
+    return divisor != 0 && divisor != 1 && divisor != -1;
+}
+
+DivMagic SignedDivMagic(int64_t divisor) {
+    // Hacker's Delight, figure 10-1, widened to 64 bits
+    const uint64_t kTwo63 = uint64_t{1} << 63;
+    uint64_t ad = static_cast<uint64_t>(divisor);
+    uint64_t anc = kTwo63 - 1 - kTwo63 % ad;
+    int p = 63;
+    uint64_t q1 = kTwo63 / anc;
+    uint64_t r1 = kTwo63 - q1 * anc;
+    uint64_t q2 = kTwo63 / ad;
+    uint64_t r2 = kTwo63 - q2 * ad;
+    uint64_t delta = 0;
+    do {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    return {static_cast<int64_t>(q2 + 1), static_cast<uint8_t>(p - 64)};
+}
+
+// dst *= factor as planned; tmp is only touched for the shift-and-add form
+void CodeGen::EmitMulByConstant(r64 dst, const MulPlan& plan, r64 tmp) {
+    if (plan.addSign != 0) {
+        asmGen.mov(tmp, dst);
+        asmGen.shl(dst, plan.addShift);
+        if (plan.addSign > 0) {
+            asmGen.add(dst, tmp);
+        } else {
+            asmGen.sub(dst, tmp);
+        }
+    }
+    for (uint8_t scale : plan.leaScales) {
+        asmGen.lea(dst, dst, dst, scale);
+    }
+    if (plan.shift != 0) {
+        asmGen.shl(dst, plan.shift);
+    }
+    if (plan.negate) {
+        asmGen.neg(dst);
+    }
+}
+
+// dst /= divisor rounding toward zero; clobbers tmp, and rax and rdx unless the divisor is a power of two
+void CodeGen::EmitDivByConstant(r64 dst, int64_t divisor, r64 tmp) {
+    uint64_t magnitude = Magnitude(divisor);
+
+    if (std::has_single_bit(magnitude)) {
+        // bias negative dividends by 2^k - 1 so the arithmetic shift truncates instead of flooring
+        uint8_t k = static_cast<uint8_t>(std::countr_zero(magnitude));
+        asmGen.mov(tmp, dst);
+        if (k > 1) {
+            asmGen.sar(tmp, 63);
+        }
+        asmGen.shr(tmp, static_cast<uint8_t>(64 - k));
+        asmGen.add(dst, tmp);
+        asmGen.sar(dst, k);
+    } else {
+        DivMagic magic = SignedDivMagic(static_cast<int64_t>(magnitude));
+        r64 dividend = dst;
+        if (dst == r64::rax || dst == r64::rdx) {
+            asmGen.mov(tmp, dst);
+            dividend = tmp;
+        }
+
+        if (FitsImm32(magic.multiplier)) {
+            asmGen.mov(r64::rax, static_cast<int32_t>(magic.multiplier));
+        } else {
+            asmGen.movabs(r64::rax, magic.multiplier);
+        }
+        asmGen.imul(dividend);
+        // a multiplier past 2^63 was stored negative, add the dividend back
+        if (magic.multiplier < 0) {
+            asmGen.add(r64::rdx, dividend);
+        }
+        if (magic.shift != 0) {
+            asmGen.sar(r64::rdx, magic.shift);
+        }
+        // the quotient so far is floored, negative ones get one added
+        asmGen.mov(r64::rax, r64::rdx);
+        asmGen.shr(r64::rax, 63);
+        asmGen.add(r64::rdx, r64::rax);
+        if (dst != r64::rdx) {
+            asmGen.mov(dst, r64::rdx);
+        }
+    }
+
+    if (divisor < 0) {
+        asmGen.neg(dst);
+    }
+}
+
+// Stack mode: the operand goes through rax, with rbx and rdx free around it.
+bool CodeGen::EmitStackByConstant(Node* node) {
+    const Node* constant = ReducibleConstant(node);
+    if (!constant) {
+        return false;
+    }
+    Node* operand = constant == node->GetRight() ? node->GetLeft() : node->GetRight();
+    int64_t value = std::stoll(constant->GetValue());
+
+    CodeGenExpr(operand);
+    asmGen.pop(r64::rax);
+    if (node->GetType() == Mul) {
+        EmitMulByConstant(r64::rax, PlanMultiply(value).value(), r64::rbx);
+    } else {
+        EmitDivByConstant(r64::rax, value, r64::rbx);
+    }
+    asmGen.push(r64::rax);
+    return true;
+}
+
+bool CodeGen::EmitRegByConstant(Node* node, r64 dst) {
+    const Node* constant = ReducibleConstant(node);
+    if (!constant) {
+        return false;
+    }
+    Node* operand = constant == node->GetRight() ? node->GetLeft() : node->GetRight();
+    int64_t value = std::stoll(constant->GetValue());
+
+    CodeGenExprTo(operand, dst);
+
+    if (node->GetType() == Mul) {
+        MulPlan plan = PlanMultiply(value).value();
+        ScratchReg tmp {dst, false};
+        if (plan.addSign != 0) {
+            tmp = AcquireScratch(dst);
+        }
+        EmitMulByConstant(dst, plan, tmp.reg);
+        if (plan.addSign != 0) {
+            ReleaseScratch(tmp);
+        }
+        return true;
+    }
+
+    bool powerOfTwo = std::has_single_bit(Magnitude(value));
+    bool needsTmp = powerOfTwo || dst == r64::rax || dst == r64::rdx;
+    ScratchReg tmp {dst, false};
+    if (needsTmp) {
+        tmp = AcquireScratch(dst);
+    }
+
+    // the multiply-high clobbers rdx:rax; keep whatever an enclosing expression parked there
+    bool saveRax = !powerOfTwo && dst != r64::rax && std::find(liveResults.begin(), liveResults.end(), r64::rax) != liveResults.end();
+    bool saveRdx = !powerOfTwo && dst != r64::rdx && std::find(liveResults.begin(), liveResults.end(), r64::rdx) != liveResults.end();
+    if (saveRax) asmGen.push(r64::rax);
+    if (saveRdx) asmGen.push(r64::rdx);
+
+    EmitDivByConstant(dst, value, tmp.reg);
+
+    if (saveRdx) asmGen.pop(r64::rdx);
+    if (saveRax) asmGen.pop(r64::rax);
+
+    if (needsTmp) {
+        ReleaseScratch(tmp);
+    }
+    return true;
+}
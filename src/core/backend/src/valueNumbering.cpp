@@ -0,0 +1,321 @@
+#include "valueNumbering.h"
+
+#include <utility>
+
+namespace {
+
+const std::string kTempPrefix = "__cse_";
+
+bool IsLeaf(const Node* node) {
+    return node->GetType() == Number || node->GetType() == Identifier;
+}
+
+bool IsBinary(const Node* node) {
+    switch (node->GetType()) {
+        case Add:
+        case Sub:
+        case Mul:
+        case Div:
+        case Greater:
+        case GreaterOrEqual:
+        case Less:
+        case LessOrEqual:
+        case Identical:
+        case NotIdentical: {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+bool IsCommutative(NodeType type) {
+    return type == Add || type == Mul || type == Identical || type == NotIdentical;
+}
+
+bool IsPure(const Node* node) {
+    if (IsLeaf(node)) {
+        return true;
+    }
+    return IsBinary(node) && IsPure(node->GetLeft()) && IsPure(node->GetRight());
+}
+
+// adding or subtracting two leaves is a single instruction, cheaper to redo than to keep
+bool IsWorthReusing(const Node* node) {
+    if (!IsBinary(node) || !IsPure(node)) {
+        return false;
+    }
+    bool leaves = IsLeaf(node->GetLeft()) && IsLeaf(node->GetRight());
+    return !(leaves && (node->GetType() == Add || node->GetType() == Sub));
+}
+
+bool HasCall(const Node* node) {
+    if (!node) {
+        return false;
+    }
+    switch (node->GetType()) {
+        case Call: {
+            return true;
+        }
+        case Equal: {
+            return node->GetRight()->GetType() == Call;
+        }
+        case Semicolon:
+        case If:
+        case While: {
+            return HasCall(node->GetLeft()) || HasCall(node->GetRight());
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+void CollectAssigned(const Node* node, std::unordered_set<std::string>& names) {
+    if (!node) {
+        return;
+    }
+    if (node->GetType() == Equal) {
+        names.insert(node->GetLeft()->GetValue());
+    }
+    if (node->GetType() == Semicolon || node->GetType() == If || node->GetType() == While) {
+        CollectAssigned(node->GetLeft(), names);
+        CollectAssigned(node->GetRight(), names);
+    }
+}
+
+} // namespace
+
+void ValueNumbering::Run(Node* program) {
+    if (!program) {
+        return;
+    }
+
+    switch (program->GetType()) {
+        case Semicolon: {
+            Run(program->GetLeft());
+            Run(program->GetRight());
+            break;
+        }
+        case Def: {
+            versions.clear();
+            values.clear();
+            available.clear();
+            owners.clear();
+            moved.clear();
+            VisitStmt(program->GetRight());
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void ValueNumbering::VisitStmt(Node* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->GetType()) {
+        case Semicolon: {
+            VisitStmt(node->GetLeft());
+            VisitStmt(node->GetRight());
+            break;
+        }
+        case Equal:         VisitAssignment(node);                      break;
+        case If:            VisitIf(node);                              break;
+        case While:         VisitWhile(node);                           break;
+        case PrintAscii:
+        case PrintInt:
+        case Return:        VisitExpr(node->GetLeft(), node, true);     break;
+        case Call:          available.clear();                          break;
+
+        default: {
+            break;
+        }
+    }
+}
+
+void ValueNumbering::VisitAssignment(Node* node) {
+    // a reuse may move this statement behind a new temporary, so read it up front
+    std::string name = node->GetLeft()->GetValue();
+    Node* rhs = node->GetRight();
+
+    if (rhs->GetType() == Call) {
+        available.clear();
+    }
+    if (!IsPure(rhs)) {
+        Assign(name);
+        return;
+    }
+
+    std::string number = NumberOf(rhs);
+    VisitExpr(rhs, node, true);
+    Assign(name);
+
+    // the variable holds the value until it is assigned again
+    if (auto iter = available.find(number); iter != available.end()) {
+        Value& value = values[iter->second];
+        if (value.node == rhs && value.holder.empty()) {
+            value.holder = name;
+            value.holderVersion = versions[name];
+        }
+    }
+}
+
+void ValueNumbering::VisitIf(Node* node) {
+    Node* cond = node->GetLeft();
+    Node* body = node->GetRight();
+
+    // a comparison stays in the condition, where it becomes cmp + jcc; only its operands are shared
+    if (IsBinary(cond)) {
+        VisitExpr(cond->GetLeft(), node, true);
+        VisitExpr(cond->GetRight(), node, true);
+    } else {
+        VisitExpr(cond, node, true);
+    }
+
+    // numbers from the body do not hold when it is skipped; whatever it assigned has a newer
+    // version now, so the older numbers that survive are still right
+    std::unordered_map<std::string, size_t> before = available;
+    VisitStmt(body);
+    available = std::move(before);
+
+    if (HasCall(body)) {
+        available.clear();
+    }
+}
+
+void ValueNumbering::VisitWhile(Node* node) {
+    Node* cond = node->GetLeft();
+    Node* body = node->GetRight();
+
+    std::unordered_set<std::string> assigned;
+    CollectAssigned(body, assigned);
+    Invalidate(assigned);
+    if (HasCall(body)) {
+        available.clear();
+    }
+
+    // the condition runs at the loop head, where no temporary can be placed, so it only reuses
+    std::unordered_map<std::string, size_t> head = available;
+    if (IsBinary(cond)) {
+        VisitExpr(cond->GetLeft(), node, false);
+        VisitExpr(cond->GetRight(), node, false);
+    } else {
+        VisitExpr(cond, node, false);
+    }
+    VisitStmt(body);
+    available = std::move(head);
+}
+
+void ValueNumbering::VisitExpr(Node* node, Node* stmt, bool record) {
+    if (!node || !IsWorthReusing(node)) {
+        return;
+    }
+
+    std::string number = NumberOf(node);
+    if (auto iter = available.find(number); iter != available.end()) {
+        std::string name = Reuse(values[iter->second]);
+        node->SetType(Identifier);
+        node->SetValue(name);
+        node->SetLeft(nullptr);
+        node->SetRight(nullptr);
+        return;
+    }
+
+    VisitExpr(node->GetLeft(), stmt, record);
+    VisitExpr(node->GetRight(), stmt, record);
+
+    if (record) {
+        available[number] = values.size();
+        values.push_back({node, "", 0});
+        owners[node] = stmt;
+    }
+}
+
+std::string ValueNumbering::NumberOf(const Node* node) const {
+    switch (node->GetType()) {
+        case Number: {
+            return node->GetValue();
+        }
+        case Identifier: {
+            auto iter = versions.find(node->GetValue());
+            return node->GetValue() + "@" + std::to_string(iter == versions.end() ? 0 : iter->second);
+        }
+        default: {
+            break;
+        }
+    }
+
+    std::string lhs = NumberOf(node->GetLeft());
+    std::string rhs = NumberOf(node->GetRight());
+    if (IsCommutative(node->GetType()) && rhs < lhs) {
+        std::swap(lhs, rhs);
+    }
+    return std::to_string(node->GetType()) + "(" + lhs + "," + rhs + ")";
+}
+
+// Returns a variable holding the value. Without one, the first occurrence is computed into a
+// temporary placed right before the statement evaluating it; that statement may itself be an
+// earlier temporary, so temporaries always follow the ones they read.
+std::string ValueNumbering::Reuse(Value& value) {
+    if (!value.holder.empty() && versions[value.holder] == value.holderVersion) {
+        return value.holder;
+    }
+
+    std::string name = kTempPrefix + std::to_string(tempCount++);
+    Node* first = value.node;
+    Node* computed = tree.Create(first->GetType(), first->GetValue(), first->GetLeft(), first->GetRight());
+    Node* temp = tree.Create(Equal, keyEqual, tree.Create(Identifier, name), computed);
+    SetOwner(computed, temp);
+
+    first->SetType(Identifier);
+    first->SetValue(name);
+    first->SetLeft(nullptr);
+    first->SetRight(nullptr);
+
+    // the statement turns into "temporary; statement" in place, so its parent keeps pointing at it
+    Node* stmt = Resolve(owners.at(first));
+    Node* rest = tree.Create(stmt->GetType(), stmt->GetValue(), stmt->GetLeft(), stmt->GetRight());
+    stmt->SetType(Semicolon);
+    stmt->SetValue(keySemicolon);
+    stmt->SetLeft(temp);
+    stmt->SetRight(rest);
+    moved[stmt] = rest;
+
+    Assign(name);
+    value.holder = name;
+    value.holderVersion = versions[name];
+    return name;
+}
+
+void ValueNumbering::Assign(const std::string& name) {
+    versions[name] = ++versionCount;
+}
+
+void ValueNumbering::Invalidate(const std::unordered_set<std::string>& names) {
+    for (const std::string& name : names) {
+        Assign(name);
+    }
+}
+
+Node* ValueNumbering::Resolve(Node* stmt) const {
+    for (auto iter = moved.find(stmt); iter != moved.end(); iter = moved.find(stmt)) {
+        stmt = iter->second;
+    }
+    return stmt;
+}
+
+void ValueNumbering::SetOwner(const Node* node, Node* stmt) {
+    if (!node) {
+        return;
+    }
+    if (auto iter = owners.find(node); iter != owners.end()) {
+        iter->second = stmt;
+    }
+    SetOwner(node->GetLeft(), stmt);
+    SetOwner(node->GetRight(), stmt);
+}
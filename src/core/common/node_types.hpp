@@ -30,6 +30,13 @@ enum NodeType {
     Def,
     Call,
     Return,
+    PrintStr,
+    String,
+    MapFile,
+    MapReadInt,
+    MapEof,
+    ClockNs,
+    Cycles,
 };
 
 inline const std::unordered_map<NodeType, std::string> kNodeTypeToString {
@@ -56,6 +63,13 @@ inline const std::unordered_map<NodeType, std::string> kNodeTypeToString {
     {Def, keyDef},  
     {Call, keyCall},
     {Return, keyReturn},
+    {PrintStr, keyPrintStr},
+    {String, keyString},
+    {MapFile, keyMapFile},
+    {MapReadInt, keyMapReadInt},
+    {MapEof, keyMapEof},
+    {ClockNs, keyClockNs},
+    {Cycles, keyCycles},
 };
 
 inline const std::unordered_map<std::string, NodeType> kStringToNodeType {
@@ -82,4 +96,11 @@ inline const std::unordered_map<std::string, NodeType> kStringToNodeType {
     {keyCall, Call},
     {keyReturn, Return},
     {keyEnd, End},
+    {keyPrintStr, PrintStr},
+    {keyString, String},
+    {keyMapFile, MapFile},
+    {keyMapReadInt, MapReadInt},
+    {keyMapEof, MapEof},
+    {keyClockNs, ClockNs},
+    {keyCycles, Cycles},
 };
@@ -16,6 +16,12 @@ inline const std::string keyCall = "call";
 inline const std::string keyPrintAscii = "print_ascii";
 inline const std::string keyPrintInt = "print_int";
 inline const std::string keyReadInt = "read_int";
+inline const std::string keyPrintStr = "print_str";
+inline const std::string keyMapFile = "map_file";
+inline const std::string keyMapReadInt = "map_read_int";
+inline const std::string keyMapEof = "map_eof";
+inline const std::string keyClockNs = "clock_ns";
+inline const std::string keyCycles = "cycles";
 inline const std::string keyWhile = "while";
 inline const std::string keySemicolon = ";";
 inline const std::string keyIdentical = "==";
@@ -29,5 +35,7 @@ inline const std::string keyLeftCurlyBracket = "{";
 inline const std::string keyRightCurlyBracket = "}";
 inline const std::string keyNumber = "number";
 inline const std::string keyIdentifier = "identifier";
+inline const std::string keyString = "string";
 inline const std::string keyOperation = "operation";
 inline const std::string keyComma = ",";
+inline const std::string keyQuote = "\"";
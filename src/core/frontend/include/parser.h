@@ -19,6 +19,7 @@ private:
     Node* GetDef();
     Node* GetWhile();
     Node* GetNumber();
+    Node* GetString();
     Node* GetVariable();
     Node* GetOperation();
     Node* GetExpression();
@@ -14,6 +14,7 @@ private:
     };
 
     void SplitIntoTokens(const std::string& data);
+    size_t ReadStringLiteral(const std::string& data, size_t i);
 
 public:
     Tokenizer(const std::string& fn);
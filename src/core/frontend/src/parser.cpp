@@ -88,6 +88,15 @@ Node* Parser::GetNumber() {
     return ast.Create(Number, tokens[pos++]);
 }
 
+Node* Parser::GetString() {
+    if (tokens[pos].size() < 2 || tokens[pos][0] != keyQuote[0]) {
+        SyntaxError();
+    }
+    std::string value = tokens[pos].substr(1, tokens[pos].size() - 2);
+    pos++;
+    return ast.Create(String, value);
+}
+
 Node* Parser::GetVariable() {
     return ast.Create(Identifier, tokens[pos++]);
 }
@@ -145,10 +154,18 @@ Node* Parser::GetOperation() {
         CHECK_RIGHT_PARENTHESIS;
         pos++;
         return ast.Create(PrintInt, keyPrintInt, left, nullptr); 
+    } else if (tokens[pos] == keyPrintStr) {
+        pos++;
+        CHECK_LEFT_PARENTHESIS;
+        pos++;
+        Node* left = GetString();
+        CHECK_RIGHT_PARENTHESIS;
+        pos++;
+        return ast.Create(PrintStr, keyPrintStr, left, nullptr);
     } else if (tokens[pos] == keyReturn) {
         size_t op = pos;
         pos++;
-        Node* left = GetComparsion();
+        Node* left = tokens[pos] == keyCall ? GetCalling() : GetComparsion();
         return ast.Create(Return, keyReturn, left, nullptr);
     } else if (tokens[pos] == keyLeftCurlyBracket) {
         pos++;
@@ -218,13 +235,31 @@ Node* Parser::GetAssignment() {
     pos++;
     if (tokens[pos] == keyCall) {
         rightNode = GetCalling();
-    } else if (tokens[pos] == keyReadInt) {
+    } else if (tokens[pos] == keyReadInt || tokens[pos] == keyClockNs || tokens[pos] == keyCycles) {
+        size_t op = pos;
+        pos++;
+        CHECK_LEFT_PARENTHESIS;
+        pos++;
+        CHECK_RIGHT_PARENTHESIS;
+        pos++;
+        rightNode = ast.Create(kStringToNodeType.at(tokens[op]), tokens[op]);
+    } else if (tokens[pos] == keyMapFile) {
+        pos++;
+        CHECK_LEFT_PARENTHESIS;
+        pos++;
+        Node* path = GetString();
+        CHECK_RIGHT_PARENTHESIS;
+        pos++;
+        rightNode = ast.Create(MapFile, keyMapFile, path, nullptr);
+    } else if (tokens[pos] == keyMapReadInt || tokens[pos] == keyMapEof) {
+        size_t op = pos;
         pos++;
         CHECK_LEFT_PARENTHESIS;
         pos++;
+        Node* handle = GetComparsion();
         CHECK_RIGHT_PARENTHESIS;
         pos++;
-        rightNode = ast.Create(ReadInt, keyReadInt);
+        rightNode = ast.Create(kStringToNodeType.at(tokens[op]), tokens[op], handle, nullptr);
     } else {
         rightNode = GetComparsion();
     }
@@ -53,6 +53,8 @@ void Tokenizer::SplitIntoTokens(const std::string& data) {
                 buffer += data[i++];
             }
             tokens.push_back(buffer);
+        } else if (data[i] == keyQuote[0]) {
+            i = ReadStringLiteral(data, i);
         } else if (i < data.size() && data[i] == '#') {
             while (i < data.size() && data[i] != '\n') {
                 ++i;
@@ -65,3 +67,46 @@ void Tokenizer::SplitIntoTokens(const std::string& data) {
         }
     }
 }
+
+size_t Tokenizer::ReadStringLiteral(const std::string& data, size_t i) {
+    size_t start = i++;
+    std::string buffer = keyQuote;
+    while (i < data.size() && data[i] != keyQuote[0]) {
+        if (data[i] == '\n') {
+            break;
+        }
+        if (data[i] != '\\') {
+            buffer += data[i++];
+            continue;
+        }
+
+        if (++i >= data.size()) {
+            break;
+        }
+        switch (data[i++]) {
+            case 'n':   buffer += '\n';   break;
+            case 't':   buffer += '\t';   break;
+            case 'r':   buffer += '\r';   break;
+            case '0':   buffer += '\0';   break;
+            case '\\':  buffer += '\\';   break;
+            case '"':   buffer += '"';    break;
+
+            default: {
+                throw FrontendExcept::TokenizerException(
+                    "Unknown escape sequence '\\" + std::string(1, data[i - 1]) +
+                    "' at position " + std::to_string(i - 2)
+                );
+            }
+        }
+    }
+
+    if (i >= data.size() || data[i] != keyQuote[0]) {
+        throw FrontendExcept::TokenizerException(
+            "Unterminated string literal at position " + std::to_string(start)
+        );
+    }
+
+    buffer += data[i++];
+    tokens.push_back(buffer);
+    return i;
+}
@@ -0,0 +1,45 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <vector>
+
+#include "ir.hpp"
+
+namespace ssa {
+
+// Immediate dominators by the Cooper-Harvey-Kennedy iteration. Expects the blocks numbered
+// in reverse postorder, as Function::RemoveUnreachableBlocks leaves them.
+class DominatorTree {
+private:
+    std::vector<BlockId> idom;
+    std::vector<std::vector<BlockId>> children;
+
+public:
+    explicit DominatorTree(const Function& func);
+
+    BlockId Idom(BlockId block) const { return idom[block]; }
+    const std::vector<BlockId>& Children(BlockId block) const { return children[block]; }
+    bool Dominates(BlockId a, BlockId b) const;
+};
+
+// Gives every edge from a block with several successors into a block with several
+// predecessors a block of its own, so copies for the target's phis have somewhere to go.
+void SplitCriticalEdges(Function& func);
+
+// Cleans the graph up between passes: branches on constants become jumps, unreachable blocks
+// and phis that merge a single value disappear, straight-line chains are merged and blocks
+// that only jump somewhere else are bypassed.
+class CfgSimplifier {
+private:
+    bool FoldBranches(Function& func);
+    bool RemoveTrivialPhis(Function& func);
+    bool MergeChains(Function& func);
+    bool BypassForwarders(Function& func);
+
+public:
+    void Run(Function& func);
+};
+
+} // namespace ssa
+
+#endif // CFG_H
@@ -0,0 +1,18 @@
+#ifndef DEAD_VALUES_H
+#define DEAD_VALUES_H
+
+#include "ir.hpp"
+
+namespace ssa {
+
+// Mark-and-sweep over values: everything with an effect and every terminator is live, and so
+// is whatever they use, transitively. The rest, including phis that only feed each other
+// around a loop, is removed.
+class DeadValueEliminator {
+public:
+    void Run(Function& func);
+};
+
+} // namespace ssa
+
+#endif // DEAD_VALUES_H
@@ -0,0 +1,35 @@
+#ifndef GVN_H
+#define GVN_H
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "cfg.hpp"
+#include "ir.hpp"
+
+namespace ssa {
+
+// Dominator-based global value numbering. Walking the dominator tree with a scoped table of
+// pure expressions, a value that recomputes one available in a dominating block is replaced
+// by it. Operands are numbered first, so whole chains of redundant arithmetic collapse, and
+// the identities x + 0, x - 0, x * 1 and x / 1 reduce to x.
+class Gvn {
+private:
+    using Key = std::tuple<Opcode, std::vector<ValueId>, int64_t>;
+
+    Function* func = nullptr;
+    std::map<Key, ValueId> available;
+    std::vector<ValueId> leader;
+
+    void Visit(const DominatorTree& domTree, BlockId block);
+    std::optional<ValueId> Simplify(const Inst& inst) const;
+    Key KeyOf(const Inst& inst) const;
+
+public:
+    void Run(Function& function);
+};
+
+} // namespace ssa
+
+#endif // GVN_H
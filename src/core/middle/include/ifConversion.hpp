@@ -0,0 +1,22 @@
+#ifndef IF_CONVERSION_H
+#define IF_CONVERSION_H
+
+#include "ir.hpp"
+
+namespace ssa {
+
+// Turns small branches into selects. A block that only its branching predecessor reaches,
+// computes a couple of pure values and jumps on to that predecessor's other successor is
+// hoisted into the predecessor, and the phis where the two paths meet become Selects on the
+// branch condition. Nothing that can trap is hoisted, so the result runs the same either way.
+class IfConverter {
+private:
+    bool Convert(Function& func, BlockId head);
+
+public:
+    void Run(Function& func);
+};
+
+} // namespace ssa
+
+#endif // IF_CONVERSION_H
@@ -0,0 +1,124 @@
+#ifndef IR_H
+#define IR_H
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ssa {
+
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+
+constexpr BlockId kEntryBlock = 0;
+
+enum class Opcode {
+    // pure values
+    Const,
+    Param,
+    Phi,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Less,
+    LessOrEqual,
+    Greater,
+    GreaterOrEqual,
+    Identical,
+    NotIdentical,
+    // the second argument when the first is nonzero, else the third
+    Select,
+
+    // calls and builtins, kept in program order
+    Call,
+    ReadInt,
+    MapFile,
+    MapReadInt,
+    MapEof,
+    ClockNs,
+    Cycles,
+    PrintAscii,
+    PrintInt,
+    PrintStr,
+
+    // exactly one of these ends every block
+    Jump,
+    Branch,
+    Return,
+};
+
+struct Inst {
+    Opcode op = Opcode::Const;
+    std::vector<ValueId> args;
+    // Const: the value, Param: the parameter index
+    int64_t imm = 0;
+    // Call: the callee, PrintStr: the literal, MapFile: the path
+    std::string name;
+    BlockId block = 0;
+};
+
+struct Block {
+    // phis first, the terminator last
+    std::vector<ValueId> insts;
+    // a phi's arguments follow this order
+    std::vector<BlockId> preds;
+    // Branch goes to the first one when its operand is nonzero
+    std::vector<BlockId> succs;
+};
+
+// One Def as a control-flow graph in SSA form. Values are numbered by the instruction that
+// defines them; an instruction removed from its block keeps its slot so ids stay stable.
+class Function {
+public:
+    std::string name;
+    size_t paramCount = 0;
+    std::vector<Inst> values;
+    std::vector<Block> blocks;
+
+    BlockId AddBlock();
+    ValueId Append(BlockId block, Inst inst);
+    ValueId AddPhi(BlockId block);
+    // places a value ahead of everything but the phis
+    ValueId Prepend(BlockId block, Inst inst);
+
+    void AddEdge(BlockId from, BlockId to);
+    // drops one from -> to edge together with the phi arguments that came along it
+    void RemoveEdge(BlockId from, BlockId to);
+    // moves the from -> oldTo edge to newTo, which receives the given phi arguments
+    void RedirectEdge(BlockId from, BlockId oldTo, BlockId newTo, const std::vector<ValueId>& phiArgs);
+
+    void Remove(ValueId value);
+    void ReplaceUses(ValueId from, ValueId to);
+    // the terminator becomes a Jump to the given successor, other edges are removed
+    void MakeJump(BlockId block, BlockId target);
+
+    Inst& Terminator(BlockId block) { return values[blocks[block].insts.back()]; }
+    const Inst& Terminator(BlockId block) const { return values[blocks[block].insts.back()]; }
+    std::vector<ValueId> Phis(BlockId block) const;
+    size_t PredIndex(BlockId block, BlockId pred) const;
+
+    // Drops the blocks the entry cannot reach and renumbers the rest in reverse postorder.
+    void RemoveUnreachableBlocks();
+
+    void Print(std::ostream& out) const;
+};
+
+bool IsTerminator(Opcode op);
+bool IsCommutative(Opcode op);
+bool IsBinary(Opcode op);
+bool IsComparison(Opcode op);
+
+// Whether removing the value could change what the program does. Division traps on a zero
+// divisor, so it counts as an effect unless the divisor is a harmless constant.
+bool HasEffects(const Function& func, ValueId value);
+
+// The generated code's arithmetic: wrapping, with truncating division. Division by zero and
+// INT64_MIN / -1 trap at run time and give nullopt.
+std::optional<int64_t> Evaluate(Opcode op, int64_t lhs, int64_t rhs);
+
+} // namespace ssa
+
+#endif // IR_H
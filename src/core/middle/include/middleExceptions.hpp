@@ -0,0 +1,23 @@
+#ifndef MIDDLE_EXCEPTIONS_H
+#define MIDDLE_EXCEPTIONS_H
+
+#include <stdexcept>
+#include <string>
+
+namespace MiddleExcept {
+
+class BaseException : public std::runtime_error {
+public:
+    BaseException(const std::string& message)
+        : std::runtime_error(message) {}
+};
+
+class LoweringException : public BaseException {
+public:
+    LoweringException(const std::string& message)
+        : BaseException("Lowering error: " + message) {}
+};
+
+} // namespace MiddleExcept
+
+#endif // MIDDLE_EXCEPTIONS_H
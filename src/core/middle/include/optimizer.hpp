@@ -0,0 +1,17 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ir.hpp"
+
+namespace ssa {
+
+// The pass pipeline run on every function before it is lowered to machine code:
+// SCCP, then GVN, then dead value elimination, with CfgSimplifier tidying up in between.
+class Optimizer {
+public:
+    void Run(Function& func);
+};
+
+} // namespace ssa
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,49 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "ir.hpp"
+
+namespace ssa {
+
+// Sparse conditional constant propagation (Wegman-Zadeck). Values start out unknown and only
+// blocks reached along edges found executable are evaluated, so a constant that decides a
+// branch also keeps the untaken side from spoiling the phis below it. Values proven constant
+// become Const, decided branches become jumps and blocks never reached are dropped.
+class Sccp {
+private:
+    enum class State {
+        Unknown,
+        Constant,
+        Varying,
+    };
+
+    struct Lattice {
+        State state = State::Unknown;
+        int64_t value = 0;
+    };
+
+    Function* func = nullptr;
+    std::vector<Lattice> lattice;
+    std::vector<std::vector<ValueId>> users;
+    std::vector<bool> reached;
+    std::set<std::pair<BlockId, BlockId>> executable;
+    std::vector<std::pair<BlockId, BlockId>> edgeWork;
+    std::vector<ValueId> valueWork;
+
+    void Propagate();
+    void Visit(ValueId value);
+    Lattice Evaluate(const Inst& inst) const;
+    void Update(ValueId value, Lattice next);
+    void Rewrite();
+
+public:
+    void Run(Function& function);
+};
+
+} // namespace ssa
+
+#endif // SCCP_H
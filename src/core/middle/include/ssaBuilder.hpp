@@ -0,0 +1,59 @@
+#ifndef SSA_BUILDER_H
+#define SSA_BUILDER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.hpp"
+#include "node.hpp"
+
+namespace ssa {
+
+// Lowers one Def into SSA form while walking its statements, after Braun et al., "Simple and
+// Efficient Construction of Static Single Assignment Form": a variable read looks for its
+// definition in the current block and then through the predecessors, placing phis where paths
+// join. A loop header is sealed only once its back edge exists; reads before that leave phis
+// whose operands are filled in at sealing. Trivial phis are left to CfgSimplifier.
+//
+// Variables follow the generator's scoping: the first assignment declares a name in the
+// innermost scope, and If and While bodies open a scope of their own.
+class SsaBuilder {
+private:
+    using VarId = size_t;
+
+    Function func;
+    BlockId current = kEntryBlock;
+
+    std::vector<std::unordered_map<std::string, VarId>> scopes;
+    // per variable: its value at the end of each block that assigns it, or that was asked
+    std::vector<std::unordered_map<BlockId, ValueId>> definitions;
+    std::vector<bool> sealed;
+    std::unordered_map<BlockId, std::vector<std::pair<VarId, ValueId>>> incompletePhis;
+
+    void LowerStmt(const Node* node);
+    void LowerIf(const Node* node);
+    void LowerWhile(const Node* node);
+    void LowerReturn(const Node* node);
+    ValueId LowerExpr(const Node* node);
+    ValueId LowerCall(const Node* node);
+
+    ValueId Emit(Opcode op, std::vector<ValueId> args = {}, int64_t imm = 0, const std::string& name = "");
+    void Terminate(Opcode op, std::vector<ValueId> args, const std::vector<BlockId>& succs);
+    BlockId NewBlock();
+    void Seal(BlockId block);
+
+    VarId Declare(const std::string& name);
+    std::optional<VarId> Lookup(const std::string& name) const;
+    void WriteVariable(VarId var, BlockId block, ValueId value);
+    ValueId ReadVariable(VarId var, BlockId block);
+    ValueId ReadVariableRecursive(VarId var, BlockId block);
+    void AddPhiOperands(VarId var, ValueId phi);
+
+public:
+    Function Build(const Node* def);
+};
+
+} // namespace ssa
+
+#endif // SSA_BUILDER_H
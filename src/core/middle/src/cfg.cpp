@@ -0,0 +1,208 @@
+#include "cfg.hpp"
+
+#include <algorithm>
+
+namespace ssa {
+
+DominatorTree::DominatorTree(const Function& func)
+    : idom(func.blocks.size(), kEntryBlock), children(func.blocks.size()) {
+    std::vector<bool> done(func.blocks.size(), false);
+    done[kEntryBlock] = true;
+
+    auto intersect = [&](BlockId a, BlockId b) {
+        while (a != b) {
+            while (a > b) a = idom[a];
+            while (b > a) b = idom[b];
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (BlockId b = 1; b < func.blocks.size(); ++b) {
+            std::optional<BlockId> dom;
+            for (BlockId pred : func.blocks[b].preds) {
+                if (done[pred]) {
+                    dom = dom.has_value() ? intersect(pred, dom.value()) : pred;
+                }
+            }
+            if (dom.has_value() && (!done[b] || idom[b] != dom.value())) {
+                idom[b] = dom.value();
+                done[b] = true;
+                changed = true;
+            }
+        }
+    }
+
+    for (BlockId b = 1; b < func.blocks.size(); ++b) {
+        children[idom[b]].push_back(b);
+    }
+}
+
+bool DominatorTree::Dominates(BlockId a, BlockId b) const {
+    while (b != a && b != kEntryBlock) {
+        b = idom[b];
+    }
+    return b == a;
+}
+
+void SplitCriticalEdges(Function& func) {
+    size_t count = func.blocks.size();
+    for (BlockId from = 0; from < count; ++from) {
+        if (func.blocks[from].succs.size() < 2) {
+            continue;
+        }
+        for (size_t i = 0; i < func.blocks[from].succs.size(); ++i) {
+            BlockId to = func.blocks[from].succs[i];
+            if (func.blocks[to].preds.size() < 2) {
+                continue;
+            }
+            // the new block takes over the predecessor slot, so the phi arguments stay in place
+            BlockId middle = func.AddBlock();
+            func.Append(middle, Inst {Opcode::Jump, {}, 0, "", middle});
+            std::vector<BlockId>& preds = func.blocks[to].preds;
+            *std::find(preds.begin(), preds.end(), from) = middle;
+            func.blocks[from].succs[i] = middle;
+            func.blocks[middle].preds.push_back(from);
+            func.blocks[middle].succs.push_back(to);
+        }
+    }
+    // renumbering moves the new blocks next to their predecessors
+    func.RemoveUnreachableBlocks();
+}
+
+void CfgSimplifier::Run(Function& func) {
+    func.RemoveUnreachableBlocks();
+
+    bool changed = true;
+    while (changed) {
+        changed = FoldBranches(func);
+        changed |= RemoveTrivialPhis(func);
+        changed |= MergeChains(func);
+        changed |= BypassForwarders(func);
+        func.RemoveUnreachableBlocks();
+    }
+}
+
+bool CfgSimplifier::FoldBranches(Function& func) {
+    bool changed = false;
+    for (BlockId b = 0; b < func.blocks.size(); ++b) {
+        const Inst& term = func.Terminator(b);
+        if (term.op != Opcode::Branch) {
+            continue;
+        }
+        const std::vector<BlockId>& succs = func.blocks[b].succs;
+        const Inst& cond = func.values[term.args[0]];
+        if (cond.op == Opcode::Const) {
+            func.MakeJump(b, cond.imm != 0 ? succs[0] : succs[1]);
+            changed = true;
+        } else if (succs[0] == succs[1]) {
+            func.MakeJump(b, succs[0]);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// a phi whose arguments are one value, apart from the phi itself, is that value
+bool CfgSimplifier::RemoveTrivialPhis(Function& func) {
+    bool changed = false;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (BlockId b = 0; b < func.blocks.size(); ++b) {
+            for (ValueId phi : func.Phis(b)) {
+                std::optional<ValueId> same;
+                bool trivial = true;
+                for (ValueId arg : func.values[phi].args) {
+                    if (arg == phi || arg == same) {
+                        continue;
+                    }
+                    if (same.has_value()) {
+                        trivial = false;
+                        break;
+                    }
+                    same = arg;
+                }
+                if (!trivial || !same.has_value()) {
+                    continue;
+                }
+                func.ReplaceUses(phi, same.value());
+                func.Remove(phi);
+                progress = true;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+bool CfgSimplifier::MergeChains(Function& func) {
+    bool changed = false;
+    for (BlockId b = 0; b < func.blocks.size(); ++b) {
+        // blocks merged into their predecessor are left empty until the next renumbering
+        while (!func.blocks[b].insts.empty() && func.Terminator(b).op == Opcode::Jump) {
+            BlockId s = func.blocks[b].succs[0];
+            if (s == b || s == kEntryBlock || func.blocks[s].preds.size() != 1) {
+                break;
+            }
+
+            for (ValueId phi : func.Phis(s)) {
+                func.ReplaceUses(phi, func.values[phi].args[0]);
+                func.Remove(phi);
+            }
+            func.Remove(func.blocks[b].insts.back());
+
+            Block& block = func.blocks[b];
+            Block& succ = func.blocks[s];
+            for (ValueId id : succ.insts) {
+                func.values[id].block = b;
+                block.insts.push_back(id);
+            }
+            block.succs = succ.succs;
+            for (BlockId next : succ.succs) {
+                std::vector<BlockId>& preds = func.blocks[next].preds;
+                std::replace(preds.begin(), preds.end(), s, b);
+            }
+            succ = Block {};
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool CfgSimplifier::BypassForwarders(Function& func) {
+    bool changed = false;
+    for (BlockId f = 1; f < func.blocks.size(); ++f) {
+        const Block& forwarder = func.blocks[f];
+        if (forwarder.insts.size() != 1 || func.Terminator(f).op != Opcode::Jump) {
+            continue;
+        }
+        BlockId s = forwarder.succs[0];
+        if (s == f) {
+            continue;
+        }
+
+        std::vector<ValueId> phis = func.Phis(s);
+        std::vector<ValueId> phiArgs;
+        size_t index = func.PredIndex(s, f);
+        for (ValueId phi : phis) {
+            phiArgs.push_back(func.values[phi].args[index]);
+        }
+
+        std::vector<BlockId> preds = forwarder.preds;
+        for (BlockId p : preds) {
+            const std::vector<BlockId>& targetPreds = func.blocks[s].preds;
+            // a second edge from p into s could need different phi arguments
+            if (p == f || (!phis.empty() && std::find(targetPreds.begin(), targetPreds.end(), p) != targetPreds.end())) {
+                continue;
+            }
+            func.RedirectEdge(p, f, s, phiArgs);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+} // namespace ssa
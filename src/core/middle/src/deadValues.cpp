@@ -0,0 +1,36 @@
+#include "deadValues.hpp"
+
+#include <vector>
+
+namespace ssa {
+
+void DeadValueEliminator::Run(Function& func) {
+    std::vector<bool> live(func.values.size(), false);
+    std::vector<ValueId> work;
+
+    for (const Block& block : func.blocks) {
+        for (ValueId id : block.insts) {
+            if (IsTerminator(func.values[id].op) || HasEffects(func, id)) {
+                live[id] = true;
+                work.push_back(id);
+            }
+        }
+    }
+
+    while (!work.empty()) {
+        ValueId id = work.back();
+        work.pop_back();
+        for (ValueId arg : func.values[id].args) {
+            if (!live[arg]) {
+                live[arg] = true;
+                work.push_back(arg);
+            }
+        }
+    }
+
+    for (Block& block : func.blocks) {
+        std::erase_if(block.insts, [&](ValueId id) { return !live[id]; });
+    }
+}
+
+} // namespace ssa
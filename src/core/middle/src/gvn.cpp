@@ -0,0 +1,120 @@
+#include "gvn.hpp"
+
+#include <algorithm>
+
+namespace ssa {
+
+void Gvn::Run(Function& function) {
+    func = &function;
+    available.clear();
+    leader.resize(func->values.size());
+    for (ValueId id = 0; id < leader.size(); ++id) {
+        leader[id] = id;
+    }
+
+    DominatorTree domTree(*func);
+    Visit(domTree, kEntryBlock);
+
+    // phi arguments along back edges may name values numbered after the phi
+    for (Block& block : func->blocks) {
+        std::vector<ValueId> insts = block.insts;
+        for (ValueId id : insts) {
+            for (ValueId& arg : func->values[id].args) {
+                arg = leader[arg];
+            }
+            if (leader[id] != id) {
+                func->Remove(id);
+            }
+        }
+    }
+}
+
+void Gvn::Visit(const DominatorTree& domTree, BlockId block) {
+    std::vector<Key> added;
+
+    for (ValueId id : func->blocks[block].insts) {
+        Inst& inst = func->values[id];
+        for (ValueId& arg : inst.args) {
+            arg = leader[arg];
+        }
+        if (HasEffects(*func, id) || IsTerminator(inst.op) || inst.op == Opcode::Param) {
+            continue;
+        }
+
+        if (std::optional<ValueId> same = Simplify(inst); same.has_value()) {
+            leader[id] = same.value();
+            continue;
+        }
+
+        Key key = KeyOf(inst);
+        // phis only match phis of the same block
+        if (inst.op == Opcode::Phi) {
+            std::get<2>(key) = block;
+        }
+        auto [iter, inserted] = available.emplace(key, id);
+        if (inserted) {
+            added.push_back(key);
+        } else {
+            leader[id] = iter->second;
+        }
+    }
+
+    for (BlockId child : domTree.Children(block)) {
+        Visit(domTree, child);
+    }
+
+    for (const Key& key : added) {
+        available.erase(key);
+    }
+}
+
+std::optional<ValueId> Gvn::Simplify(const Inst& inst) const {
+    if (!IsBinary(inst.op)) {
+        return std::nullopt;
+    }
+    auto isConst = [&](ValueId value, int64_t constant) {
+        const Inst& arg = func->values[value];
+        return arg.op == Opcode::Const && arg.imm == constant;
+    };
+
+    ValueId lhs = inst.args[0];
+    ValueId rhs = inst.args[1];
+    switch (inst.op) {
+        case Opcode::Add: {
+            if (isConst(rhs, 0)) return lhs;
+            if (isConst(lhs, 0)) return rhs;
+            return std::nullopt;
+        }
+        case Opcode::Mul: {
+            if (isConst(rhs, 1)) return lhs;
+            if (isConst(lhs, 1)) return rhs;
+            return std::nullopt;
+        }
+        case Opcode::Sub: {
+            if (isConst(rhs, 0)) return lhs;
+            return std::nullopt;
+        }
+        case Opcode::Div: {
+            if (isConst(rhs, 1)) return lhs;
+            return std::nullopt;
+        }
+        default: {
+            return std::nullopt;
+        }
+    }
+}
+
+// a > b is numbered as b < a, and commutative operands are sorted
+Gvn::Key Gvn::KeyOf(const Inst& inst) const {
+    Opcode op = inst.op;
+    std::vector<ValueId> args = inst.args;
+    if (op == Opcode::Greater || op == Opcode::GreaterOrEqual) {
+        op = op == Opcode::Greater ? Opcode::Less : Opcode::LessOrEqual;
+        std::swap(args[0], args[1]);
+    } else if (IsCommutative(op)) {
+        std::sort(args.begin(), args.end());
+    }
+    return {op, args, inst.op == Opcode::Const ? inst.imm : 0};
+}
+
+} // namespace ssa
@@ -0,0 +1,96 @@
+#include "ifConversion.hpp"
+
+#include <algorithm>
+
+#include "cfg.hpp"
+
+namespace ssa {
+
+namespace {
+
+// hoisted instructions run on both paths, and every select is a cmov
+constexpr size_t kMaxHoisted = 2;
+constexpr size_t kMaxSelects = 2;
+
+bool IsHoistable(const Inst& inst) {
+    return inst.op == Opcode::Const || (IsBinary(inst.op) && inst.op != Opcode::Div);
+}
+
+} // namespace
+
+void IfConverter::Run(Function& func) {
+    bool changed = false;
+    for (BlockId b = 0; b < func.blocks.size(); ++b) {
+        if (!func.blocks[b].insts.empty() && func.Terminator(b).op == Opcode::Branch) {
+            changed |= Convert(func, b);
+        }
+    }
+    if (changed) {
+        CfgSimplifier().Run(func);
+    }
+}
+
+bool IfConverter::Convert(Function& func, BlockId head) {
+    const std::vector<BlockId>& succs = func.blocks[head].succs;
+    for (size_t side = 0; side < 2; ++side) {
+        BlockId arm = succs[side];
+        BlockId join = succs[1 - side];
+        const Block& armBlock = func.blocks[arm];
+        const Block& joinBlock = func.blocks[join];
+        if (arm == head || join == head || armBlock.preds.size() != 1 || func.Terminator(arm).op != Opcode::Jump ||
+            armBlock.succs[0] != join || joinBlock.preds.size() != 2) {
+            continue;
+        }
+
+        std::vector<ValueId> hoisted(armBlock.insts.begin(), armBlock.insts.end() - 1);
+        std::vector<ValueId> phis = func.Phis(join);
+        if (hoisted.size() > kMaxHoisted || phis.empty() || phis.size() > kMaxSelects ||
+            !std::all_of(hoisted.begin(), hoisted.end(), [&](ValueId id) { return IsHoistable(func.values[id]); })) {
+            continue;
+        }
+
+        ValueId cond = func.Terminator(head).args[0];
+        size_t fromHead = func.PredIndex(join, head);
+        size_t fromArm = func.PredIndex(join, arm);
+
+        std::vector<ValueId>& insts = func.blocks[head].insts;
+        ValueId branch = insts.back();
+        insts.pop_back();
+        for (ValueId id : hoisted) {
+            func.values[id].block = head;
+            insts.push_back(id);
+        }
+        func.blocks[arm].insts.erase(func.blocks[arm].insts.begin(), func.blocks[arm].insts.end() - 1);
+
+        // a comparison nothing else in the block reads goes right before the first select,
+        // which can then test its flags
+        auto condIter = std::find(insts.begin(), insts.end(), cond);
+        bool readLater = condIter != insts.end() && std::any_of(condIter + 1, insts.end(), [&](ValueId id) {
+            const std::vector<ValueId>& args = func.values[id].args;
+            return std::find(args.begin(), args.end(), cond) != args.end();
+        });
+        if (condIter != insts.end() && IsComparison(func.values[cond].op) && !readLater) {
+            insts.erase(condIter);
+            insts.push_back(cond);
+        }
+
+        for (ValueId phi : phis) {
+            ValueId armValue = func.values[phi].args[fromArm];
+            ValueId headValue = func.values[phi].args[fromHead];
+            // the branch takes its first successor when the condition is nonzero
+            std::vector<ValueId> args = side == 0
+                ? std::vector<ValueId>{cond, armValue, headValue}
+                : std::vector<ValueId>{cond, headValue, armValue};
+            ValueId select = func.Append(head, Inst {Opcode::Select, args, 0, "", head});
+            func.ReplaceUses(phi, select);
+            func.Remove(phi);
+        }
+
+        insts.push_back(branch);
+        func.MakeJump(head, join);
+        return true;
+    }
+    return false;
+}
+
+} // namespace ssa
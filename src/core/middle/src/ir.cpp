@@ -0,0 +1,295 @@
+#include "ir.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+namespace ssa {
+
+namespace {
+
+const std::unordered_map<Opcode, std::string> kOpcodeNames {
+    {Opcode::Const, "const"},
+    {Opcode::Param, "param"},
+    {Opcode::Phi, "phi"},
+    {Opcode::Add, "add"},
+    {Opcode::Sub, "sub"},
+    {Opcode::Mul, "mul"},
+    {Opcode::Div, "div"},
+    {Opcode::Less, "lt"},
+    {Opcode::LessOrEqual, "le"},
+    {Opcode::Greater, "gt"},
+    {Opcode::GreaterOrEqual, "ge"},
+    {Opcode::Identical, "eq"},
+    {Opcode::NotIdentical, "ne"},
+    {Opcode::Select, "select"},
+    {Opcode::Call, "call"},
+    {Opcode::ReadInt, "read_int"},
+    {Opcode::MapFile, "map_file"},
+    {Opcode::MapReadInt, "map_read_int"},
+    {Opcode::MapEof, "map_eof"},
+    {Opcode::ClockNs, "clock_ns"},
+    {Opcode::Cycles, "cycles"},
+    {Opcode::PrintAscii, "print_ascii"},
+    {Opcode::PrintInt, "print_int"},
+    {Opcode::PrintStr, "print_str"},
+    {Opcode::Jump, "jump"},
+    {Opcode::Branch, "branch"},
+    {Opcode::Return, "return"},
+};
+
+} // namespace
+
+BlockId Function::AddBlock() {
+    blocks.emplace_back();
+    return static_cast<BlockId>(blocks.size() - 1);
+}
+
+ValueId Function::Append(BlockId block, Inst inst) {
+    inst.block = block;
+    values.push_back(std::move(inst));
+    ValueId id = static_cast<ValueId>(values.size() - 1);
+    blocks[block].insts.push_back(id);
+    return id;
+}
+
+ValueId Function::AddPhi(BlockId block) {
+    Inst phi {Opcode::Phi, {}, 0, "", block};
+    values.push_back(phi);
+    ValueId id = static_cast<ValueId>(values.size() - 1);
+    std::vector<ValueId>& insts = blocks[block].insts;
+    insts.insert(insts.begin() + Phis(block).size(), id);
+    return id;
+}
+
+ValueId Function::Prepend(BlockId block, Inst inst) {
+    size_t phiCount = Phis(block).size();
+    inst.block = block;
+    values.push_back(std::move(inst));
+    ValueId id = static_cast<ValueId>(values.size() - 1);
+    std::vector<ValueId>& insts = blocks[block].insts;
+    insts.insert(insts.begin() + phiCount, id);
+    return id;
+}
+
+void Function::AddEdge(BlockId from, BlockId to) {
+    blocks[from].succs.push_back(to);
+    blocks[to].preds.push_back(from);
+}
+
+void Function::RemoveEdge(BlockId from, BlockId to) {
+    std::vector<BlockId>& succs = blocks[from].succs;
+    succs.erase(std::find(succs.begin(), succs.end(), to));
+
+    size_t index = PredIndex(to, from);
+    blocks[to].preds.erase(blocks[to].preds.begin() + index);
+    for (ValueId phi : Phis(to)) {
+        values[phi].args.erase(values[phi].args.begin() + index);
+    }
+}
+
+void Function::RedirectEdge(BlockId from, BlockId oldTo, BlockId newTo, const std::vector<ValueId>& phiArgs) {
+    std::vector<BlockId>& succs = blocks[from].succs;
+    *std::find(succs.begin(), succs.end(), oldTo) = newTo;
+
+    size_t index = PredIndex(oldTo, from);
+    blocks[oldTo].preds.erase(blocks[oldTo].preds.begin() + index);
+    for (ValueId phi : Phis(oldTo)) {
+        values[phi].args.erase(values[phi].args.begin() + index);
+    }
+
+    blocks[newTo].preds.push_back(from);
+    std::vector<ValueId> phis = Phis(newTo);
+    for (size_t i = 0; i < phis.size(); ++i) {
+        values[phis[i]].args.push_back(phiArgs[i]);
+    }
+}
+
+void Function::Remove(ValueId value) {
+    std::vector<ValueId>& insts = blocks[values[value].block].insts;
+    insts.erase(std::find(insts.begin(), insts.end(), value));
+}
+
+void Function::ReplaceUses(ValueId from, ValueId to) {
+    for (Block& block : blocks) {
+        for (ValueId id : block.insts) {
+            std::replace(values[id].args.begin(), values[id].args.end(), from, to);
+        }
+    }
+}
+
+void Function::MakeJump(BlockId block, BlockId target) {
+    std::vector<BlockId> dropped = blocks[block].succs;
+    dropped.erase(std::find(dropped.begin(), dropped.end(), target));
+    for (BlockId succ : dropped) {
+        RemoveEdge(block, succ);
+    }
+
+    Inst& term = Terminator(block);
+    term.op = Opcode::Jump;
+    term.args.clear();
+}
+
+std::vector<ValueId> Function::Phis(BlockId block) const {
+    std::vector<ValueId> phis;
+    for (ValueId id : blocks[block].insts) {
+        if (values[id].op != Opcode::Phi) {
+            break;
+        }
+        phis.push_back(id);
+    }
+    return phis;
+}
+
+size_t Function::PredIndex(BlockId block, BlockId pred) const {
+    const std::vector<BlockId>& preds = blocks[block].preds;
+    return static_cast<size_t>(std::find(preds.begin(), preds.end(), pred) - preds.begin());
+}
+
+void Function::RemoveUnreachableBlocks() {
+    // successors are visited last to first, so the first one lands right after its block
+    std::vector<BlockId> postorder;
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<std::pair<BlockId, size_t>> stack {{kEntryBlock, blocks[kEntryBlock].succs.size()}};
+    visited[kEntryBlock] = true;
+    while (!stack.empty()) {
+        auto& [block, remaining] = stack.back();
+        if (remaining == 0) {
+            postorder.push_back(block);
+            stack.pop_back();
+            continue;
+        }
+        BlockId succ = blocks[block].succs[--remaining];
+        if (!visited[succ]) {
+            visited[succ] = true;
+            stack.push_back({succ, blocks[succ].succs.size()});
+        }
+    }
+
+    constexpr BlockId kUnreachable = std::numeric_limits<BlockId>::max();
+    std::vector<BlockId> renumber(blocks.size(), kUnreachable);
+    for (size_t i = 0; i < postorder.size(); ++i) {
+        renumber[postorder[postorder.size() - 1 - i]] = static_cast<BlockId>(i);
+    }
+
+    std::vector<Block> kept(postorder.size());
+    for (BlockId old = 0; old < blocks.size(); ++old) {
+        BlockId now = renumber[old];
+        if (now == kUnreachable) {
+            continue;
+        }
+        Block& block = blocks[old];
+        std::vector<ValueId> phis = Phis(old);
+
+        // phi arguments from unreachable predecessors go with them
+        for (size_t i = block.preds.size(); i-- > 0;) {
+            if (renumber[block.preds[i]] != kUnreachable) {
+                continue;
+            }
+            block.preds.erase(block.preds.begin() + i);
+            for (ValueId phi : phis) {
+                values[phi].args.erase(values[phi].args.begin() + i);
+            }
+        }
+        for (BlockId& pred : block.preds) {
+            pred = renumber[pred];
+        }
+        for (BlockId& succ : block.succs) {
+            succ = renumber[succ];
+        }
+        for (ValueId id : block.insts) {
+            values[id].block = now;
+        }
+        kept[now] = std::move(block);
+    }
+    blocks = std::move(kept);
+}
+
+void Function::Print(std::ostream& out) const {
+    out << "def " << name << "(" << paramCount << ")\n";
+    for (BlockId b = 0; b < blocks.size(); ++b) {
+        out << "b" << b << ":";
+        if (!blocks[b].preds.empty()) {
+            out << " ; preds";
+            for (BlockId pred : blocks[b].preds) {
+                out << " b" << pred;
+            }
+        }
+        out << "\n";
+
+        for (ValueId id : blocks[b].insts) {
+            const Inst& inst = values[id];
+            out << "    ";
+            if (!IsTerminator(inst.op) && inst.op < Opcode::PrintAscii) {
+                out << "v" << id << " = ";
+            }
+            out << kOpcodeNames.at(inst.op);
+            if (inst.op == Opcode::Const || inst.op == Opcode::Param) {
+                out << " " << inst.imm;
+            }
+            if (!inst.name.empty()) {
+                out << " \"" << inst.name << "\"";
+            }
+            for (size_t i = 0; i < inst.args.size(); ++i) {
+                out << (i == 0 ? " " : ", ") << "v" << inst.args[i];
+            }
+            for (BlockId succ : IsTerminator(inst.op) ? blocks[b].succs : std::vector<BlockId>{}) {
+                out << (inst.args.empty() && succ == blocks[b].succs.front() ? " " : ", ") << "b" << succ;
+            }
+            out << "\n";
+        }
+    }
+}
+
+bool IsTerminator(Opcode op) {
+    return op == Opcode::Jump || op == Opcode::Branch || op == Opcode::Return;
+}
+
+bool IsCommutative(Opcode op) {
+    return op == Opcode::Add || op == Opcode::Mul || op == Opcode::Identical || op == Opcode::NotIdentical;
+}
+
+bool IsBinary(Opcode op) {
+    return op >= Opcode::Add && op <= Opcode::NotIdentical;
+}
+
+bool IsComparison(Opcode op) {
+    return op >= Opcode::Less && op <= Opcode::NotIdentical;
+}
+
+bool HasEffects(const Function& func, ValueId value) {
+    const Inst& inst = func.values[value];
+    if (inst.op == Opcode::Div) {
+        const Inst& divisor = func.values[inst.args[1]];
+        return divisor.op != Opcode::Const || divisor.imm == 0 || divisor.imm == -1;
+    }
+    return inst.op >= Opcode::Call;
+}
+
+std::optional<int64_t> Evaluate(Opcode op, int64_t lhs, int64_t rhs) {
+    uint64_t ulhs = static_cast<uint64_t>(lhs);
+    uint64_t urhs = static_cast<uint64_t>(rhs);
+    switch (op) {
+        case Opcode::Add:               return static_cast<int64_t>(ulhs + urhs);
+        case Opcode::Sub:               return static_cast<int64_t>(ulhs - urhs);
+        case Opcode::Mul:               return static_cast<int64_t>(ulhs * urhs);
+        case Opcode::Div: {
+            if (rhs == 0 || (lhs == std::numeric_limits<int64_t>::min() && rhs == -1)) {
+                return std::nullopt;
+            }
+            return lhs / rhs;
+        }
+        case Opcode::Less:              return lhs < rhs;
+        case Opcode::LessOrEqual:       return lhs <= rhs;
+        case Opcode::Greater:           return lhs > rhs;
+        case Opcode::GreaterOrEqual:    return lhs >= rhs;
+        case Opcode::Identical:         return lhs == rhs;
+        case Opcode::NotIdentical:      return lhs != rhs;
+
+        default: {
+            return std::nullopt;
+        }
+    }
+}
+
+} // namespace ssa
@@ -0,0 +1,19 @@
+#include "optimizer.hpp"
+
+#include "cfg.hpp"
+#include "deadValues.hpp"
+#include "gvn.hpp"
+#include "sccp.hpp"
+
+namespace ssa {
+
+void Optimizer::Run(Function& func) {
+    CfgSimplifier().Run(func);
+    Sccp().Run(func);
+    CfgSimplifier().Run(func);
+    Gvn().Run(func);
+    DeadValueEliminator().Run(func);
+    CfgSimplifier().Run(func);
+}
+
+} // namespace ssa
@@ -0,0 +1,187 @@
+#include "sccp.hpp"
+
+namespace ssa {
+
+void Sccp::Run(Function& function) {
+    func = &function;
+    lattice.assign(func->values.size(), {});
+    users.assign(func->values.size(), {});
+    reached.assign(func->blocks.size(), false);
+    executable.clear();
+    edgeWork.clear();
+    valueWork.clear();
+
+    for (const Block& block : func->blocks) {
+        for (ValueId id : block.insts) {
+            for (ValueId arg : func->values[id].args) {
+                users[arg].push_back(id);
+            }
+        }
+    }
+
+    // a pseudo edge into the entry block starts things off
+    edgeWork.push_back({kEntryBlock, kEntryBlock});
+    Propagate();
+    Rewrite();
+}
+
+void Sccp::Propagate() {
+    while (!edgeWork.empty() || !valueWork.empty()) {
+        if (!edgeWork.empty()) {
+            auto [from, to] = edgeWork.back();
+            edgeWork.pop_back();
+            if (!executable.insert({from, to}).second) {
+                continue;
+            }
+
+            // a block seen before only has its phis to revisit for the new incoming edge
+            bool first = !reached[to];
+            reached[to] = true;
+            for (ValueId id : func->blocks[to].insts) {
+                if (!first && func->values[id].op != Opcode::Phi) {
+                    break;
+                }
+                Visit(id);
+            }
+            continue;
+        }
+
+        ValueId value = valueWork.back();
+        valueWork.pop_back();
+        for (ValueId user : users[value]) {
+            if (reached[func->values[user].block]) {
+                Visit(user);
+            }
+        }
+    }
+}
+
+void Sccp::Visit(ValueId value) {
+    const Inst& inst = func->values[value];
+    const Block& block = func->blocks[inst.block];
+
+    switch (inst.op) {
+        case Opcode::Jump: {
+            edgeWork.push_back({inst.block, block.succs[0]});
+            break;
+        }
+        case Opcode::Branch: {
+            const Lattice& cond = lattice[inst.args[0]];
+            if (cond.state == State::Varying || (cond.state == State::Constant && cond.value != 0)) {
+                edgeWork.push_back({inst.block, block.succs[0]});
+            }
+            if (cond.state == State::Varying || (cond.state == State::Constant && cond.value == 0)) {
+                edgeWork.push_back({inst.block, block.succs[1]});
+            }
+            break;
+        }
+        case Opcode::Return: {
+            break;
+        }
+        default: {
+            Update(value, Evaluate(inst));
+            break;
+        }
+    }
+}
+
+Sccp::Lattice Sccp::Evaluate(const Inst& inst) const {
+    switch (inst.op) {
+        case Opcode::Const: {
+            return {State::Constant, inst.imm};
+        }
+        case Opcode::Phi: {
+            // only edges known to run contribute
+            const Block& block = func->blocks[inst.block];
+            Lattice result;
+            for (size_t i = 0; i < inst.args.size(); ++i) {
+                if (executable.count({block.preds[i], inst.block}) == 0) {
+                    continue;
+                }
+                const Lattice& arg = lattice[inst.args[i]];
+                if (arg.state == State::Unknown) {
+                    continue;
+                }
+                if (arg.state == State::Varying || (result.state == State::Constant && result.value != arg.value)) {
+                    return {State::Varying};
+                }
+                result = arg;
+            }
+            return result;
+        }
+        default: {
+            break;
+        }
+    }
+
+    if (!IsBinary(inst.op)) {
+        return {State::Varying};
+    }
+
+    const Lattice& lhs = lattice[inst.args[0]];
+    const Lattice& rhs = lattice[inst.args[1]];
+    if (lhs.state == State::Varying || rhs.state == State::Varying) {
+        return {State::Varying};
+    }
+    if (lhs.state == State::Unknown || rhs.state == State::Unknown) {
+        return {State::Unknown};
+    }
+    std::optional<int64_t> value = ssa::Evaluate(inst.op, lhs.value, rhs.value);
+    if (!value.has_value()) {
+        return {State::Varying};
+    }
+    return {State::Constant, value.value()};
+}
+
+// states only ever move down Unknown -> Constant -> Varying
+void Sccp::Update(ValueId value, Lattice next) {
+    Lattice& current = lattice[value];
+    if (next.state == current.state && (next.state != State::Constant || next.value == current.value)) {
+        return;
+    }
+    if (next.state == State::Unknown || current.state == State::Varying) {
+        return;
+    }
+    if (current.state == State::Constant && next.state == State::Constant) {
+        next = {State::Varying};
+    }
+    current = next;
+    valueWork.push_back(value);
+}
+
+void Sccp::Rewrite() {
+    for (BlockId b = 0; b < func->blocks.size(); ++b) {
+        if (!reached[b]) {
+            continue;
+        }
+
+        std::vector<ValueId> insts = func->blocks[b].insts;
+        for (ValueId id : insts) {
+            Inst& inst = func->values[id];
+            const Lattice& result = lattice[id];
+            if (result.state != State::Constant || inst.op == Opcode::Const) {
+                continue;
+            }
+
+            // a constant phi is replaced by a Const after the phis, keeping them at the block start
+            if (inst.op == Opcode::Phi) {
+                ValueId constant = func->Prepend(b, Inst {Opcode::Const, {}, result.value, "", b});
+                func->ReplaceUses(id, constant);
+                func->Remove(id);
+                continue;
+            }
+            inst.op = Opcode::Const;
+            inst.imm = result.value;
+            inst.args.clear();
+        }
+
+        const Inst& term = func->Terminator(b);
+        if (term.op == Opcode::Branch && lattice[term.args[0]].state == State::Constant) {
+            const std::vector<BlockId>& succs = func->blocks[b].succs;
+            func->MakeJump(b, lattice[term.args[0]].value != 0 ? succs[0] : succs[1]);
+        }
+    }
+    func->RemoveUnreachableBlocks();
+}
+
+} // namespace ssa
@@ -0,0 +1,253 @@
+#include "ssaBuilder.hpp"
+
+#include "middleExceptions.hpp"
+
+namespace ssa {
+
+namespace {
+
+constexpr size_t kMaxRegisterArgs = 6;
+
+const std::unordered_map<NodeType, Opcode> kBinaryOpcodes {
+    {Add, Opcode::Add},
+    {Sub, Opcode::Sub},
+    {Mul, Opcode::Mul},
+    {Div, Opcode::Div},
+    {Less, Opcode::Less},
+    {LessOrEqual, Opcode::LessOrEqual},
+    {Greater, Opcode::Greater},
+    {GreaterOrEqual, Opcode::GreaterOrEqual},
+    {Identical, Opcode::Identical},
+    {NotIdentical, Opcode::NotIdentical},
+};
+
+} // namespace
+
+Function SsaBuilder::Build(const Node* def) {
+    func = Function {};
+    func.name = def->GetValue();
+    scopes = {{}};
+    definitions.clear();
+    sealed.clear();
+    incompletePhis.clear();
+
+    current = NewBlock();
+    Seal(current);
+
+    for (const Node* param = def->GetLeft(); param; param = param->GetLeft()) {
+        if (func.paramCount == kMaxRegisterArgs) {
+            throw MiddleExcept::LoweringException("More than " + std::to_string(kMaxRegisterArgs) + " parameters in: " + func.name);
+        }
+        ValueId value = Emit(Opcode::Param, {}, static_cast<int64_t>(func.paramCount++));
+        WriteVariable(Declare(param->GetValue()), current, value);
+    }
+
+    LowerStmt(def->GetRight());
+
+    // falling off the end returns -1, as in the generator
+    Terminate(Opcode::Return, {Emit(Opcode::Const, {}, -1)}, {});
+    return std::move(func);
+}
+
+void SsaBuilder::LowerStmt(const Node* node) {
+    switch (node->GetType()) {
+        case End: {
+            break;
+        }
+        case Semicolon: {
+            LowerStmt(node->GetLeft());
+            LowerStmt(node->GetRight());
+            break;
+        }
+        case Equal: {
+            ValueId value = LowerExpr(node->GetRight());
+            std::string name = node->GetLeft()->GetValue();
+            std::optional<VarId> var = Lookup(name);
+            WriteVariable(var.has_value() ? var.value() : Declare(name), current, value);
+            break;
+        }
+        case If:            LowerIf(node);                                                  break;
+        case While:         LowerWhile(node);                                               break;
+        case Return:        LowerReturn(node);                                              break;
+        case Call:          LowerCall(node);                                                break;
+        case PrintAscii:    Emit(Opcode::PrintAscii, {LowerExpr(node->GetLeft())});         break;
+        case PrintInt:      Emit(Opcode::PrintInt, {LowerExpr(node->GetLeft())});           break;
+        case PrintStr:      Emit(Opcode::PrintStr, {}, 0, node->GetLeft()->GetValue());     break;
+
+        default: {
+            throw MiddleExcept::LoweringException("Unexpected statement in: " + func.name);
+        }
+    }
+}
+
+void SsaBuilder::LowerIf(const Node* node) {
+    ValueId cond = LowerExpr(node->GetLeft());
+    BlockId body = NewBlock();
+    BlockId join = NewBlock();
+    Terminate(Opcode::Branch, {cond}, {body, join});
+    Seal(body);
+
+    current = body;
+    scopes.emplace_back();
+    LowerStmt(node->GetRight());
+    scopes.pop_back();
+    Terminate(Opcode::Jump, {}, {join});
+
+    Seal(join);
+    current = join;
+}
+
+// The loop is rotated as in the generator: a guard branches around it and the condition is
+// tested again at the bottom, so the body block is the loop header and its back edge is a branch.
+void SsaBuilder::LowerWhile(const Node* node) {
+    BlockId body = NewBlock();
+    BlockId exit = NewBlock();
+    Terminate(Opcode::Branch, {LowerExpr(node->GetLeft())}, {body, exit});
+
+    current = body;
+    scopes.emplace_back();
+    LowerStmt(node->GetRight());
+    scopes.pop_back();
+    Terminate(Opcode::Branch, {LowerExpr(node->GetLeft())}, {body, exit});
+
+    // the back edge is in place, so reads from the body can now be resolved
+    Seal(body);
+    Seal(exit);
+    current = exit;
+}
+
+void SsaBuilder::LowerReturn(const Node* node) {
+    Terminate(Opcode::Return, {LowerExpr(node->GetLeft())}, {});
+
+    // whatever follows is unreachable, but still has to be lowered somewhere
+    current = NewBlock();
+    Seal(current);
+}
+
+ValueId SsaBuilder::LowerExpr(const Node* node) {
+    if (auto iter = kBinaryOpcodes.find(node->GetType()); iter != kBinaryOpcodes.end()) {
+        ValueId lhs = LowerExpr(node->GetLeft());
+        ValueId rhs = LowerExpr(node->GetRight());
+        return Emit(iter->second, {lhs, rhs});
+    }
+
+    switch (node->GetType()) {
+        case Number: {
+            return Emit(Opcode::Const, {}, std::stoll(node->GetValue()));
+        }
+        case Identifier: {
+            std::optional<VarId> var = Lookup(node->GetValue());
+            if (!var.has_value()) {
+                throw MiddleExcept::LoweringException("Undefined variable: " + node->GetValue());
+            }
+            return ReadVariable(var.value(), current);
+        }
+        case Call:          return LowerCall(node);
+        case ReadInt:       return Emit(Opcode::ReadInt);
+        case ClockNs:       return Emit(Opcode::ClockNs);
+        case Cycles:        return Emit(Opcode::Cycles);
+        case MapFile:       return Emit(Opcode::MapFile, {}, 0, node->GetLeft()->GetValue());
+        case MapReadInt:    return Emit(Opcode::MapReadInt, {LowerExpr(node->GetLeft())});
+        case MapEof:        return Emit(Opcode::MapEof, {LowerExpr(node->GetLeft())});
+
+        default: {
+            throw MiddleExcept::LoweringException("Unexpected expression in: " + func.name);
+        }
+    }
+}
+
+// arguments are chained through their left links
+ValueId SsaBuilder::LowerCall(const Node* node) {
+    std::vector<ValueId> args;
+    for (const Node* arg = node->GetLeft(); arg; arg = arg->GetLeft()) {
+        if (args.size() == kMaxRegisterArgs) {
+            throw MiddleExcept::LoweringException("More than " + std::to_string(kMaxRegisterArgs) + " arguments to: " + node->GetValue());
+        }
+        args.push_back(LowerExpr(arg));
+    }
+    return Emit(Opcode::Call, std::move(args), 0, node->GetValue());
+}
+
+ValueId SsaBuilder::Emit(Opcode op, std::vector<ValueId> args, int64_t imm, const std::string& name) {
+    return func.Append(current, Inst {op, std::move(args), imm, name, current});
+}
+
+void SsaBuilder::Terminate(Opcode op, std::vector<ValueId> args, const std::vector<BlockId>& succs) {
+    Emit(op, std::move(args));
+    for (BlockId succ : succs) {
+        func.AddEdge(current, succ);
+    }
+}
+
+BlockId SsaBuilder::NewBlock() {
+    sealed.push_back(false);
+    return func.AddBlock();
+}
+
+// no more predecessors will be added, so the pending phis can get their operands
+void SsaBuilder::Seal(BlockId block) {
+    std::vector<std::pair<VarId, ValueId>> pending = std::move(incompletePhis[block]);
+    incompletePhis.erase(block);
+    for (auto [var, phi] : pending) {
+        AddPhiOperands(var, phi);
+    }
+    sealed[block] = true;
+}
+
+SsaBuilder::VarId SsaBuilder::Declare(const std::string& name) {
+    VarId var = definitions.size();
+    definitions.emplace_back();
+    scopes.back()[name] = var;
+    return var;
+}
+
+std::optional<SsaBuilder::VarId> SsaBuilder::Lookup(const std::string& name) const {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        if (auto iter = scope->find(name); iter != scope->end()) {
+            return iter->second;
+        }
+    }
+    return std::nullopt;
+}
+
+void SsaBuilder::WriteVariable(VarId var, BlockId block, ValueId value) {
+    definitions[var][block] = value;
+}
+
+ValueId SsaBuilder::ReadVariable(VarId var, BlockId block) {
+    if (auto iter = definitions[var].find(block); iter != definitions[var].end()) {
+        return iter->second;
+    }
+    return ReadVariableRecursive(var, block);
+}
+
+ValueId SsaBuilder::ReadVariableRecursive(VarId var, BlockId block) {
+    std::vector<BlockId> preds = func.blocks[block].preds;
+    ValueId value;
+    if (!sealed[block]) {
+        value = func.AddPhi(block);
+        incompletePhis[block].push_back({var, value});
+    } else if (preds.empty()) {
+        // only code after a Return has no predecessors, and it never runs
+        value = func.Prepend(block, Inst {Opcode::Const, {}, 0, "", block});
+    } else if (preds.size() == 1) {
+        value = ReadVariable(var, preds[0]);
+    } else {
+        // recorded before the operands are read, so a loop finds this phi and stops
+        value = func.AddPhi(block);
+        WriteVariable(var, block, value);
+        AddPhiOperands(var, value);
+    }
+    WriteVariable(var, block, value);
+    return value;
+}
+
+void SsaBuilder::AddPhiOperands(VarId var, ValueId phi) {
+    std::vector<BlockId> preds = func.blocks[func.values[phi].block].preds;
+    for (BlockId pred : preds) {
+        ValueId arg = ReadVariable(var, pred);
+        func.values[phi].args.push_back(arg);
+    }
+}
+
+} // namespace ssa
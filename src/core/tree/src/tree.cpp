@@ -2,10 +2,50 @@
 
 #include <iostream>
 #include <fstream>
+#include <cctype>
 
 #include "treeExceptions.hpp"
 #include "node_types.hpp"
 
+namespace {
+
+const char kEscapeChar = '%';
+const char kHexDigits[] = "0123456789abcdef";
+
+// values are separated by whitespace in the serialized form, so string
+// literals have whitespace, control characters and the escape char itself
+// written as %XX
+std::string EscapeValue(const std::string& value) {
+    std::string result;
+    for (unsigned char c : value) {
+        if (std::isgraph(c) && c != kEscapeChar) {
+            result += static_cast<char>(c);
+        } else {
+            result += kEscapeChar;
+            result += kHexDigits[c >> 4];
+            result += kHexDigits[c & 0xf];
+        }
+    }
+    return result;
+}
+
+std::string UnescapeValue(const std::string& value) {
+    std::string result;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == kEscapeChar && i + 2 < value.size() &&
+            std::isxdigit(value[i + 1]) && std::isxdigit(value[i + 2]))
+        {
+            result += static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            result += value[i];
+        }
+    }
+    return result;
+}
+
+} // namespace
+
 void Tree::Dump(const std::string& fileName) const {
     std::ofstream file(fileName + ".gv");
     if (!file) {
@@ -108,7 +148,7 @@ void Tree::PreOrderTraversal(std::ofstream& file, Node* node) const {
         return;
     }
 
-    file << node->GetType() << " " << node->GetValue() << " ";
+    file << node->GetType() << " " << EscapeValue(node->GetValue()) << " ";
 
     PreOrderTraversal(file, node->GetLeft());
     PreOrderTraversal(file, node->GetRight());    
@@ -149,7 +189,7 @@ void Tree::Deserialize(const std::string& fileName) {
         while (i < data.size() && !std::isspace(data[i])) {
             buffer += data[i++];
         }
-        tokens.push_back({type, buffer});
+        tokens.push_back({type, UnescapeValue(buffer)});
     }
 
     SetRoot(ParseTreeFromTokens(tokens).first);
@@ -26,7 +26,7 @@ int main(int argc, const char** argv) {
             return frontend.exit_code;
         }
 
-        auto backend = app::proc::RunProcess("./build/src/core/backend/backend", {cfg.ast, cfg.output});
+        auto backend = app::proc::RunProcess("./build/src/core/backend/backend", {cfg.ast, cfg.output, "--codegen=" + cfg.codegen});
         if (backend.exit_code) {
             std::cerr << "Backend failed:\n" << backend.stderr_text;
             return backend.exit_code;